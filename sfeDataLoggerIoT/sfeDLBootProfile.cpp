@@ -0,0 +1,75 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - boot phase timing
+ *
+ */
+
+#include "sfeDLBootProfile.h"
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLBootProfile::sfeDLBootProfile()
+{
+    for (int i = 0; i < kBootPhases; i++)
+    {
+        _msStart[i] = 0;
+        _msEnd[i] = 0;
+    }
+}
+
+//---------------------------------------------------------------------------
+// Only the first run of a phase is recorded. millis() starts at boot - a phase that starts in the first ms is
+// recorded at 1 ms, so 0 is "not started"
+
+void sfeDLBootProfile::start(uint8_t phase)
+{
+    uint32_t ticks = millis();
+    if (phase < kBootPhases && _msStart[phase] == 0)
+        _msStart[phase] = ticks > 0 ? ticks : 1;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLBootProfile::end(uint8_t phase)
+{
+    if (phase < kBootPhases && _msStart[phase] != 0 && _msEnd[phase] == 0)
+        _msEnd[phase] = millis();
+}
+
+//---------------------------------------------------------------------------
+const char *sfeDLBootProfile::phaseName(uint8_t phase)
+{
+    switch (phase)
+    {
+    case kBootSerial:
+        return "Serial";
+    case kBootStartupMenu:
+        return "Startup Menu";
+    case kBootBoardCheck:
+        return "Board Check";
+    case kBootDeviceLoad:
+        return "Device Load";
+    case kBootRestore:
+        return "Settings Restore";
+    case kBootStart:
+        return "Start";
+    case kBootWiFi:
+        return "WiFi Connect";
+    case kBootDeviceSetup:
+        return "Device Setup";
+    case kBootTime:
+        return "Clock Setup";
+    case kBootStatus:
+        return "Status Output";
+    }
+    return "Unknown";
+}
@@ -0,0 +1,58 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - boot phase timing
+ *
+ * The start and end (ms since boot) of each startup phase - the first time it runs. Phases can overlap - the
+ * WiFi connection runs on its own task. Output by the !boot-profile command.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+class sfeDLBootProfile
+{
+  public:
+    // Startup phases
+    static constexpr uint8_t kBootSerial = 0;
+    static constexpr uint8_t kBootStartupMenu = 1;
+    static constexpr uint8_t kBootBoardCheck = 2;
+    static constexpr uint8_t kBootDeviceLoad = 3;
+    static constexpr uint8_t kBootRestore = 4;
+    static constexpr uint8_t kBootStart = 5;
+    static constexpr uint8_t kBootWiFi = 6;
+    static constexpr uint8_t kBootDeviceSetup = 7;
+    static constexpr uint8_t kBootTime = 8;
+    static constexpr uint8_t kBootStatus = 9;
+    static constexpr uint8_t kBootPhases = 10;
+
+    sfeDLBootProfile();
+
+    void start(uint8_t phase);
+    void end(uint8_t phase);
+
+    // ms since boot - 0 if the phase hasn't started/ended
+    uint32_t msStart(uint8_t phase)
+    {
+        return phase < kBootPhases ? _msStart[phase] : 0;
+    }
+    uint32_t msEnd(uint8_t phase)
+    {
+        return phase < kBootPhases ? _msEnd[phase] : 0;
+    }
+
+    static const char *phaseName(uint8_t phase);
+
+  private:
+    // phases can be marked from other tasks
+    volatile uint32_t _msStart[kBootPhases];
+    volatile uint32_t _msEnd[kBootPhases];
+};
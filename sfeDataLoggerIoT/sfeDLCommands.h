@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include "sfeDLEvents.h"
+#include "sfeDLSerialDownload.h"
 #include "sfeDataLogger.h"
 #include <ArduinoJson.h>
 
@@ -17,6 +19,9 @@
 #include <Flux/flxUtils.h>
 #include <time.h>
 
+#include <algorithm>
+#include <set>
+
 class sfeDLCommands
 {
     typedef bool (sfeDLCommands::*commandCB_t)(sfeDataLogger *);
@@ -58,7 +63,7 @@ class sfeDLCommands
         if (!dlApp)
             return false;
 
-        dlApp->_sysStorage.resetStorage();
+        dlApp->_settingsStore.resetStorage();
         flxLog_I(F("Settings Cleared"));
 
         dlApp->_sysUpdate.restartDevice();
@@ -90,7 +95,7 @@ class sfeDLCommands
         if (!dlApp)
             return false;
 
-        dlApp->_sysStorage.resetStorage();
+        dlApp->_settingsStore.resetStorage();
         flxLog_I(F("Settings Cleared"));
 
         return true;
@@ -98,16 +103,23 @@ class sfeDLCommands
     //---------------------------------------------------------------------
     bool restartDevice(sfeDataLogger *dlApp)
     {
-        if (dlApp)
-            dlApp->_sysUpdate.restartDevicePrompt();
+        if (!dlApp)
+            return false;
+
+        // a pending settings save is lost in a restart
+        dlApp->_settingsSaver.flush();
+        dlApp->_sysUpdate.restartDevicePrompt();
 
         return true;
     }
     //---------------------------------------------------------------------
     bool restartDeviceForced(sfeDataLogger *dlApp)
     {
-        if (dlApp)
-            dlApp->_sysUpdate.restartDevice();
+        if (!dlApp)
+            return false;
+
+        dlApp->_settingsSaver.flush();
+        dlApp->_sysUpdate.restartDevice();
 
         return true;
     }
@@ -179,6 +191,36 @@ class sfeDLCommands
     }
     //---------------------------------------------------------------------
     ///
+    /// @brief Outputs the settings storage stats - the snapshot restore time and size, values read from the per
+    /// setting storage, the NVS writes of saves, and the deferred save requests, counts and times
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool settingsStats(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLSettingsSnapshot &theStore = dlApp->_settingsStore;
+
+        flxLog_N(F("Settings Snapshot: %s  Restore: %.2f ms  Values: %u  Size: %u bytes  Per Setting Reads: %u"),
+                 theStore.restored() ? "restored" : "not found", theStore.usRestore() / 1000., theStore.nValues(),
+                 theStore.size(), theStore.nLegacyReads());
+        flxLog_N(F("    Saves: %u  NVS Writes: %u  Last Save: %u values  %u changed  %u ms"), theStore.nSaves(),
+                 theStore.nWrites(), theStore.nLastSaved(), theStore.nLastChanged(), theStore.msLastSave());
+
+        sfeDLSettingsSaver &theSaver = dlApp->_settingsSaver;
+        flxLog_N(F("    Save Requests: %u  Saves: %u  With SD Fallback: %u  Failed: %u  Pending: %s"),
+                 theSaver.nRequests(), theSaver.nSaves(), theSaver.nFallbackSaves(), theSaver.nFailed(),
+                 theSaver.pending() ? "yes" : "no");
+        flxLog_N(F("    Save Time - Last: %u ms  Avg: %u ms  Max: %u ms"), theSaver.msLastSave(), theSaver.msSaveAvg(),
+                 theSaver.msSaveMax());
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
     /// @brief Dumps out the current heap size/stats
     ///
     /// @param dlApp Pointer to the DataLogger App
@@ -321,6 +363,60 @@ class sfeDLCommands
         return true;
     }
 
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Outputs the log file write times - the first write of recent startups (open, seek to the end and
+    /// append) with the file size, and the append times of this startup
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool logFileStats(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLLogFileStats &theStats = dlApp->_logFileStats;
+
+        flxLog_N(F("Log File Writes: %u  First Write: %.2f ms  Append Avg: %.2f ms  Max: %.2f ms"), theStats.nWrites(),
+                 theStats.usFirstWrite() / 1000., theStats.usAppendAvg() / 1000., theStats.usAppendMax() / 1000.);
+        flxLog_N(F("    Opened At Saved Position: %s"), theStats.resumed() ? "yes" : "no");
+
+        sfeDLLogFileOpen_t entries[kLogFileHistory];
+        uint8_t nEntries = theStats.history(entries);
+        if (nEntries == 0)
+            return true;
+
+        flxLog_N(F("    First write of recent startups - oldest first:"));
+        for (uint8_t i = 0; i < nEntries; i++)
+            flxLog_N(F("    File Size: %8u bytes  First Write: %.2f ms  %s"), entries[i].fileSize,
+                     entries[i].usFirstWrite / 1000., entries[i].bResumed ? "saved position" : "seek to end");
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Outputs the wall clock state - how the clock was corrected at startup, the sleep drift estimate and
+    /// the clock steps seen
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool clockStats(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLTimeKeeper &theClock = dlApp->_timeKeeper;
+
+        flxLog_N(F("Clock Startup: %s  Correction: %.3f secs"), theClock.startSourceName(), theClock.startCorrection());
+        flxLog_N(F("    Sleep Drift: %.1f ppm  Asleep Since Set: %u secs"), theClock.driftPPM(),
+                 theClock.secsAsleep());
+        flxLog_N(F("    Steps: %u  Last Step: %.3f secs  Corrections Logged: %u"), theClock.nSteps(),
+                 theClock.lastStep(), theClock.nCorrections());
+
+        return true;
+    }
     //---------------------------------------------------------------------
     ///
     /// @brief Lists loaded devices
@@ -351,6 +447,62 @@ class sfeDLCommands
     }
     //---------------------------------------------------------------------
     ///
+    /// @brief Outputs the loaded device cache - the device set from the last startup, and the load time
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool deviceCache(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLDeviceCache &theCache = dlApp->_deviceCache;
+
+        flxLog_N(F("Device Cache: %u devices - %s at startup  Device Load Time: %u ms"), theCache.cached().size(),
+                 theCache.matched() ? "matched" : "updated", theCache.msLoad());
+        flxLog_N(F("    Loaded From: %s  Last Full Scan: %u ms"), theCache.cachedLoad() ? "cache" : "full scan",
+                 theCache.msAutoload());
+
+        for (auto &entry : theCache.cached())
+            flxLog_N(F("    %s"), entry.c_str());
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Scans the qwiic bus and reports changes from the loaded device cache
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool deviceScan(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        dlApp->_deviceCache.scan();
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Clears the loaded device cache - the device set is saved again at the next startup
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool deviceCacheClear(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        dlApp->_deviceCache.clear();
+
+        flxLog_I(F("Device cache cleared"));
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
     /// @brief outputs current time
     ///
     /// @param dlApp Pointer to the DataLogger App
@@ -406,7 +558,7 @@ class sfeDLCommands
         if (!dlApp)
             return false;
 
-        flxSendEvent(flxEvent::kOnLogObservationWithSource, "CLI");
+        flxSendEvent(flxEvent::kOnLogObservationWithSource, kDLEventSourceCLI);
 
         return true;
     }
@@ -459,6 +611,380 @@ class sfeDLCommands
         return true;
     }
     //---------------------------------------------------------------------
+    ///
+    /// @brief Outputs the publish statistics of the enabled IoT endpoints
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool iotStats(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        int nEnabled = 0;
+        for (auto pChannel : dlApp->_iotPublisher)
+        {
+            if (!pChannel->endpointEnabled())
+                continue;
+
+            if (nEnabled++ == 0)
+                flxLog_I(F("IoT Publishing:"));
+
+            flxLog_N(F("    %-24s  Publishes: %u (%.2f/sec)  Observations: %u  Bytes/Observation: %.1f  Pending: %u"),
+                     pChannel->name(), pChannel->nPublishes(), pChannel->publishRate(), pChannel->nObservations(),
+                     pChannel->nObservations() > 0 ? (float)pChannel->nBytes() / (float)pChannel->nObservations() : 0.,
+                     pChannel->pending());
+
+            flxLog_N(F("    %-24s  Publish Time (ms) - p50: %u  p90: %u  p99: %u  Max: %u"), "",
+                     pChannel->publishTimePercentile(50), pChannel->publishTimePercentile(90),
+                     pChannel->publishTimePercentile(99), pChannel->maxPublishTime());
+
+            if (pChannel->background() || pChannel->queued() > 0 || pChannel->held() > 0)
+                flxLog_N(F("    %-24s  Queued: %u  Held: %u  Dropped: %u  Over Budget: %u"), "", pChannel->queued(),
+                         pChannel->held(), pChannel->nDropped(), pChannel->nOverBudget());
+        }
+        if (nEnabled == 0)
+        {
+            flxLog_I(F("No IoT services enabled"));
+            return true;
+        }
+
+        sfeDLIoTHTTP &theHTTP = dlApp->_iotHTTPKeepAlive;
+        if (theHTTP.enabled())
+            flxLog_N(F("    %-24s  Connections: %u (%.1f ms/publish)  Reused: %u (%.1f ms/publish)  Reconnects: %u  "
+                       "Failures: %u  Lines Dropped: %u"),
+                     theHTTP.name(), theHTTP.nHandshakes(), theHTTP.handshakeTime(), theHTTP.nReused(),
+                     theHTTP.reusedTime(), theHTTP.nReconnects(), theHTTP.nFailures(), theHTTP.nLinesDropped());
+
+        sfeDLIoTUDP &theUDP = dlApp->_iotUDP;
+        if (theUDP.enabled())
+            flxLog_N(F("    %-24s  Datagrams: %u  Payloads: %u  Bytes: %u  Send Errors: %u  Sequence: %u"),
+                     theUDP.name(), theUDP.nDatagrams(), theUDP.nPayloads(), theUDP.nBytes(), theUDP.nSendErrors(),
+                     theUDP.sequence());
+
+        // memory high water mark
+        flxLog_N(F("    Free Heap: %u bytes  Min Free Heap: %u bytes"), ESP.getFreeHeap(), ESP.getMinFreeHeap());
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Times the IoT payload encoders on a new observation
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool iotBenchmark(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        // the benchmark runs on the next observation - so log one now
+        dlApp->_iotPublisher.requestBenchmark();
+        flxSendEvent(flxEvent::kOnLogObservationWithSource, kDLEventSourceCLI);
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Resets the IoT publish statistics
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool iotStatsReset(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        for (auto pChannel : dlApp->_iotPublisher)
+            pChannel->resetStats();
+
+        dlApp->_iotHTTPKeepAlive.resetStats();
+        dlApp->_iotUDP.resetStats();
+
+        flxLog_I(F("IoT publish statistics reset"));
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Outputs the log file sync status
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool syncStatus(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLSyncEngine &theSync = dlApp->_syncEngine;
+
+        flxLog_N(F("Log File Sync: %s"), theSync.enabled() ? "enabled" : "disabled");
+
+        std::string syncFile = theSync.currentFile();
+        if (syncFile.length() > 0)
+            flxLog_N(F("    Syncing: %s  %u of %u bytes"), syncFile.c_str(), theSync.currentOffset(),
+                     theSync.currentSize());
+        else
+            flxLog_N(F("    Syncing: <idle>"));
+
+        flxLog_N(F("    SD Card ID: %08x  Last Synced File Number: %u"), theSync.cardId(), theSync.lastSyncedNumber());
+        flxLog_N(F("    Files: %u  Chunks: %u  Retries: %u  Bytes: %u"), theSync.nFilesSynced(), theSync.nChunks(),
+                 theSync.nRetries(), theSync.nBytes());
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Clears the log file sync state - all log files are sent again
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool syncReset(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        dlApp->_syncEngine.resetSync();
+
+        flxLog_I(F("Log file sync state cleared"));
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Outputs the WiFi radio usage, the connect times and the battery trend
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool radioStats(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLRadioManager &theRadio = dlApp->_radioManager;
+
+        flxLog_N(F("WiFi: %s  Radio: %s"), theRadio.onDemand() ? "on demand" : "always on", theRadio.stateName());
+        flxLog_N(F("    Radio On: %.1f secs  Per Hour: %.1f secs"), theRadio.msRadioOn() / 1000.,
+                 theRadio.radioOnPerHour());
+        flxLog_N(F("    Upload Windows: %u  Timed Out: %u  Observations: %u  Held: %u  Undelivered: %u"),
+                 theRadio.nWindows(), theRadio.nTimeouts(), theRadio.nObservations(), theRadio.nQueued(),
+                 dlApp->_iotPublisher.undelivered());
+
+        sfeDLFastConnect &theConnect = theRadio.fastConnect();
+        flxLog_N(F("    Connect Last: %s %.2f secs  Link Cached: %s"), theConnect.lastConnectName(),
+                 theConnect.msLast() / 1000., theConnect.cached() ? "yes" : "no");
+        flxLog_N(F("    Fast: %u (DHCP %u)  Avg: %.2f secs  Failed: %u  Full Scan: %u  Avg: %.2f secs  Failed: %u"),
+                 theConnect.nFast(), theConnect.nFastDHCP(), theConnect.msFastAvg() / 1000., theConnect.nFastFailed(),
+                 theConnect.nFull(), theConnect.msFullAvg() / 1000., theConnect.nFailed());
+
+        // The battery trend shows the energy used on hardware
+        if (dlApp->_fuelGauge)
+            flxLog_N(F("    Battery: %.1f%%  Change Rate: %.2f%%/hr"), dlApp->_fuelGauge->getSOC(),
+                     dlApp->_fuelGauge->getChangeRate());
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Resets the WiFi radio usage statistics
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool radioStatsReset(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        dlApp->_radioManager.resetStats();
+
+        flxLog_I(F("WiFi radio statistics reset"));
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Opens a WiFi upload window now - when WiFi is on demand
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool radioWindow(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        if (!dlApp->_radioManager.onDemand())
+        {
+            flxLog_I(F("WiFi is always on - no upload window needed"));
+            return true;
+        }
+        dlApp->_radioManager.requestWindow();
+
+        flxLog_I(F("WiFi upload window requested"));
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Outputs the serial console output buffer statistics
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool serialStats(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLSerialOutput &theOutput = dlApp->_serialOutput;
+
+        if (theOutput.size() == 0)
+        {
+            flxLog_N(F("Serial Output: not buffered"));
+            return true;
+        }
+        flxLog_N(F("Serial Output: %s when full  Buffer: %u bytes  Used: %u  Peak: %u"),
+                 theOutput.policyName(), theOutput.size(), theOutput.used(), theOutput.highWater());
+        flxLog_N(F("    Records: %u  Dropped: %u (%u bytes)  Time Blocked: %.2f secs"), theOutput.nRecords(),
+                 theOutput.nDropped(), theOutput.nDroppedBytes(), theOutput.msBlocked() / 1000.);
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Resets the serial console output buffer statistics
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool serialStatsReset(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        dlApp->_serialOutput.resetStats();
+
+        flxLog_I(F("Serial output statistics reset"));
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Outputs the wake from sleep statistics - cold and warm wake timings
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool wakeStats(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLWakeState &theWake = dlApp->_wakeState;
+
+        flxLog_N(F("Wake: %s  First Observation: %u ms after boot  Last Cycle Awake: %.1f secs"),
+                 theWake.isWarm() ? "warm" : "cold", theWake.msFirstObservation(), theWake.msLastAwake() / 1000.);
+
+        const sfeDLWakeTimes_t *wakeTimes[] = {&theWake.coldTimes(), &theWake.warmTimes()};
+        const char *wakeNames[] = {"Cold", "Warm"};
+
+        for (int i = 0; i < 2; i++)
+        {
+            const sfeDLWakeTimes_t &theTimes = *wakeTimes[i];
+            flxLog_N(F("    %s Wakes: %u  Avg First Observation: %u ms  Avg Awake: %.1f secs"), wakeNames[i],
+                     theTimes.nCycles, theTimes.nFirstObs ? theTimes.msFirstObsTotal / theTimes.nFirstObs : 0,
+                     theTimes.nAwake ? theTimes.msAwakeTotal / 1000. / theTimes.nAwake : 0.);
+        }
+
+        sfeDLSleepBuffer &theBuffer = dlApp->_sleepBuffer;
+        if (!theBuffer.buffering() && theBuffer.nFlushes() == 0)
+            return true;
+
+        flxLog_N(F("Sleep Buffer: %s  Records: %u  Used: %u of %u bytes  Wakes: %u of %u"),
+                 theBuffer.buffering() ? "on" : "off", theBuffer.count(), theBuffer.used(), theBuffer.capacity(),
+                 theBuffer.wakes(), theBuffer.flushWakes());
+        flxLog_N(F("    Recovered: %u  Writes: %u  Records Written: %u  Full: %u  Damaged: %u  Held For IoT: %u"),
+                 theBuffer.nRecovered(), theBuffer.nFlushes(), theBuffer.nFlushed(), theBuffer.nFull(),
+                 theBuffer.nDamaged(), theBuffer.nHeld());
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Resets the wake from sleep statistics
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool wakeStatsReset(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        dlApp->_wakeState.resetStats();
+
+        flxLog_I(F("Wake statistics reset"));
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Outputs the startup timeline - start, end and duration of each phase, in start order
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool bootProfile(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLBootProfile &theProfile = dlApp->_bootProfile;
+
+        uint8_t phases[sfeDLBootProfile::kBootPhases];
+        for (uint8_t i = 0; i < sfeDLBootProfile::kBootPhases; i++)
+            phases[i] = i;
+
+        std::sort(phases, phases + sfeDLBootProfile::kBootPhases, [&theProfile](uint8_t a, uint8_t b) {
+            return theProfile.msStart(a) < theProfile.msStart(b);
+        });
+
+        flxLog_N(F("Boot Profile (%s wake) - ms since boot:"), dlApp->_wakeState.isWarm() ? "warm" : "cold");
+        flxLog_N(F("    %-18s  %8s  %8s  %8s"), "Phase", "Start", "End", "Time");
+
+        for (uint8_t phase : phases)
+        {
+            uint32_t msStart = theProfile.msStart(phase);
+            if (msStart == 0)
+                continue; // didn't run
+
+            uint32_t msEnd = theProfile.msEnd(phase);
+            if (msEnd == 0)
+                flxLog_N(F("    %-18s  %8u  %8s  %8s"), sfeDLBootProfile::phaseName(phase), msStart, "-", "-");
+            else
+                flxLog_N(F("    %-18s  %8u  %8u  %8u"), sfeDLBootProfile::phaseName(phase), msStart, msEnd,
+                         msEnd - msStart);
+        }
+        flxLog_N(F("    %-18s  %8u"), "First Observation", dlApp->_wakeState.msFirstObservation());
+
+        return true;
+    }
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Sends a file from the SD card to the host download tool (tools/dl_serial_download.py)
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @retval bool indicates success (true) or failure (!true)
+    ///
+    bool downloadFile(sfeDataLogger *dlApp)
+    {
+        if (!dlApp)
+            return false;
+
+        sfeDLSerialDownload theDownload;
+        return theDownload.send(&dlApp->_theSDCard, _args.c_str());
+    }
+    //---------------------------------------------------------------------
     // our command map - command name to callback method
     commandMap_t _commandMap = {
         {"factory-reset", &sfeDLCommands::factoryResetDevice},
@@ -474,9 +1000,29 @@ class sfeDLCommands
         {"log-now", &sfeDLCommands::logObservationNow},
         {"wifi", &sfeDLCommands::wifiStats},
         {"sdcard", &sfeDLCommands::sdCardStats},
+        {"log-file-stats", &sfeDLCommands::logFileStats},
+        {"clock-stats", &sfeDLCommands::clockStats},
+        {"download", &sfeDLCommands::downloadFile},
         {"devices", &sfeDLCommands::listLoadedDevices},
+        {"device-cache", &sfeDLCommands::deviceCache},
+        {"device-cache-clear", &sfeDLCommands::deviceCacheClear},
+        {"device-scan", &sfeDLCommands::deviceScan},
         {"save-settings", &sfeDLCommands::saveSettings},
+        {"settings-stats", &sfeDLCommands::settingsStats},
         {"heap", &sfeDLCommands::heapStatus},
+        {"iot-stats", &sfeDLCommands::iotStats},
+        {"iot-stats-reset", &sfeDLCommands::iotStatsReset},
+        {"iot-bench", &sfeDLCommands::iotBenchmark},
+        {"sync-status", &sfeDLCommands::syncStatus},
+        {"sync-reset", &sfeDLCommands::syncReset},
+        {"radio-stats", &sfeDLCommands::radioStats},
+        {"radio-stats-reset", &sfeDLCommands::radioStatsReset},
+        {"radio-window", &sfeDLCommands::radioWindow},
+        {"serial-stats", &sfeDLCommands::serialStats},
+        {"serial-stats-reset", &sfeDLCommands::serialStatsReset},
+        {"boot-profile", &sfeDLCommands::bootProfile},
+        {"wake-stats", &sfeDLCommands::wakeStats},
+        {"wake-stats-reset", &sfeDLCommands::wakeStatsReset},
         {"verbose", &sfeDLCommands::toggleVerboseOutput},
         {"systime", &sfeDLCommands::outputSystemTime},
         {"uptime", &sfeDLCommands::outputUpTime},
@@ -487,22 +1033,69 @@ class sfeDLCommands
         {"help", &sfeDLCommands::helpDevice},
     };
 
+    // commands that stay on the console task - they prompt for input, or run for a while
+    std::set<std::string> _consoleCommands = {"factory-reset", "reset-device", "clear-settings", "restart",
+                                              "download"};
+
+    // command arguments - the text after the command name
+    std::string _args;
+
   public:
-    bool processCommand(sfeDataLogger *dlApp)
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Reads a command line from the serial console
+    ///
+    /// @param sBuffer The command line read
+    /// @returns true if a line was entered
+    ///
+    bool readCommand(std::string &sBuffer)
     {
         // The data editor we're using - serial field
         flxSerialField theDataEditor;
-        std::string sBuffer;
         bool status = theDataEditor.editFieldString(sBuffer);
 
         flxLog_N(""); // need to output a CR
 
-        if (!status)
-            return false;
+        return status;
+    }
+
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Checks if a command runs on the console task - it prompts for input, or runs for a while (a
+    /// download). Other commands run on the main loop.
+    ///
+    /// @param sBuffer The command line
+    /// @returns true if the command runs on the console task
+    ///
+    bool runsOnConsole(const std::string &sBuffer)
+    {
+        std::string sCommand = flx_utils::strtrim(sBuffer);
+        return _consoleCommands.count(sCommand.substr(0, sCommand.find(' '))) > 0;
+    }
+
+    //---------------------------------------------------------------------
+    ///
+    /// @brief Runs a command line read by readCommand()
+    ///
+    /// @param dlApp Pointer to the DataLogger App
+    /// @param sBuffer The command line
+    /// @returns true on success
+    ///
+    bool runCommand(sfeDataLogger *dlApp, std::string sBuffer)
+    {
+        bool status;
 
         // cleanup string
         sBuffer = flx_utils::strtrim(sBuffer);
 
+        // any arguments follow the command name
+        size_t argStart = sBuffer.find(' ');
+        if (argStart != std::string::npos)
+        {
+            _args = flx_utils::strtrim(sBuffer.substr(argStart + 1));
+            sBuffer.erase(argStart);
+        }
+
         // Find our command
         commandMap_t::iterator it = _commandMap.find(sBuffer);
         if (it != _commandMap.end())
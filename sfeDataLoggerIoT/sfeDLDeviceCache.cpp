@@ -0,0 +1,409 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - loaded device cache
+ *
+ */
+
+#include "sfeDLDeviceCache.h"
+
+#include <Flux/flxCoreLog.h>
+#include <Flux/flxFlux.h>
+
+#include <Flux/flxDevBME280.h>
+#include <Flux/flxDevButton.h>
+#include <Flux/flxDevENS160.h>
+#include <Flux/flxDevGNSS.h>
+#include <Flux/flxDevISM330.h>
+#include <Flux/flxDevMAX17048.h>
+#include <Flux/flxDevMMC5983.h>
+#include <Flux/flxDevRV8803.h>
+#include <Flux/flxDevSHTC3.h>
+#include <Flux/flxDevST25DV.h>
+#include <Flux/flxDevTwist.h>
+
+#include <Preferences.h>
+#include <Wire.h>
+
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+// NVS namespace for the device cache - the set is a single string, an entry per line
+static const char *kDeviceCachePrefsName = "dldevices";
+
+// qwiic addresses probed by a scan - the 7 bit range, less the reserved addresses
+const uint8_t kDeviceScanFirst = 0x08;
+const uint8_t kDeviceScanLast = 0x77;
+
+//---------------------------------------------------------------------------
+// Drivers that cached devices can be built with - by driver name. A cached qwiic device without a driver here
+// means a full auto-load.
+
+template <class T> static flxDevice *buildDevice(uint8_t address)
+{
+    T *pDevice = new T;
+    pDevice->setAddress(address);
+    if (pDevice->initialize(Wire))
+        return pDevice;
+
+    delete pDevice;
+    return nullptr;
+}
+
+typedef struct
+{
+    const char *(*name)(void);
+    flxDevice *(*build)(uint8_t address);
+} sfeDLDeviceBuilder_t;
+
+static const sfeDLDeviceBuilder_t kDeviceBuilders[] = {
+    {flxDevBME280::getDeviceName, buildDevice<flxDevBME280>},
+    {flxDevButton::getDeviceName, buildDevice<flxDevButton>},
+    {flxDevENS160::getDeviceName, buildDevice<flxDevENS160>},
+    {flxDevGNSS::getDeviceName, buildDevice<flxDevGNSS>},
+    {flxDevISM330::getDeviceName, buildDevice<flxDevISM330>},
+    {flxDevMAX17048::getDeviceName, buildDevice<flxDevMAX17048>},
+    {flxDevMMC5983::getDeviceName, buildDevice<flxDevMMC5983>},
+    {flxDevRV8803::getDeviceName, buildDevice<flxDevRV8803>},
+    {flxDevSHTC3::getDeviceName, buildDevice<flxDevSHTC3>},
+    {flxDevST25DV::getDeviceName, buildDevice<flxDevST25DV>},
+    {flxDevTwist::getDeviceName, buildDevice<flxDevTwist>},
+};
+
+// The driver for a cached device name - the name can have the address added (verbose device names)
+static const sfeDLDeviceBuilder_t *findBuilder(const char *szName)
+{
+    for (auto &builder : kDeviceBuilders)
+    {
+        size_t length = strlen(builder.name());
+        if (strncmp(szName, builder.name(), length) == 0 && !isalnum(szName[length]))
+            return &builder;
+    }
+    return nullptr;
+}
+
+//---------------------------------------------------------------------------
+// The cache entry for a device
+
+static std::string deviceEntry(flxDevice *pDevice)
+{
+    const char *szKind = "gpio";
+    if (pDevice->getKind() == flxDeviceKindI2C)
+        szKind = "qwiic";
+    else if (pDevice->getKind() == flxDeviceKindSPI)
+        szKind = "spi";
+
+    char szEntry[64];
+    snprintf(szEntry, sizeof(szEntry), "%s %x %s", szKind, pDevice->address(), pDevice->name());
+    return szEntry;
+}
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLDeviceCache::sfeDLDeviceCache()
+    : _bMatched{false}, _bCachedLoad{false}, _loadStartTicks{0}, _msLoad{0}, _msAutoload{0}
+{
+}
+
+//---------------------------------------------------------------------------
+void sfeDLDeviceCache::load(void)
+{
+    _cached.clear();
+
+    Preferences prefs;
+    if (!prefs.begin(kDeviceCachePrefsName, true))
+        return;
+
+    std::string theSet = prefs.getString("set", "").c_str();
+
+    // the addresses that answered at the last full load - a bit per address
+    uint8_t addresses[16] = {0};
+    prefs.getBytes("addrs", addresses, sizeof(addresses));
+    _msAutoload = prefs.getUInt("msauto", 0);
+
+    prefs.end();
+
+    _savedAddresses.reset();
+    for (uint8_t address = 0; address < _savedAddresses.size(); address++)
+        _savedAddresses[address] = (addresses[address / 8] >> (address % 8)) & 1;
+
+    size_t lineStart = 0;
+    while (lineStart < theSet.length())
+    {
+        size_t lineEnd = theSet.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = theSet.length();
+
+        _cached.push_back(theSet.substr(lineStart, lineEnd - lineStart));
+        lineStart = lineEnd + 1;
+    }
+}
+
+//---------------------------------------------------------------------------
+void sfeDLDeviceCache::save(void)
+{
+    std::string theSet;
+    for (auto &entry : _cached)
+    {
+        theSet += entry;
+        theSet += '\n';
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(kDeviceCachePrefsName, false))
+        return;
+
+    prefs.putString("set", theSet.c_str());
+    prefs.end();
+}
+
+//---------------------------------------------------------------------------
+// sweep()
+//
+// The qwiic addresses that answer
+
+void sfeDLDeviceCache::sweep(addressSet_t &theSet)
+{
+    theSet.reset();
+    for (uint8_t address = kDeviceScanFirst; address <= kDeviceScanLast; address++)
+    {
+        Wire.beginTransmission(address);
+        theSet[address] = Wire.endTransmission() == 0;
+    }
+}
+
+//---------------------------------------------------------------------------
+// loadCached()
+//
+// Called before the framework's auto-load. If the same qwiic addresses answer as at the last full load, the
+// cached devices are built at their addresses. If any of them can't be, the ones built are dropped and the
+// auto-load runs.
+
+bool sfeDLDeviceCache::loadCached(void)
+{
+    load();
+
+    Wire.begin();
+    sweep(_addresses);
+
+    if (_cached.size() == 0 || _savedAddresses.none())
+        return false;
+
+    if (_addresses != _savedAddresses)
+    {
+        flxLog_I(F("The qwiic bus changed since the last startup - loading devices with a full scan"));
+        return false;
+    }
+
+    // A driver for every cached qwiic device? SPI and GPIO devices are set up by the app
+    std::vector<std::pair<const sfeDLDeviceBuilder_t *, uint8_t>> toBuild;
+    for (auto &entry : _cached)
+    {
+        unsigned int address;
+        char szName[48];
+        if (sscanf(entry.c_str(), "qwiic %x %47[^\n]", &address, szName) != 2)
+            continue;
+
+        const sfeDLDeviceBuilder_t *pBuilder = findBuilder(szName);
+        if (!pBuilder)
+        {
+            flxLog_V(F("No cached load driver for %s - loading devices with a full scan"), szName);
+            return false;
+        }
+        toBuild.push_back({pBuilder, address});
+    }
+
+    std::vector<flxDevice *> built;
+    for (auto &item : toBuild)
+    {
+        flxDevice *pDevice = item.first->build(item.second);
+        if (!pDevice)
+        {
+            flxLog_W(F("Cached device %s at 0x%x didn't start - loading devices with a full scan"),
+                     item.first->name(), item.second);
+            for (auto pBuilt : built)
+                delete pBuilt;
+            return false;
+        }
+        built.push_back(pDevice);
+    }
+
+    for (auto pDevice : built)
+        flux.add(pDevice);
+
+    _bCachedLoad = true;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// verify()
+//
+// Compare the loaded devices with the cached set - log any change and update the cache. After a full load, the
+// qwiic addresses that answered are saved for the next startup's cached load. After a cached load that doesn't
+// match, they're cleared - the next startup runs the full load.
+
+bool sfeDLDeviceCache::verify(flxDeviceContainer &theDevices)
+{
+    if (!_bCachedLoad)
+    {
+        load();
+        if (_addresses.none())
+            sweep(_addresses);
+    }
+
+    std::vector<std::string> loaded;
+    for (auto device : theDevices)
+        loaded.push_back(deviceEntry(device));
+
+    std::sort(loaded.begin(), loaded.end());
+
+    _bMatched = loaded == _cached;
+
+    if (_bCachedLoad)
+        flxLog_I(F("%u devices loaded from the cache in %u ms (last full scan %u ms) - %s"), loaded.size(), _msLoad,
+                 _msAutoload, _bMatched ? "no change since the last startup" : "the device set changed");
+    else
+        flxLog_I(F("%u devices loaded in %u ms - %s"), loaded.size(), _msLoad,
+                 _bMatched ? "no change since the last startup" : "the device set changed");
+
+    if (!_bCachedLoad)
+        saveAddresses(false);
+    else if (!_bMatched)
+    {
+        flxLog_W(F("Devices didn't match the cache - the next startup loads devices with a full scan"));
+        saveAddresses(true);
+    }
+
+    if (_bMatched)
+        return true;
+
+    // first startup, or a cleared cache?
+    if (_cached.size() > 0)
+    {
+        for (auto &entry : _cached)
+        {
+            if (!std::binary_search(loaded.begin(), loaded.end(), entry))
+                flxLog_W(F("Device not found: %s"), entry.c_str());
+        }
+        for (auto &entry : loaded)
+        {
+            if (!std::binary_search(_cached.begin(), _cached.end(), entry))
+                flxLog_I(F("New device: %s"), entry.c_str());
+        }
+    }
+    _cached = std::move(loaded);
+    save();
+
+    return false;
+}
+
+//---------------------------------------------------------------------------
+// saveAddresses()
+//
+// The addresses that answered, and the time, of a full load - NVS is only written when they change. Cleared
+// addresses mean a full load at the next startup.
+
+void sfeDLDeviceCache::saveAddresses(bool bClear)
+{
+    if (bClear)
+        _addresses.reset();
+    else if (_addresses == _savedAddresses && _msAutoload != 0)
+        return;
+
+    uint8_t addresses[16] = {0};
+    for (uint8_t address = 0; address < _addresses.size(); address++)
+    {
+        if (_addresses[address])
+            addresses[address / 8] |= 1 << (address % 8);
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(kDeviceCachePrefsName, false))
+        return;
+
+    prefs.putBytes("addrs", addresses, sizeof(addresses));
+    if (!bClear)
+    {
+        _msAutoload = _msLoad;
+        prefs.putUInt("msauto", _msAutoload);
+    }
+    prefs.end();
+
+    _savedAddresses = _addresses;
+}
+
+//---------------------------------------------------------------------------
+// scan()
+//
+// Probe each qwiic address. A cached qwiic device that doesn't answer is reported as missing, an address that
+// answers without a cached device as new. Devices that share an address with a cached one aren't told apart.
+
+uint32_t sfeDLDeviceCache::scan(void)
+{
+    uint32_t nChanges = 0;
+    uint32_t nFound = 0;
+
+    std::vector<bool> cachedAddress(kDeviceScanLast + 1, false);
+    for (auto &entry : _cached)
+    {
+        unsigned int address;
+        if (sscanf(entry.c_str(), "qwiic %x", &address) == 1 && address <= kDeviceScanLast)
+            cachedAddress[address] = true;
+    }
+
+    uint32_t ticks = millis();
+
+    for (uint8_t address = kDeviceScanFirst; address <= kDeviceScanLast; address++)
+    {
+        Wire.beginTransmission(address);
+        bool bFound = Wire.endTransmission() == 0;
+
+        if (bFound)
+            nFound++;
+
+        if (bFound == cachedAddress[address])
+            continue;
+
+        nChanges++;
+        if (bFound)
+            flxLog_I(F("New device at qwiic address 0x%x - restart to load it"), address);
+        else
+        {
+            for (auto &entry : _cached)
+            {
+                unsigned int cached;
+                if (sscanf(entry.c_str(), "qwiic %x", &cached) == 1 && cached == address)
+                    flxLog_W(F("Device not responding: %s"), entry.c_str());
+            }
+        }
+    }
+    flxLog_I(F("qwiic scan: %u addresses responded in %u ms - %u changes"), nFound, millis() - ticks, nChanges);
+
+    return nChanges;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLDeviceCache::clear(void)
+{
+    Preferences prefs;
+    if (!prefs.begin(kDeviceCachePrefsName, false))
+        return;
+
+    prefs.clear();
+    prefs.end();
+
+    _cached.clear();
+    _savedAddresses.reset();
+    _msAutoload = 0;
+    _bMatched = false;
+}
@@ -0,0 +1,113 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - loaded device cache
+ *
+ * The set of devices loaded at startup - kind, address and driver name of each - is kept in NVS. At startup
+ * the loaded set is checked against the cached set: a change in the attached hardware is logged, and the
+ * cache updated. NVS is only written when the set changes.
+ *
+ * Startup is verify-first: before the framework's auto-load, the qwiic bus is swept and the addresses that
+ * answer compared with those that answered at the last full load. If they match, and every cached qwiic device
+ * has a driver here, the cached devices are built at their addresses and the auto-load - each driver probing
+ * each of its addresses - is skipped. Otherwise, or if a cached device doesn't initialize, the full auto-load
+ * runs. A set that doesn't match the cache after a cached load has the next startup run the full auto-load.
+ *
+ * The time taken by the device load is also kept, and logged at startup, with the time of the last full
+ * auto-load - !device-cache
+ *
+ * A scan of the qwiic bus can be run at any time - !device-scan. It reports cached devices that no longer
+ * respond, and addresses that respond without a loaded device. Drivers are only built by the startup load, so
+ * a new device needs a restart.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxDevice.h>
+
+#include <bitset>
+#include <string>
+#include <vector>
+
+class sfeDLDeviceCache
+{
+  public:
+    sfeDLDeviceCache();
+
+    // Device load timing - the start is marked before the framework loads devices, the end once it's done
+    void markLoadStart(void)
+    {
+        _loadStartTicks = millis();
+    }
+    void markLoadEnd(void)
+    {
+        _msLoad = millis() - _loadStartTicks;
+    }
+
+    // Build the cached devices, if the qwiic bus is unchanged - returns true if they were, and the auto-load
+    // isn't needed
+    bool loadCached(void);
+
+    // Check the loaded devices against the cache - returns true if they match
+    bool verify(flxDeviceContainer &theDevices);
+
+    // Clear the cache - the next startup saves the loaded set
+    void clear(void);
+
+    // Probe the qwiic bus and compare it with the cached set - returns the number of differences
+    uint32_t scan(void);
+
+    bool matched(void)
+    {
+        return _bMatched;
+    }
+    // were the devices built from the cache at startup?
+    bool cachedLoad(void)
+    {
+        return _bCachedLoad;
+    }
+    // ms taken to load devices at startup
+    uint32_t msLoad(void)
+    {
+        return _msLoad;
+    }
+    // ms taken by the last full auto-load - 0 if not known
+    uint32_t msAutoload(void)
+    {
+        return _msAutoload;
+    }
+    // the cached set, one entry per device - "<kind> <address> <name>"
+    const std::vector<std::string> &cached(void)
+    {
+        return _cached;
+    }
+
+  private:
+    typedef std::bitset<128> addressSet_t;
+
+    void load(void);
+    void save(void);
+    void sweep(addressSet_t &theSet);
+    void saveAddresses(bool bClear);
+
+    std::vector<std::string> _cached;
+
+    // qwiic addresses that answered before the load, and at the last full load
+    addressSet_t _addresses;
+    addressSet_t _savedAddresses;
+
+    bool _bMatched;
+    bool _bCachedLoad;
+    uint32_t _loadStartTicks;
+    uint32_t _msLoad;
+    uint32_t _msAutoload;
+};
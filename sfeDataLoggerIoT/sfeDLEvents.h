@@ -0,0 +1,30 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+// Sources of event triggered observations - the value sent with kOnLogObservationWithSource
+#pragma once
+
+#include <string.h>
+
+// GNSS PPS - every second
+#define kDLEventSourcePPS "PPS"
+
+// Data available on the external serial port
+#define kDLEventSourceSerial "SERIAL"
+
+// A bang command - !log-now
+#define kDLEventSourceCLI "CLI"
+
+// Is an event triggered observation an alarm - sent right away, not batched? The periodic (PPS) and data
+// (external serial) sources aren't - the interrupt, button and command line sources are.
+inline bool dlEventIsAlarm(const char *szSource)
+{
+    return !szSource || (strcmp(szSource, kDLEventSourcePPS) != 0 && strcmp(szSource, kDLEventSourceSerial) != 0);
+}
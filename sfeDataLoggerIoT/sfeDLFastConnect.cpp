@@ -0,0 +1,204 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - fast WiFi reconnect
+ *
+ */
+
+#include "sfeDLFastConnect.h"
+#include "sfeDLRTCBuffer.h"
+
+#include <string.h>
+
+#define kFastConnectMagic 0x4B4E4C44 // "DLNK"
+
+// How often (ms) a connection is checked for
+const uint32_t kFastConnectPoll = 20;
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLFastConnect::sfeDLFastConnect()
+    : _pLink{nullptr}, _pDriver{nullptr}, _leaseSecs{kFastConnectLeaseSecs}, _lastConnect{kConnectNone}
+{
+    resetStats();
+}
+
+//---------------------------------------------------------------------------
+uint32_t sfeDLFastConnect::linkCRC(const sfeDLWiFiLink_t &theLink)
+{
+    return sfeDLRTCBuffer::crc32((const uint8_t *)&theLink, offsetof(sfeDLWiFiLink_t, crc));
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFastConnect::attach(sfeDLWiFiLink_t *pLink)
+{
+    _pLink = pLink;
+
+    if (!cached())
+        invalidate();
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLFastConnect::cached(void)
+{
+    return _pLink && _pLink->magic == kFastConnectMagic && _pLink->crc == linkCRC(*_pLink);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFastConnect::invalidate(void)
+{
+    if (_pLink)
+        memset(_pLink, 0, sizeof(sfeDLWiFiLink_t));
+}
+
+//---------------------------------------------------------------------------
+// save()
+//
+// Cache the link of the current connection. A new lease is from DHCP - otherwise the lease start is kept
+
+void sfeDLFastConnect::save(bool bNewLease)
+{
+    if (!_pLink)
+        return;
+
+    sfeDLWiFiLink_t theLink;
+    memset(&theLink, 0, sizeof(theLink));
+
+    if (!_pDriver->getLink(theLink))
+        return;
+
+    bool bSameLease = cached() && !bNewLease && theLink.ip == _pLink->ip;
+
+    theLink.leaseStart = bSameLease ? _pLink->leaseStart : _pDriver->now();
+    theLink.magic = kFastConnectMagic;
+    theLink.crc = linkCRC(theLink);
+
+    memcpy(_pLink, &theLink, sizeof(theLink));
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLFastConnect::waitConnected(uint32_t msTimeout)
+{
+    uint32_t startTicks = _pDriver->ticks();
+
+    while (!_pDriver->isConnected())
+    {
+        if (_pDriver->ticks() - startTicks >= msTimeout)
+            return false;
+        _pDriver->wait(kFastConnectPoll);
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// fastConnect()
+//
+// Connect to the cached access point - with the cached address if the lease is in time
+
+bool sfeDLFastConnect::fastConnect(void)
+{
+    uint32_t now = _pDriver->now();
+
+    // no clock, no lease check - use DHCP
+    bool bStaticIP = _leaseSecs > 0 && now > 0 && _pLink->ip != 0 && _pLink->leaseStart > 0 &&
+                     now >= _pLink->leaseStart && now - _pLink->leaseStart < _leaseSecs;
+
+    if (!_pDriver->begin(*_pLink, bStaticIP) || !waitConnected(kFastConnectTimeout))
+        return false;
+
+    _lastConnect = bStaticIP ? kConnectFast : kConnectFastDHCP;
+    save(!bStaticIP);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// connect()
+//
+// The cached link first - on failure it's dropped, and a full connection made. The station is reset before the
+// full connection, so a static address from the cached link isn't carried into it
+
+bool sfeDLFastConnect::connect(void)
+{
+    if (!_pDriver)
+        return false;
+
+    uint32_t startTicks = _pDriver->ticks();
+
+    if (cached())
+    {
+        if (fastConnect())
+        {
+            _msLast = _pDriver->ticks() - startTicks;
+            _msFastTotal += _msLast;
+            _nFast++;
+            if (_lastConnect == kConnectFastDHCP)
+                _nFastDHCP++;
+            return true;
+        }
+        _nFastFailed++;
+        invalidate();
+    }
+
+    uint32_t fullTicks = _pDriver->ticks();
+
+    _pDriver->reset();
+    _pDriver->join();
+
+    bool bConnected = waitConnected(kFullConnectTimeout);
+
+    _msLast = _pDriver->ticks() - startTicks;
+
+    if (!bConnected)
+    {
+        _nFailed++;
+        _lastConnect = kConnectFailed;
+        return false;
+    }
+
+    _nFull++;
+    _msFullTotal += _pDriver->ticks() - fullTicks;
+    _lastConnect = kConnectFull;
+    save(true);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFastConnect::resetStats(void)
+{
+    _nFast = 0;
+    _nFastDHCP = 0;
+    _nFastFailed = 0;
+    _nFull = 0;
+    _nFailed = 0;
+    _msFastTotal = 0;
+    _msFullTotal = 0;
+    _msLast = 0;
+}
+
+//---------------------------------------------------------------------------
+const char *sfeDLFastConnect::lastConnectName(void)
+{
+    switch (_lastConnect)
+    {
+    case kConnectFast:
+        return "fast";
+    case kConnectFastDHCP:
+        return "fast (DHCP)";
+    case kConnectFull:
+        return "full scan";
+    case kConnectFailed:
+        return "failed";
+    }
+    return "none";
+}
@@ -0,0 +1,186 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - fast WiFi reconnect
+ *
+ * A full WiFi connection scans every channel for the network, then gets an address by DHCP - seconds of radio
+ * time for each upload window or wake. The access point, channel and address of the last connection are kept
+ * (in RTC memory), and the next connection goes straight to that access point on its channel. While the DHCP
+ * lease is within its time, the address is set directly and DHCP is skipped.
+ *
+ * If the fast connection fails, the cached link is dropped, the station is reset to DHCP and a full connection
+ * is made - the link it makes is cached for next time.
+ *
+ * The cached link holds no credentials - the driver takes the password from the WiFi settings. The connection
+ * change event is left to the caller, the same for either path.
+ *
+ * No Arduino or ESP32 dependencies - the radio is reached through a driver - so the connection logic builds and
+ * runs on a host, against a fake driver.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The network of a connection. Addresses are IPv4, as held by IPAddress
+typedef struct
+{
+    uint32_t magic;
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint32_t leaseStart; // wall clock (secs) the address was given by DHCP
+    uint32_t crc;
+} sfeDLWiFiLink_t;
+
+//---------------------------------------------------------------------------
+// The radio, as used by the fast connect
+class sfeDLWiFiDriver
+{
+  public:
+    virtual ~sfeDLWiFiDriver()
+    {
+    }
+
+    // Start a connection to the access point of the link, on its channel. With bStaticIP, the address of the link
+    // is set - no DHCP. Returns false if the link can't be used - it isn't the network of the WiFi settings
+    virtual bool begin(const sfeDLWiFiLink_t &theLink, bool bStaticIP) = 0;
+
+    // Start a full connection to the network of the WiFi settings - a scan and DHCP
+    virtual void join(void) = 0;
+
+    virtual bool isConnected(void) = 0;
+
+    // The link of the current connection - returns false if not connected. leaseStart isn't set
+    virtual bool getLink(sfeDLWiFiLink_t &theLink) = 0;
+
+    // Drop a connection attempt, and go back to DHCP
+    virtual void reset(void) = 0;
+
+    // ms ticks
+    virtual uint32_t ticks(void) = 0;
+
+    // wall clock (secs) - 0 if the clock isn't set
+    virtual uint32_t now(void) = 0;
+
+    virtual void wait(uint32_t ms) = 0;
+};
+
+// Defaults - the DHCP lease time assumed (secs), and how long (ms) the fast and full connections are given
+const uint32_t kFastConnectLeaseSecs = 3600;
+const uint32_t kFastConnectTimeout = 3000;
+const uint32_t kFullConnectTimeout = 15000;
+
+class sfeDLFastConnect
+{
+  public:
+    sfeDLFastConnect();
+
+    // The cached link - kept by the caller, in memory that survives sleep. Cleared if not valid
+    void attach(sfeDLWiFiLink_t *pLink);
+
+    void setDriver(sfeDLWiFiDriver *pDriver)
+    {
+        _pDriver = pDriver;
+    }
+
+    // The static address is used for this long after DHCP gave it - 0 always uses DHCP
+    void setLeaseSecs(uint32_t leaseSecs)
+    {
+        _leaseSecs = leaseSecs;
+    }
+
+    // Connect - the cached link first, then a full connection if that fails. Returns true if connected
+    bool connect(void);
+
+    // Forget the cached link - the next connection is a full one
+    void invalidate(void);
+
+    bool cached(void);
+
+    // How the last connection was made
+    static constexpr uint8_t kConnectNone = 0x0;
+    static constexpr uint8_t kConnectFast = 0x1;
+    static constexpr uint8_t kConnectFastDHCP = 0x2;
+    static constexpr uint8_t kConnectFull = 0x3;
+    static constexpr uint8_t kConnectFailed = 0x4;
+
+    uint8_t lastConnect(void)
+    {
+        return _lastConnect;
+    }
+    const char *lastConnectName(void);
+
+    //---------------------------------------------------------------------------
+    // Stats
+    uint32_t nFast(void)
+    {
+        return _nFast;
+    }
+    // fast connections that used DHCP - the lease was out of time
+    uint32_t nFastDHCP(void)
+    {
+        return _nFastDHCP;
+    }
+    uint32_t nFastFailed(void)
+    {
+        return _nFastFailed;
+    }
+    uint32_t nFull(void)
+    {
+        return _nFull;
+    }
+    uint32_t nFailed(void)
+    {
+        return _nFailed;
+    }
+    uint32_t msFastAvg(void)
+    {
+        return _nFast > 0 ? _msFastTotal / _nFast : 0;
+    }
+    uint32_t msFullAvg(void)
+    {
+        return _nFull > 0 ? _msFullTotal / _nFull : 0;
+    }
+    // the last connection - includes a failed fast attempt
+    uint32_t msLast(void)
+    {
+        return _msLast;
+    }
+
+    void resetStats(void);
+
+  private:
+    bool waitConnected(uint32_t msTimeout);
+    bool fastConnect(void);
+    void save(bool bNewLease);
+
+    static uint32_t linkCRC(const sfeDLWiFiLink_t &theLink);
+
+    sfeDLWiFiLink_t *_pLink;
+    sfeDLWiFiDriver *_pDriver;
+    uint32_t _leaseSecs;
+
+    uint8_t _lastConnect;
+
+    uint32_t _nFast;
+    uint32_t _nFastDHCP;
+    uint32_t _nFastFailed;
+    uint32_t _nFull;
+    uint32_t _nFailed;
+    uint32_t _msFastTotal;
+    uint32_t _msFullTotal;
+    uint32_t _msLast;
+};
@@ -0,0 +1,273 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - framed binary serial output
+ *
+ */
+
+#include "sfeDLFmtBinary.h"
+
+#include <esp_rom_crc.h>
+
+#include <algorithm>
+#include <math.h>
+
+// A schema frame is sent every N data frames, or after this period (ms) - whichever is first
+const uint32_t kBinarySchemaFrames = 100;
+const uint32_t kBinarySchemaPeriod = 5000;
+
+// Numbers with a magnitude over this are sent as f64 - a f32 keeps ~7 digits
+const double kBinaryFloatMax = 100000.;
+
+// Longest string value sent
+const size_t kBinaryMaxString = 255;
+
+//---------------------------------------------------------------------------
+// The binary type of a value - 0 for values that aren't sent (arrays, objects, null)
+
+static char fieldType(JsonVariantConst jValue)
+{
+    if (jValue.is<bool>())
+        return 'b';
+
+    if (jValue.is<long long>())
+    {
+        long long value = jValue.as<long long>();
+        return value >= INT32_MIN && value <= INT32_MAX ? 'i' : 'd';
+    }
+    if (jValue.is<double>())
+    {
+        double value = jValue.as<double>();
+        return isnan(value) || isinf(value) || fabs(value) < kBinaryFloatMax ? 'f' : 'd';
+    }
+    if (jValue.is<const char *>())
+        return 's';
+
+    return 0;
+}
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLFmtBinary::sfeDLFmtBinary()
+    : _pOutput{nullptr}, _schemaID{0}, _framesSinceSchema{0}, _schemaTicks{0}, _sequence{0}, _nFrames{0},
+      _nSchemaFrames{0}
+{
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFmtBinary::setOutput(sfeDLSerialOutput *pOutput)
+{
+    if (pOutput == _pOutput)
+        return;
+
+    _pOutput = pOutput;
+
+    // start the stream with a schema
+    _schema.clear();
+}
+
+//---------------------------------------------------------------------------
+// buildSchema()
+//
+// The schema of an observation - a line per field, <type><device>.<parameter>. The values are collected in
+// the same order.
+
+void sfeDLFmtBinary::buildSchema(JsonObjectConst jObs, std::string &schema)
+{
+    _values.clear();
+
+    for (JsonPairConst jSection : jObs)
+    {
+        JsonObjectConst joParams = jSection.value().as<JsonObjectConst>();
+
+        // a section that is a single value
+        if (joParams.isNull())
+        {
+            char type = fieldType(jSection.value());
+            if (!type)
+                continue;
+
+            schema += type;
+            schema += jSection.key().c_str();
+            schema += '\n';
+            _values.push_back(jSection.value());
+            continue;
+        }
+
+        for (JsonPairConst jParam : joParams)
+        {
+            char type = fieldType(jParam.value());
+            if (!type)
+                continue;
+
+            schema += type;
+            schema += jSection.key().c_str();
+            schema += '.';
+            schema += jParam.key().c_str();
+            schema += '\n';
+            _values.push_back(jParam.value());
+        }
+    }
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFmtBinary::packValue(char type, JsonVariantConst jValue)
+{
+    switch (type)
+    {
+    case 'b':
+        pack<uint8_t>(jValue.as<bool>() ? 1 : 0);
+        break;
+
+    case 'i':
+        pack<int32_t>(jValue.as<int32_t>());
+        break;
+
+    case 'f':
+        pack<float>(jValue.as<float>());
+        break;
+
+    case 'd':
+        pack<double>(jValue.as<double>());
+        break;
+
+    case 's': {
+        const char *szValue = jValue.as<const char *>();
+        size_t length = std::min(strlen(szValue), kBinaryMaxString);
+
+        pack<uint8_t>(length);
+        _frame.insert(_frame.end(), (const uint8_t *)szValue, (const uint8_t *)szValue + length);
+        break;
+    }
+    }
+}
+
+//---------------------------------------------------------------------------
+// encodeFrame()
+//
+// Add the CRC to a frame, and COBS encode it - between 0x00 delimiters
+
+void sfeDLFmtBinary::encodeFrame(std::vector<uint8_t> &frame, std::vector<uint8_t> &encoded)
+{
+    uint32_t crc = esp_rom_crc32_le(0, frame.data(), frame.size());
+    frame.insert(frame.end(), (const uint8_t *)&crc, (const uint8_t *)&crc + sizeof(crc));
+
+    encoded.clear();
+    encoded.push_back(0);
+
+    // COBS - each block starts with the offset to the next zero. A zero in the frame ends a block, as does
+    // a run of 254 non-zero bytes
+    size_t codeIndex = encoded.size();
+    encoded.push_back(0);
+    uint8_t code = 1;
+
+    for (uint8_t byte : frame)
+    {
+        if (byte != 0)
+        {
+            encoded.push_back(byte);
+            code++;
+        }
+        if (byte == 0 || code == 0xFF)
+        {
+            encoded[codeIndex] = code;
+            codeIndex = encoded.size();
+            encoded.push_back(0);
+            code = 1;
+        }
+    }
+    encoded[codeIndex] = code;
+    encoded.push_back(0);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFmtBinary::sendFrame(void)
+{
+    encodeFrame(_frame, _encoded);
+    _pOutput->writeBytes(_encoded.data(), _encoded.size());
+
+    _sequence++;
+    _nFrames++;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFmtBinary::sendSchema(void)
+{
+    _frame.clear();
+    _frame.push_back('S');
+    pack<uint16_t>(_sequence);
+    pack<uint16_t>(_schemaID);
+    pack<uint8_t>(kBinaryVersion);
+    pack<uint16_t>(_values.size());
+
+    // each line of the schema is a field
+    size_t lineStart = 0;
+    while (lineStart < _schema.length())
+    {
+        size_t lineEnd = _schema.find('\n', lineStart);
+        size_t length = std::min(lineEnd - lineStart - 1, (size_t)255);
+
+        _frame.push_back(_schema[lineStart]);
+        pack<uint8_t>(length);
+        _frame.insert(_frame.end(), _schema.begin() + lineStart + 1, _schema.begin() + lineStart + 1 + length);
+
+        lineStart = lineEnd + 1;
+    }
+    sendFrame();
+
+    _framesSinceSchema = 0;
+    _schemaTicks = millis();
+    _nSchemaFrames++;
+}
+
+//---------------------------------------------------------------------------
+// write()
+//
+// Send an observation as a data frame - preceded by a schema frame if the fields changed, or it's time to
+// repeat the schema
+
+void sfeDLFmtBinary::write(JsonDocument &jDoc)
+{
+    if (!_pOutput)
+        return;
+
+    std::string schema;
+    buildSchema(jDoc.as<JsonObjectConst>(), schema);
+    if (_values.empty())
+        return;
+
+    bool bNewSchema = schema != _schema;
+    if (bNewSchema)
+    {
+        _schema = schema;
+        _schemaID = esp_rom_crc32_le(0, (const uint8_t *)_schema.c_str(), _schema.length()) & 0xFFFF;
+    }
+    if (bNewSchema || _framesSinceSchema >= kBinarySchemaFrames || millis() - _schemaTicks >= kBinarySchemaPeriod)
+        sendSchema();
+
+    _frame.clear();
+    _frame.push_back('D');
+    pack<uint16_t>(_sequence);
+    pack<uint16_t>(_schemaID);
+    pack<uint32_t>(millis());
+
+    // the value types are the first character of each schema line
+    size_t lineStart = 0;
+    for (JsonVariantConst jValue : _values)
+    {
+        packValue(_schema[lineStart], jValue);
+        lineStart = _schema.find('\n', lineStart) + 1;
+    }
+    sendFrame();
+
+    _framesSinceSchema++;
+}
@@ -0,0 +1,103 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - framed binary serial output
+ *
+ * For high rate captures to a PC. Each observation is sent as a binary frame - values are packed in the
+ * order given by a schema frame, which names and types each field. A schema frame is sent when the fields
+ * change, and periodically, so a capture started mid-stream can sync up.
+ *
+ * Frame contents - integers are little endian:
+ *
+ *      Schema:  'S' <seq:u16> <schema id:u16> <version:u8> <n fields:u16> {<type:char> <len:u8> <name>} ...
+ *      Data:    'D' <seq:u16> <schema id:u16> <millis:u32> <value> ...
+ *
+ * Field names are <device>.<parameter>. Value types:
+ *
+ *      'b' bool - u8       'i' integer - i32       'f' number - f32
+ *      'd' number - f64    's' string - <len:u8> <chars>
+ *
+ * The frame is followed by its CRC32 (u32), COBS encoded and sent between 0x00 delimiters. Other console
+ * output between frames is discarded by the reader, and the sequence number shows lost frames.
+ *
+ * See tools/dl_serial_capture.py
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCoreInterface.h>
+
+#include <ArduinoJson.h>
+
+#include <string>
+#include <vector>
+
+#include "sfeDLSerialOutput.h"
+
+// Frame format version - in the schema frame
+const uint8_t kBinaryVersion = 1;
+
+class sfeDLFmtBinary : public flxIWriterJSON
+{
+  public:
+    sfeDLFmtBinary();
+
+    // The output for frames - nullptr to disable
+    void setOutput(sfeDLSerialOutput *pOutput);
+
+    // flxIWriterJSON - called by the JSON formatter with each observation
+    void write(JsonDocument &jDoc);
+
+    uint32_t nFrames(void)
+    {
+        return _nFrames;
+    }
+    uint32_t nSchemaFrames(void)
+    {
+        return _nSchemaFrames;
+    }
+
+    // Add the CRC to a frame and COBS encode it, with the delimiters
+    static void encodeFrame(std::vector<uint8_t> &frame, std::vector<uint8_t> &encoded);
+
+  private:
+    void buildSchema(JsonObjectConst jObs, std::string &schema);
+    void packValue(char type, JsonVariantConst jValue);
+    void sendSchema(void);
+    void sendFrame(void);
+
+    template <typename T> void pack(T value)
+    {
+        const uint8_t *pValue = (const uint8_t *)&value;
+        _frame.insert(_frame.end(), pValue, pValue + sizeof(T));
+    }
+
+    sfeDLSerialOutput *_pOutput;
+
+    // the current schema - a line per field: <type><name>
+    std::string _schema;
+    uint16_t _schemaID;
+    uint32_t _framesSinceSchema;
+    uint32_t _schemaTicks;
+
+    uint16_t _sequence;
+
+    // the values of the observation being sent, in schema order
+    std::vector<JsonVariantConst> _values;
+
+    // the frame being built, and its encoded form - reused between observations
+    std::vector<uint8_t> _frame;
+    std::vector<uint8_t> _encoded;
+
+    uint32_t _nFrames;
+    uint32_t _nSchemaFrames;
+};
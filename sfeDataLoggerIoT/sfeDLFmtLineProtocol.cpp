@@ -0,0 +1,209 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - InfluxDB line protocol output format
+ *
+ */
+
+#include "sfeDLFmtLineProtocol.h"
+
+#include <Flux/flxFlux.h>
+
+#include <algorithm>
+#include <math.h>
+#include <sys/time.h>
+
+// Before this time (secs - 2020-01-01), the clock isn't set
+const time_t kLineProtocolMinTime = 1577836800;
+
+// Characters escaped in each element of a line
+static const char *kEscapeMeasurement = ", ";
+static const char *kEscapeKey = ",= ";
+
+//---------------------------------------------------------------------------
+// Append text, with the given characters backslash escaped. Newlines can't be escaped - they're dropped
+
+static void appendEscaped(std::string &out, const char *szText, const char *szEscape)
+{
+    for (const char *pch = szText; *pch; pch++)
+    {
+        if (*pch == '\n' || *pch == '\r')
+            continue;
+        if (strchr(szEscape, *pch))
+            out += '\\';
+        out += *pch;
+    }
+}
+
+//---------------------------------------------------------------------------
+// sfeDLLineProtocol
+//---------------------------------------------------------------------------
+uint64_t sfeDLLineProtocol::timestamp(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+
+    if (tv.tv_sec < kLineProtocolMinTime)
+        return 0;
+
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLLineProtocol::updateTags(void)
+{
+    std::string board = flux.localName();
+
+    if (_tags.length() > 0 && board == _board)
+        return;
+
+    _board = board;
+
+    _tags = ",board=";
+    appendEscaped(_tags, _board.c_str(), kEscapeKey);
+    _tags += ",id=";
+    appendEscaped(_tags, flux.deviceId(), kEscapeKey);
+}
+
+//---------------------------------------------------------------------------
+// appendField()
+//
+// Append key=value - returns false if the value type has no line protocol form
+
+bool sfeDLLineProtocol::appendField(std::string &out, const char *szKey, JsonVariantConst jValue)
+{
+    char szValue[32];
+    const char *pValue = szValue;
+
+    if (jValue.is<bool>())
+        pValue = jValue.as<bool>() ? "true" : "false";
+
+    else if (jValue.is<long long>())
+        snprintf(szValue, sizeof(szValue), "%lldi", jValue.as<long long>());
+
+    else if (jValue.is<double>())
+    {
+        double value = jValue.as<double>();
+        if (isnan(value) || isinf(value))
+            return false;
+        snprintf(szValue, sizeof(szValue), "%.9g", value);
+    }
+    else if (!jValue.is<const char *>())
+        return false;
+
+    appendEscaped(out, szKey, kEscapeKey);
+    out += '=';
+
+    if (!jValue.is<const char *>())
+    {
+        out += pValue;
+        return true;
+    }
+
+    out += '"';
+    appendEscaped(out, jValue.as<const char *>(), "\"\\");
+    out += '"';
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+uint32_t sfeDLLineProtocol::encode(JsonVariantConst jObs, std::string &out, uint64_t msTimestamp)
+{
+    updateTags();
+
+    char szTimestamp[24] = {0};
+    if (msTimestamp > 0)
+        snprintf(szTimestamp, sizeof(szTimestamp), " %llu", msTimestamp);
+
+    uint32_t nLines = 0;
+
+    for (JsonPairConst jSection : jObs.as<JsonObjectConst>())
+    {
+        size_t lineStart = out.length();
+
+        appendEscaped(out, jSection.key().c_str(), kEscapeMeasurement);
+        out += _tags;
+        out += ' ';
+
+        uint32_t nFields = 0;
+
+        JsonObjectConst joParams = jSection.value().as<JsonObjectConst>();
+        if (joParams.isNull())
+            nFields = appendField(out, "value", jSection.value()) ? 1 : 0;
+        else
+        {
+            for (JsonPairConst jParam : joParams)
+            {
+                size_t fieldStart = out.length();
+                if (nFields > 0)
+                    out += ',';
+
+                if (appendField(out, jParam.key().c_str(), jParam.value()))
+                    nFields++;
+                else
+                    out.resize(fieldStart);
+            }
+        }
+
+        // no fields - no line
+        if (nFields == 0)
+        {
+            out.resize(lineStart);
+            continue;
+        }
+        out += szTimestamp;
+        out += '\n';
+        nLines++;
+    }
+    return nLines;
+}
+
+//---------------------------------------------------------------------------
+// sfeDLFmtLineProtocol
+//---------------------------------------------------------------------------
+void sfeDLFmtLineProtocol::add(flxWriter *pWriter)
+{
+    if (pWriter && std::find(_writers.begin(), _writers.end(), pWriter) == _writers.end())
+        _writers.push_back(pWriter);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFmtLineProtocol::remove(flxWriter *pWriter)
+{
+    auto itWriter = std::find(_writers.begin(), _writers.end(), pWriter);
+    if (itWriter != _writers.end())
+        _writers.erase(itWriter);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLFmtLineProtocol::write(JsonDocument &jDoc)
+{
+    if (_writers.empty())
+        return;
+
+    _lines.clear();
+    if (_encoder.encode(jDoc.as<JsonVariantConst>(), _lines, sfeDLLineProtocol::timestamp()) == 0)
+        return;
+
+    // Writers take a line at a time - without the newline
+    size_t lineStart = 0;
+    while (lineStart < _lines.length())
+    {
+        size_t lineEnd = _lines.find('\n', lineStart);
+        _lines[lineEnd] = '\0';
+
+        for (auto pWriter : _writers)
+            pWriter->write(_lines.c_str() + lineStart, true, flxLineTypeData);
+
+        lineStart = lineEnd + 1;
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - InfluxDB line protocol output format
+ *
+ * Each device (section) of an observation becomes one line:
+ *
+ *      <device>,board=<board name>,id=<device id> <parameter>=<value>,... <timestamp>
+ *
+ * Integer values get the "i" suffix, strings are quoted. Parameters that are arrays or objects are skipped. A
+ * section that is a single value is output as the field "value". The timestamp is the system time, in
+ * milliseconds - write with precision=ms. Until the clock is set, no timestamp is output and the server
+ * uses its receive time.
+ *
+ * The formatter takes observations from the JSON formatter, so they are encoded - and timestamped - as
+ * they are logged.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCoreInterface.h>
+
+#include <ArduinoJson.h>
+
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------------------
+// Line protocol encoder
+
+class sfeDLLineProtocol
+{
+  public:
+    // Append the lines of an observation to out. A timestamp of 0 is not output. Returns the number of
+    // lines added
+    uint32_t encode(JsonVariantConst jObs, std::string &out, uint64_t msTimestamp);
+
+    // The current system time in ms, or 0 if the clock isn't set
+    static uint64_t timestamp(void);
+
+  private:
+    void updateTags(void);
+    bool appendField(std::string &out, const char *szKey, JsonVariantConst jValue);
+
+    // The board name and ID tags - rebuilt if the board name changes
+    std::string _board;
+    std::string _tags;
+};
+
+//---------------------------------------------------------------------------
+// Line protocol formatter - writes each observation, as lines, to the attached writers
+
+class sfeDLFmtLineProtocol : public flxIWriterJSON
+{
+  public:
+    void add(flxWriter &writer)
+    {
+        add(&writer);
+    }
+    void add(flxWriter *pWriter);
+
+    void remove(flxWriter &writer)
+    {
+        remove(&writer);
+    }
+    void remove(flxWriter *pWriter);
+
+    // flxIWriterJSON - called by the JSON formatter with each observation
+    void write(JsonDocument &jDoc);
+
+  private:
+    sfeDLLineProtocol _encoder;
+
+    std::vector<flxWriter *> _writers;
+
+    // reused between observations
+    std::string _lines;
+};
@@ -0,0 +1,141 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - HTTP/HTTPS client connection
+ *
+ */
+
+#include "sfeDLHTTPConnection.h"
+
+#include <Flux/flxCoreLog.h>
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLHTTPConnection::sfeDLHTTPConnection()
+    : _fileSystem{nullptr}, _pClient{nullptr}, _isSecure{false}, _caCertSize{0}, _caCertTime{0}
+{
+}
+
+//---------------------------------------------------------------------------
+sfeDLHTTPConnection::~sfeDLHTTPConnection()
+{
+    close();
+
+    if (_pClient)
+        delete _pClient;
+}
+
+//---------------------------------------------------------------------------
+// loadCACert()
+//
+// Returns true if the cached certificate changed
+
+bool sfeDLHTTPConnection::loadCACert(const std::string &caCertFilename, const char *szOwner)
+{
+    if (caCertFilename.length() == 0 || !_fileSystem)
+    {
+        bool bChanged = _caCert.length() > 0;
+        _caCert = "";
+        _caCertFile = "";
+        return bChanged;
+    }
+
+    FS theFS = _fileSystem->fileSystem();
+    File theFile = theFS.open(caCertFilename.c_str(), "r");
+    if (!theFile)
+    {
+        flxLog_W(F("%s: Unable to load CA certificate %s"), szOwner, caCertFilename.c_str());
+        return false;
+    }
+
+    if (_caCertFile == caCertFilename && _caCertSize == theFile.size() && _caCertTime == theFile.getLastWrite())
+    {
+        theFile.close();
+        return false;
+    }
+
+    uint32_t ticks = millis();
+
+    _caCert = theFile.readString().c_str();
+    _caCertFile = caCertFilename;
+    _caCertSize = theFile.size();
+    _caCertTime = theFile.getLastWrite();
+    theFile.close();
+
+    flxLog_V(F("%s: Loaded CA certificate %s in %u ms"), szOwner, _caCertFile.c_str(), millis() - ticks);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// setup()
+//
+// Create the network client for the URL
+
+bool sfeDLHTTPConnection::setup(const std::string &url, const std::string &caCertFilename, const char *szOwner)
+{
+    bool bSecure = url.compare(0, 8, "https://") == 0;
+
+    // The client is kept unless the URL or, for a new secure connection, the certificate changed
+    if (_pClient && _currentURL == url)
+    {
+        if (!_isSecure || _pClient->connected() || !loadCACert(caCertFilename, szOwner))
+            return true;
+    }
+    else if (bSecure)
+        loadCACert(caCertFilename, szOwner);
+
+    close();
+    if (_pClient)
+    {
+        delete _pClient;
+        _pClient = nullptr;
+    }
+
+    _isSecure = bSecure;
+
+    if (_isSecure)
+    {
+        WiFiClientSecure *pSecure = new WiFiClientSecure;
+        if (!pSecure)
+        {
+            flxLogM_E(kMsgErrAllocError, szOwner);
+            return false;
+        }
+        if (_caCert.length() > 0)
+            pSecure->setCACert(_caCert.c_str());
+        else
+            pSecure->setInsecure();
+
+        _pClient = pSecure;
+    }
+    else
+        _pClient = new WiFiClient;
+
+    if (!_pClient)
+    {
+        flxLogM_E(kMsgErrAllocError, szOwner);
+        return false;
+    }
+    _currentURL = url;
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLHTTPConnection::close(void)
+{
+    _http.end();
+
+    if (_pClient)
+        _pClient->stop();
+}
@@ -0,0 +1,89 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - HTTP/HTTPS client connection
+ *
+ * The network and HTTP clients for posting to a URL. HTTPS URLs use a secure client, with the CA certificate
+ * loaded from the filesystem if one is set - otherwise the server isn't verified.
+ *
+ * The CA certificate is cached - it's only read from the SD card again if the filename, or the file's size or
+ * modification time, changed. The client is kept between calls to setup() unless the URL changed or, before a
+ * new secure connection, the certificate changed.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxFS.h>
+
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+
+#include <string>
+
+class sfeDLHTTPConnection
+{
+  public:
+    sfeDLHTTPConnection();
+
+    ~sfeDLHTTPConnection();
+
+    // Filesystem the CA certificate is loaded from
+    void setFileSystem(flxIFileSystem *fs)
+    {
+        _fileSystem = fs;
+    }
+
+    // Setup the client for the URL - szOwner names the caller in log messages. Returns false on error.
+    bool setup(const std::string &url, const std::string &caCertFilename, const char *szOwner);
+
+    // Close the connection - the client is kept
+    void close(void);
+
+    bool connected(void)
+    {
+        return _pClient && _pClient->connected();
+    }
+
+    WiFiClient *client(void)
+    {
+        return _pClient;
+    }
+
+    HTTPClient &http(void)
+    {
+        return _http;
+    }
+
+    // the URL the client was setup for
+    const std::string &url(void)
+    {
+        return _currentURL;
+    }
+
+  private:
+    bool loadCACert(const std::string &caCertFilename, const char *szOwner);
+
+    flxIFileSystem *_fileSystem;
+
+    WiFiClient *_pClient;
+    bool _isSecure;
+    HTTPClient _http;
+
+    // CA certificate - must persist while the client is in use. Cached, with the file it came from
+    std::string _caCert;
+    std::string _caCertFile;
+    size_t _caCertSize;
+    time_t _caCertTime;
+
+    std::string _currentURL;
+};
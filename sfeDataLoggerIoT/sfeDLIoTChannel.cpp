@@ -0,0 +1,632 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - IoT publish channel
+ *
+ */
+
+#include "sfeDLIoTChannel.h"
+
+#include <algorithm>
+
+#include <Flux/flxCoreLog.h>
+#include <Flux/flxFlux.h>
+
+// extra space allocated when a payload is copied for background delivery
+const uint32_t kChannelSnapshotSlack = 64;
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+
+sfeDLIoTChannel::sfeDLIoTChannel(const char *name, const char *desc, bool bFreeForm)
+    : _endpoint{nullptr}, _bFreeForm{bFreeForm}, _pDictionary{nullptr}, _dictVersionSent{0}, _intervalStartTicks{0},
+      _nAccumulated{0}, _bBatchCompact{false}, _nBatched{0}, _batchBytes{0}, _batchStartTicks{0}, _bOnline{true},
+      _hQueueMutex{NULL}, _backoff{0}, _backoffStartTicks{0}, _nPublishes{0}, _nObservations{0}, _nBytes{0},
+      _nDropped{0}, _nOverBudget{0}, _maxPublishTime{0}, _statsStartTicks{0}, _nPublishTimes{0}
+{
+    setName(name, desc);
+
+    publishInterval.setTitle("Publish Rate");
+    flxRegister(publishInterval, "Publish Interval (sec)", "Min time between published observations. 0 = all");
+    flxRegister(decimation, "Decimation", "How the observations between publishes are combined");
+
+    // Only endpoints that take a free-form JSON document can be sent batches
+    if (_bFreeForm)
+    {
+        batchCount.setTitle("Batching");
+        flxRegister(batchCount, "Batch Size", "Number of observations sent in one payload");
+        flxRegister(batchWindow, "Batch Window (sec)", "Max age of a batched observation. 0 = no limit");
+        flxRegister(batchMaxSize, "Batch Max Bytes", "A payload larger than this is sent early");
+
+        payloadFormat.setTitle("Payload");
+        flxRegister(payloadFormat, "Payload Format", "Send full JSON or compact, dictionary keyed, payloads");
+    }
+    holdOffline.setTitle("Offline");
+    flxRegister(holdOffline, "Hold While Offline", "Hold payloads while the network is down, send on reconnect");
+    flxRegister(holdSize, "Hold Size", "Number of payloads held in memory");
+    flxRegister(holdToSD, "Hold On SD Card", "Hold payloads beyond the hold size on the SD card");
+
+    background.setTitle("Delivery");
+    flxRegister(background, "Background Delivery", "Publish from a separate task - a slow service won't delay logging");
+    flxRegister(queueDepth, "Queue Depth", "Number of payloads held for background delivery");
+    flxRegister(queueFullAction, "Queue Full Action", "How a new payload is handled when the queue is full");
+    flxRegister(publishBudget, "Publish Budget (ms)", "A publish taking longer than this pauses delivery for a time");
+
+    publishInterval = 0;
+
+    batchCount = 1;
+    batchWindow = 0;
+    batchMaxSize = kChannelBatchMaxSize;
+
+    holdOffline = false;
+    holdSize = kChannelHoldSize;
+    holdToSD = false;
+
+    background = false;
+    queueDepth = kChannelQueueDepth;
+    publishBudget = kChannelPublishBudget;
+
+    _hQueueMutex = xSemaphoreCreateMutex();
+}
+
+//---------------------------------------------------------------------------
+// publish()
+//
+// Called for every observation the logger outputs.
+
+void sfeDLIoTChannel::publish(JsonDocument &jDoc, JsonDocument *pCompact)
+{
+    if (!endpointEnabled())
+        return;
+
+    // Publish interval - skipped observations are only accumulated, never encoded or sent
+    if (publishInterval() > 0)
+    {
+        if (decimation() != kDecimateLast)
+            accumulate(jDoc);
+
+        if (!publishDue())
+            return;
+
+        _intervalStartTicks = millis();
+
+        if (_nAccumulated > 1 && decimate(jDoc))
+        {
+            _nAccumulated = 0;
+
+            // the decimated observation needs its own compact encoding
+            std::unique_ptr<DynamicJsonDocument> pDecimated;
+            if (useCompact())
+            {
+                pDecimated.reset(new DynamicJsonDocument(_accumDoc->capacity()));
+                if (!pDecimated || pDecimated->capacity() == 0 || !_pDictionary->encode(*_accumDoc, *pDecimated))
+                    pDecimated.reset();
+            }
+            publishObservation(*_accumDoc, pDecimated.get());
+            return;
+        }
+        _nAccumulated = 0;
+    }
+    publishObservation(jDoc, pCompact);
+}
+
+//---------------------------------------------------------------------------
+// publishObservation()
+//
+// Send, or batch, an observation that passed the publish interval
+
+void sfeDLIoTChannel::publishObservation(JsonDocument &jDoc, JsonDocument *pCompact)
+{
+    // Use the compact encoding? If the encoding failed, fall back to full JSON
+    bool bCompact = useCompact() && pCompact != nullptr;
+    JsonDocument &jPayload = bCompact ? *pCompact : jDoc;
+
+    // No batching - straight through to the endpoint
+    if (!batching())
+    {
+        deliver(jPayload, 1, bCompact);
+        return;
+    }
+
+    // Don't mix encodings in a batch
+    if (_nBatched > 0 && bCompact != _bBatchCompact)
+        flush();
+
+    if (!addToBatch(jPayload))
+    {
+        // no room for a batch - don't drop the observation, send it on its own
+        deliver(jPayload, 1, bCompact);
+        return;
+    }
+    _bBatchCompact = bCompact;
+
+    if (_nBatched >= batchCount())
+        flush();
+}
+
+//---------------------------------------------------------------------------
+// Decimation methods
+//---------------------------------------------------------------------------
+// accumulate()
+//
+// The first observation of an interval is copied, then numeric values of the following observations are
+// summed (mean) or compared (max) in place - no new document memory is used after the first copy.
+
+void sfeDLIoTChannel::accumulate(JsonDocument &jDoc)
+{
+    if (_nAccumulated == 0)
+    {
+        if (!_accumDoc || _accumDoc->capacity() < jDoc.capacity())
+        {
+            _accumDoc.reset(new DynamicJsonDocument(jDoc.capacity()));
+            if (!_accumDoc || _accumDoc->capacity() == 0)
+            {
+                flxLogM_E(kMsgErrAllocError, "IoT decimation buffer");
+                _accumDoc.reset();
+                return;
+            }
+        }
+        _accumDoc->set(jDoc);
+        _nAccumulated = 1;
+        return;
+    }
+
+    for (JsonPair kvSection : _accumDoc->as<JsonObject>())
+    {
+        JsonObjectConst jParams = jDoc[kvSection.key().c_str()].as<JsonObjectConst>();
+        if (jParams.isNull())
+            continue;
+
+        for (JsonPair kvParam : kvSection.value().as<JsonObject>())
+        {
+            JsonVariantConst jValue = jParams[kvParam.key().c_str()];
+
+            if (!kvParam.value().is<float>() || kvParam.value().is<bool>() || !jValue.is<float>())
+                continue;
+
+            if (decimation() == kDecimateMean)
+                kvParam.value().set(kvParam.value().as<double>() + jValue.as<double>());
+            else if (jValue.as<double>() > kvParam.value().as<double>())
+                kvParam.value().set(jValue.as<double>());
+        }
+    }
+    _nAccumulated++;
+}
+
+//---------------------------------------------------------------------------
+// decimate()
+//
+// Build the published observation in the accumulation document - the current observation, with the
+// numeric values replaced by the mean/max over the interval.
+
+bool sfeDLIoTChannel::decimate(JsonDocument &jDoc)
+{
+    if (!_accumDoc)
+        return false;
+
+    for (JsonPair kvSection : _accumDoc->as<JsonObject>())
+    {
+        for (JsonPair kvParam : kvSection.value().as<JsonObject>())
+        {
+            if (!kvParam.value().is<float>() || kvParam.value().is<bool>())
+                continue;
+
+            if (decimation() == kDecimateMean)
+                kvParam.value().set(kvParam.value().as<double>() / (double)_nAccumulated);
+        }
+    }
+
+    // take the non-numeric values (time stamps ...) from the current observation
+    for (JsonPairConst kvSection : jDoc.as<JsonObjectConst>())
+    {
+        JsonObject jParams = (*_accumDoc)[kvSection.key().c_str()];
+        if (jParams.isNull())
+            continue;
+
+        for (JsonPairConst kvParam : kvSection.value().as<JsonObjectConst>())
+        {
+            if (kvParam.value().is<float>() && !kvParam.value().is<bool>())
+                continue;
+            if (jParams.containsKey(kvParam.key().c_str()))
+                jParams[kvParam.key().c_str()] = kvParam.value();
+        }
+    }
+    return !_accumDoc->overflowed();
+}
+
+//---------------------------------------------------------------------------
+// Batch methods
+//---------------------------------------------------------------------------
+bool sfeDLIoTChannel::startBatch(void)
+{
+    if (!_batchDoc)
+    {
+        _batchDoc.reset(new DynamicJsonDocument(kChannelBatchDocSize));
+
+        if (!_batchDoc || _batchDoc->capacity() == 0)
+        {
+            flxLogM_E(kMsgErrAllocError, "IoT batch buffer");
+            _batchDoc.reset();
+            return false;
+        }
+    }
+    _batchDoc->clear();
+
+    // The header is shared by all observations in the batch
+    JsonObject jHeader = _batchDoc->createNestedObject("header");
+    jHeader["board"] = flux.localName();
+    jHeader["id"] = (char *)flux.deviceId(); // char * cast - so JSON copies string
+    jHeader["count"] = 0;
+
+    _batchDoc->createNestedArray("observations");
+
+    _nBatched = 0;
+    _batchBytes = measureJson(*_batchDoc);
+    _batchStartTicks = millis();
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTChannel::addToBatch(JsonDocument &jDoc)
+{
+    if (_nBatched == 0 && !startBatch())
+        return false;
+
+    // Would this observation push the payload over the size limit? If so, send what we have first
+    uint32_t obsSize = measureJson(jDoc) + 1; // + comma
+    if (_nBatched > 0 && _batchBytes + obsSize > batchMaxSize())
+    {
+        flush();
+        if (!startBatch())
+            return false;
+    }
+
+    JsonArray jaObs = (*_batchDoc)["observations"];
+    size_t nEntries = jaObs.size();
+
+    if (!jaObs.add(jDoc.as<JsonObjectConst>()) || _batchDoc->overflowed())
+    {
+        // Out of document memory - back out the partial add, send the batch and start again
+        if (jaObs.size() > nEntries)
+            jaObs.remove(nEntries);
+
+        if (_nBatched == 0)
+            return false; // the observation alone doesn't fit
+
+        flush();
+        return addToBatch(jDoc);
+    }
+    _nBatched++;
+    _batchBytes += obsSize;
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTChannel::flush(void)
+{
+    if (_nBatched == 0 || !_batchDoc)
+        return;
+
+    (*_batchDoc)["header"]["count"] = _nBatched;
+
+    deliver(*_batchDoc, _nBatched, _bBatchCompact);
+
+    _batchDoc->clear();
+    _nBatched = 0;
+    _batchBytes = 0;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTChannel::checkWindow(void)
+{
+    if (_nBatched == 0)
+        return;
+
+    // batching turned off, or the endpoint disabled, while observations are pending?
+    if (!batching() || !endpointEnabled())
+    {
+        flush();
+        return;
+    }
+
+    if (batchWindow() > 0 && millis() - _batchStartTicks >= batchWindow() * 1000)
+        flush();
+}
+
+//---------------------------------------------------------------------------
+// publishDictionary()
+//
+// Send the key dictionary to the endpoint, so compact payloads can be decoded.
+
+void sfeDLIoTChannel::publishDictionary(void)
+{
+    DynamicJsonDocument jDict(kChannelDictDocSize);
+
+    if (jDict.capacity() == 0)
+    {
+        flxLogM_E(kMsgErrAllocError, "IoT key dictionary");
+        return;
+    }
+    if (!_pDictionary->toJSON(jDict))
+    {
+        flxLog_E(F("%s: Key dictionary exceeds %u bytes"), name(), kChannelDictDocSize);
+        return;
+    }
+    if (useQueue())
+    {
+        if (!enqueue(jDict, 0, true))
+            return;
+    }
+    else
+        send(jDict, 0);
+
+    _dictVersionSent = _pDictionary->version();
+}
+
+//---------------------------------------------------------------------------
+// deliver()
+//
+// Hold the payload if offline - or if earlier payloads are still held, to keep the order.
+
+void sfeDLIoTChannel::deliver(JsonDocument &jDoc, uint32_t nObs, bool bCompact)
+{
+    if (holdOffline() && (!_bOnline || !_spool.empty()))
+    {
+        _spool.setLimits(holdSize(), holdToSD());
+        if (!_spool.push(jDoc, nObs, bCompact))
+            _nDropped += nObs;
+        return;
+    }
+    deliverNow(jDoc, nObs, bCompact);
+}
+
+//---------------------------------------------------------------------------
+// replayHeld()
+
+void sfeDLIoTChannel::replayHeld(uint32_t nMax)
+{
+    if (!_bOnline || _spool.empty() || !endpointEnabled())
+        return;
+
+    DynamicJsonDocument jDoc(kChannelBatchDocSize);
+    if (jDoc.capacity() == 0)
+    {
+        flxLogM_E(kMsgErrAllocError, "IoT replay");
+        return;
+    }
+
+    uint32_t nObs;
+    bool bCompact;
+
+    for (uint32_t i = 0; i < nMax && !_spool.empty(); i++)
+    {
+        if (_spool.pop(jDoc, nObs, bCompact))
+            deliverNow(jDoc, nObs, bCompact);
+    }
+}
+
+//---------------------------------------------------------------------------
+// deliverNow()
+//
+// Send a payload to the endpoint now, or queue it for the delivery task.
+
+void sfeDLIoTChannel::deliverNow(JsonDocument &jDoc, uint32_t nObs, bool bCompact)
+{
+    // Does the other side have the current dictionary?
+    if (bCompact && _dictVersionSent != _pDictionary->version())
+        publishDictionary();
+
+    if (useQueue())
+        enqueue(jDoc, nObs, false);
+    else
+        send(jDoc, nObs);
+}
+
+//---------------------------------------------------------------------------
+// send()
+//
+// Write a payload to the endpoint and account for it. A dictionary payload has nObs == 0
+
+void sfeDLIoTChannel::send(JsonDocument &jDoc, uint32_t nObs)
+{
+    if (_statsStartTicks == 0)
+        _statsStartTicks = millis();
+
+    uint32_t ticks = millis();
+    _endpoint->write(jDoc);
+    ticks = millis() - ticks;
+
+    _nBytes += measureJson(jDoc);
+    _nObservations += nObs;
+    if (nObs > 0)
+        _nPublishes++;
+
+    if (ticks > _maxPublishTime)
+        _maxPublishTime = ticks;
+
+    if (nObs > 0)
+        _publishTimes[_nPublishTimes++ % kChannelLatencySamples] = ticks;
+
+    // Over budget? Back off - doubling each time the service is slow
+    if (ticks > publishBudget())
+    {
+        _nOverBudget++;
+        if (_backoff == 0)
+            flxLog_W(F("%s: publish took %u ms - pausing delivery"), name(), ticks);
+
+        _backoff = _backoff == 0 ? publishBudget() : std::min(_backoff * 2, kChannelMaxBackoff);
+        _backoffStartTicks = millis();
+    }
+    else
+        _backoff = 0;
+}
+
+//---------------------------------------------------------------------------
+// Background delivery
+//---------------------------------------------------------------------------
+
+// Payloads already queued are delivered by the task, even if background delivery was turned off - keeps
+// the payloads in order.
+bool sfeDLIoTChannel::useQueue(void)
+{
+    if (!_deliveryNotify || _hQueueMutex == NULL)
+        return false;
+
+    return background() || queued() > 0;
+}
+
+//---------------------------------------------------------------------------
+uint32_t sfeDLIoTChannel::queued(void)
+{
+    if (_hQueueMutex == NULL)
+        return 0;
+
+    xSemaphoreTake(_hQueueMutex, portMAX_DELAY);
+    uint32_t nQueued = _queue.size();
+    xSemaphoreGive(_hQueueMutex);
+
+    return nQueued;
+}
+
+//---------------------------------------------------------------------------
+// enqueue()
+//
+// The payload is copied (it's a reused document), and the copy is handed to the delivery task. A
+// dictionary is never dropped - the payloads after it depend on it.
+
+bool sfeDLIoTChannel::enqueue(JsonDocument &jDoc, uint32_t nObs, bool isDictionary)
+{
+    DynamicJsonDocument *pDoc = new DynamicJsonDocument(jDoc.memoryUsage() + kChannelSnapshotSlack);
+
+    if (!pDoc || pDoc->capacity() == 0 || !pDoc->set(jDoc))
+    {
+        flxLogM_E(kMsgErrAllocError, "IoT publish queue");
+        if (pDoc)
+            delete pDoc;
+        _nDropped += nObs;
+        return false;
+    }
+
+    xSemaphoreTake(_hQueueMutex, portMAX_DELAY);
+
+    if (!isDictionary && _queue.size() >= queueDepth())
+    {
+        if (queueFullAction() == kQueueDropNewest)
+        {
+            xSemaphoreGive(_hQueueMutex);
+            delete pDoc;
+            _nDropped += nObs;
+            return false;
+        }
+        // Drop the oldest payload - or all payloads to send only the latest
+        for (auto it = _queue.begin(); it != _queue.end();)
+        {
+            if (it->isDictionary)
+            {
+                it++;
+                continue;
+            }
+            _nDropped += it->nObs;
+            delete it->pDoc;
+            it = _queue.erase(it);
+
+            if (queueFullAction() == kQueueDropOldest)
+                break;
+        }
+    }
+    _queue.push_back({pDoc, nObs, isDictionary});
+
+    xSemaphoreGive(_hQueueMutex);
+
+    _deliveryNotify();
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// serviceQueue()
+//
+// Called from the delivery task.
+
+bool sfeDLIoTChannel::serviceQueue(void)
+{
+    // backing off from a slow service?
+    if (_backoff > 0 && millis() - _backoffStartTicks < _backoff)
+        return false;
+
+    xSemaphoreTake(_hQueueMutex, portMAX_DELAY);
+    if (_queue.empty())
+    {
+        xSemaphoreGive(_hQueueMutex);
+        return false;
+    }
+    queueItem_t theItem = _queue.front();
+    _queue.pop_front();
+    bool bMore = !_queue.empty();
+
+    xSemaphoreGive(_hQueueMutex);
+
+    // endpoint disabled since the payload was queued?
+    if (endpointEnabled())
+        send(*theItem.pDoc, theItem.nObs);
+    else
+    {
+        _nDropped += theItem.nObs;
+        if (theItem.isDictionary)
+            resendDictionary();
+    }
+    delete theItem.pDoc;
+
+    return bMore;
+}
+
+//---------------------------------------------------------------------------
+// Stats
+//---------------------------------------------------------------------------
+float sfeDLIoTChannel::publishRate(void)
+{
+    if (_statsStartTicks == 0 || millis() == _statsStartTicks)
+        return 0.;
+
+    return (float)_nPublishes * 1000. / (float)(millis() - _statsStartTicks);
+}
+
+//---------------------------------------------------------------------------
+uint32_t sfeDLIoTChannel::publishTimePercentile(uint32_t pct)
+{
+    uint32_t nSamples = std::min(_nPublishTimes, kChannelLatencySamples);
+    if (nSamples == 0)
+        return 0;
+
+    // copy - the delivery task may be adding samples
+    std::array<uint32_t, kChannelLatencySamples> samples = _publishTimes;
+
+    uint32_t iPct = std::min(nSamples * std::min(pct, (uint32_t)100) / 100, nSamples - 1);
+    std::nth_element(samples.begin(), samples.begin() + iPct, samples.begin() + nSamples);
+
+    return samples[iPct];
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTChannel::resetStats(void)
+{
+    _nPublishes = 0;
+    _nObservations = 0;
+    _nBytes = 0;
+    _nDropped = 0;
+    _nOverBudget = 0;
+    _maxPublishTime = 0;
+    _statsStartTicks = 0;
+    _nPublishTimes = 0;
+}
@@ -0,0 +1,319 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - IoT publish channel
+ *
+ * A channel sits between the JSON output formatter and a single IoT endpoint. It decides when, and
+ * in what shape, an observation is delivered to that endpoint.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCore.h>
+#include <Flux/flxCoreInterface.h>
+
+#include <ArduinoJson.h>
+
+#include "sfeDLIoTSpool.h"
+#include "sfeDLPayload.h"
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <memory>
+
+// Default upper bound (bytes) on a batched payload
+const uint32_t kChannelBatchMaxSize = 4096;
+
+// Allocation size of the JSON document used to build a batch
+const uint32_t kChannelBatchDocSize = 12288;
+
+// Allocation size of the JSON document used to publish the key dictionary
+const uint32_t kChannelDictDocSize = 4096;
+
+// Default number of payloads held in RAM while offline
+const uint32_t kChannelHoldSize = 16;
+
+// Default depth of the background delivery queue
+const uint32_t kChannelQueueDepth = 8;
+
+// Number of recent publish times kept for the latency percentiles
+const uint32_t kChannelLatencySamples = 128;
+
+// A publish interval is considered reached this much early (ms) - absorbs log timer jitter
+const uint32_t kChannelIntervalSlack = 500;
+
+// Default time budget (ms) for a single publish, and the longest backoff after it is exceeded
+const uint32_t kChannelPublishBudget = 5000;
+const uint32_t kChannelMaxBackoff = 60000;
+
+class sfeDLIoTChannel : public flxActionType<sfeDLIoTChannel>
+{
+  public:
+    // bFreeForm - the endpoint accepts any JSON document (MQTT, HTTP..). Endpoints that map the observation
+    // structure to their own fields (ThingSpeak, Arduino IoT ...) don't support batching.
+    sfeDLIoTChannel(const char *name, const char *desc, bool bFreeForm = true);
+
+    //---------------------------------------------------------------------------
+    // The endpoint this channel delivers to, and how to check if the endpoint is enabled
+    void setEndpoint(flxIWriterJSON *endpoint, std::function<bool(void)> isEnabled)
+    {
+        _endpoint = endpoint;
+        _isEnabled = isEnabled;
+    }
+
+    bool endpointEnabled(void)
+    {
+        return _endpoint != nullptr && (!_isEnabled || _isEnabled());
+    }
+
+    // Key dictionary used for compact payloads
+    void setDictionary(sfeDLKeyDictionary *pDictionary)
+    {
+        _pDictionary = pDictionary;
+    }
+
+    //---------------------------------------------------------------------------
+    // Offline hold - payloads are held while the network is down and replayed, in order, once it's back
+    void setOnline(bool bOnline)
+    {
+        _bOnline = bOnline;
+    }
+
+    void setHoldFile(flxIFileSystem *fs, const char *szFilename)
+    {
+        _spool.setFile(fs, szFilename);
+    }
+
+    // Called at a regular interval - delivers up to nMax held payloads
+    void replayHeld(uint32_t nMax);
+
+    uint32_t held(void)
+    {
+        return _spool.size();
+    }
+
+    // Wakes the background delivery task. Returns false if the task isn't running
+    void setDeliveryNotify(std::function<bool(void)> notify)
+    {
+        _deliveryNotify = notify;
+    }
+
+    //---------------------------------------------------------------------------
+    // Called by the publisher for each observation. pCompact is the compact encoding of the
+    // observation, if one was made.
+    void publish(JsonDocument &jDoc, JsonDocument *pCompact);
+
+    // Decimation - what is published when observations are skipped by the publish interval
+    static constexpr uint8_t kDecimateLast = 0x0;
+    static constexpr uint8_t kDecimateMean = 0x1;
+    static constexpr uint8_t kDecimateMax = 0x2;
+
+    // Will the next observation be published? (or just accumulated)
+    bool publishDue(void)
+    {
+        return publishInterval() == 0 || _intervalStartTicks == 0 ||
+               millis() - _intervalStartTicks + kChannelIntervalSlack >= publishInterval() * 1000;
+    }
+
+    // Payload formats
+    static constexpr uint8_t kPayloadJSON = 0x0;
+    static constexpr uint8_t kPayloadCompact = 0x1;
+
+    bool useCompact(void)
+    {
+        return _bFreeForm && _pDictionary != nullptr && payloadFormat() == kPayloadCompact;
+    }
+
+    // The dictionary is sent before the next compact payload
+    void resendDictionary(void)
+    {
+        _dictVersionSent = 0;
+    }
+
+    // push out any batched observations
+    void flush(void);
+
+    // Called at a regular interval - flushes the batch if its time window expired
+    void checkWindow(void);
+
+    bool batching(void)
+    {
+        return _bFreeForm && (batchCount() > 1 || batchWindow() > 0);
+    }
+
+    uint32_t pending(void)
+    {
+        return _nBatched;
+    }
+
+    //---------------------------------------------------------------------------
+    // Background delivery
+
+    // Queue full actions
+    static constexpr uint8_t kQueueDropNewest = 0x0;
+    static constexpr uint8_t kQueueDropOldest = 0x1;
+    static constexpr uint8_t kQueueLatestOnly = 0x2;
+
+    // Called by the delivery task - sends the next queued payload. Returns true if more are waiting
+    bool serviceQueue(void);
+
+    uint32_t queued(void);
+
+    //---------------------------------------------------------------------------
+    // Stats
+    uint32_t nPublishes(void)
+    {
+        return _nPublishes;
+    }
+    uint32_t nObservations(void)
+    {
+        return _nObservations;
+    }
+    uint32_t nBytes(void)
+    {
+        return _nBytes;
+    }
+    uint32_t nDropped(void)
+    {
+        return _nDropped;
+    }
+    uint32_t nOverBudget(void)
+    {
+        return _nOverBudget;
+    }
+    // longest time (ms) taken by a single publish
+    uint32_t maxPublishTime(void)
+    {
+        return _maxPublishTime;
+    }
+
+    // publish time (ms) percentile over the recent publishes. pct is 0-100
+    uint32_t publishTimePercentile(uint32_t pct);
+
+    // publishes per second since the stats were reset
+    float publishRate(void);
+
+    void resetStats(void);
+
+    // Properties
+
+    // Min time (secs) between published observations. 0 = publish every observation
+    flxPropertyUInt32<sfeDLIoTChannel> publishInterval = {0, 86400};
+
+    // How observations between publishes are combined
+    flxPropertyUInt8<sfeDLIoTChannel> decimation = {
+        kDecimateLast, {{"Last Value", kDecimateLast}, {"Mean", kDecimateMean}, {"Max", kDecimateMax}}};
+
+    // Number of observations packed into one payload
+    flxPropertyUInt32<sfeDLIoTChannel> batchCount = {1, 100};
+
+    // Max age (secs) of the oldest batched observation before the batch is sent. 0 == no limit
+    flxPropertyUInt32<sfeDLIoTChannel> batchWindow = {0, 3600};
+
+    // Max size of a batched payload (bytes)
+    flxPropertyUInt32<sfeDLIoTChannel> batchMaxSize = {256, 16384};
+
+    // Full JSON or compact (dictionary keyed) payloads
+    flxPropertyUInt8<sfeDLIoTChannel> payloadFormat = {
+        kPayloadJSON, {{"JSON", kPayloadJSON}, {"Compact JSON - Key Dictionary", kPayloadCompact}}};
+
+    // Hold payloads while offline, for delivery on reconnect
+    flxPropertyBool<sfeDLIoTChannel> holdOffline;
+
+    // Number of payloads held in RAM
+    flxPropertyUInt32<sfeDLIoTChannel> holdSize = {0, 256};
+
+    // Payloads beyond the RAM limit are held on the SD card
+    flxPropertyBool<sfeDLIoTChannel> holdToSD;
+
+    // Publish from the background delivery task, not the logging loop
+    flxPropertyBool<sfeDLIoTChannel> background;
+
+    // Number of payloads held for background delivery
+    flxPropertyUInt32<sfeDLIoTChannel> queueDepth = {1, 32};
+
+    // What to do when the queue is full
+    flxPropertyUInt8<sfeDLIoTChannel> queueFullAction = {
+        kQueueDropOldest,
+        {{"Drop Newest", kQueueDropNewest}, {"Drop Oldest", kQueueDropOldest}, {"Send Latest Only", kQueueLatestOnly}}};
+
+    // A publish taking longer than this (ms) pauses delivery, with an increasing backoff
+    flxPropertyUInt32<sfeDLIoTChannel> publishBudget = {100, 60000};
+
+  private:
+    typedef struct
+    {
+        DynamicJsonDocument *pDoc;
+        uint32_t nObs;
+        bool isDictionary;
+    } queueItem_t;
+
+    void publishObservation(JsonDocument &jDoc, JsonDocument *pCompact);
+    void accumulate(JsonDocument &jDoc);
+    bool decimate(JsonDocument &jDoc);
+    void deliver(JsonDocument &jDoc, uint32_t nObs, bool bCompact);
+    void deliverNow(JsonDocument &jDoc, uint32_t nObs, bool bCompact);
+    void send(JsonDocument &jDoc, uint32_t nObs);
+    bool enqueue(JsonDocument &jDoc, uint32_t nObs, bool isDictionary);
+    bool useQueue(void);
+    void publishDictionary(void);
+    bool startBatch(void);
+    bool addToBatch(JsonDocument &jDoc);
+
+    flxIWriterJSON *_endpoint;
+    std::function<bool(void)> _isEnabled;
+
+    bool _bFreeForm;
+
+    sfeDLKeyDictionary *_pDictionary;
+    uint32_t _dictVersionSent;
+
+    // publish interval state - numeric values accumulated since the last publish
+    uint32_t _intervalStartTicks;
+    std::unique_ptr<DynamicJsonDocument> _accumDoc;
+    uint32_t _nAccumulated;
+
+    // is the current batch compact encoded
+    bool _bBatchCompact;
+
+    // batch state
+    std::unique_ptr<DynamicJsonDocument> _batchDoc;
+    uint32_t _nBatched;
+    uint32_t _batchBytes;
+    uint32_t _batchStartTicks;
+
+    // offline hold state
+    bool _bOnline;
+    sfeDLIoTSpool _spool;
+
+    // background delivery state
+    std::deque<queueItem_t> _queue;
+    SemaphoreHandle_t _hQueueMutex;
+    std::function<bool(void)> _deliveryNotify;
+    uint32_t _backoff;
+    uint32_t _backoffStartTicks;
+
+    // stats
+    uint32_t _nPublishes;
+    uint32_t _nObservations;
+    uint32_t _nBytes;
+    uint32_t _nDropped;
+    uint32_t _nOverBudget;
+    uint32_t _maxPublishTime;
+    uint32_t _statsStartTicks;
+
+    // recent publish times - a ring buffer
+    std::array<uint32_t, kChannelLatencySamples> _publishTimes;
+    uint32_t _nPublishTimes;
+};
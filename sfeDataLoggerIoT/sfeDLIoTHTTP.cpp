@@ -0,0 +1,331 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - HTTP Keep-Alive IoT service
+ *
+ */
+
+#include "sfeDLIoTHTTP.h"
+
+#include <Flux/flxCoreLog.h>
+#include <Flux/flxFlux.h>
+
+// how often the idle connection check runs (ms)
+const uint32_t kHTTPIdleCheckPeriod = 5000;
+
+// time to wait for a server response (ms)
+const uint16_t kHTTPResponseTimeout = 10000;
+
+// Max size (bytes) of line protocol output held for posting - the oldest lines are dropped past this
+const uint32_t kHTTPLineBufferMax = 16384;
+
+static const char *kHTTPContentJSON = "application/json";
+static const char *kHTTPContentText = "text/plain; charset=utf-8";
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLIoTHTTP::sfeDLIoTHTTP()
+    : _theNetwork{nullptr}, _lastPublishTicks{0}, _nLines{0}, _linesStartTicks{0}, _bLinesDue{false},
+      _hLinesMutex{NULL}, _hMutex{NULL}, _nHandshakes{0}, _nReused{0}, _nReconnects{0}, _nFailures{0},
+      _msHandshakes{0}, _msReused{0}, _nLinesDropped{0}
+{
+    setName("HTTP Keep-Alive", "Post observations over a persistent HTTP/HTTPS connection");
+
+    flxRegister(enabled, "Enabled", "Enable or Disable the HTTP Keep-Alive Client");
+    flxRegister(URL, "URL", "URL to post observations to");
+    flxRegister(caCertFilename, "CA Cert Filename", "File to load the CA certificate from");
+    flxRegister(authorization, "Authorization", "Authorization header value - for example: Token <API token>");
+
+    payloadFormat.setTitle("Format");
+    flxRegister(payloadFormat, "Payload Format",
+                "JSON posts each IoT payload. Line Protocol posts logged observations as InfluxDB lines");
+    flxRegister(linesPerPost, "Lines Per Post", "Line protocol lines sent in one post");
+    flxRegister(lineMaxWait, "Max Line Wait (sec)", "Max time a line protocol line waits to be posted");
+
+    keepAlive.setTitle("Connection");
+    flxRegister(keepAlive, "Keep Alive", "Hold the connection open between publishes");
+    flxRegister(idleTimeout, "Idle Timeout (sec)", "Close the connection after this time without a publish");
+
+    enabled = false;
+    keepAlive = true;
+    idleTimeout = kHTTPIdleTimeout;
+    linesPerPost = kHTTPLinesPerPost;
+    lineMaxWait = kHTTPLineMaxWait;
+
+    _hMutex = xSemaphoreCreateMutex();
+    _hLinesMutex = xSemaphoreCreateMutex();
+}
+
+//---------------------------------------------------------------------------
+sfeDLIoTHTTP::~sfeDLIoTHTTP()
+{
+    closeConnection();
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTHTTP::initialize(void)
+{
+    _jobCheckIdle.setup("httpidle", kHTTPIdleCheckPeriod, this, &sfeDLIoTHTTP::checkIdle);
+    flxAddJobToQueue(_jobCheckIdle);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTHTTP::closeConnection(void)
+{
+    _connection.close();
+}
+
+//---------------------------------------------------------------------------
+// post()
+//
+// Returns the HTTP status code, or < 0 on a connection error
+
+int sfeDLIoTHTTP::post(const char *szPayload, size_t length, const char *szContentType)
+{
+    HTTPClient &theHTTP = _connection.http();
+
+    if (!theHTTP.begin(*_connection.client(), _connection.url().c_str()))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+
+    theHTTP.setReuse(keepAlive());
+    theHTTP.setTimeout(kHTTPResponseTimeout);
+    theHTTP.addHeader("Content-Type", szContentType);
+    if (authorization().length() > 0)
+        theHTTP.addHeader("Authorization", authorization().c_str());
+
+    int status = theHTTP.POST((uint8_t *)szPayload, length);
+
+    // with reuse, end() leaves the connection open
+    theHTTP.end();
+
+    return status;
+}
+
+//---------------------------------------------------------------------------
+// send()
+//
+// Post a payload - called with the mutex held. A held connection the server has since closed is detected
+// on the post - in that case the connection is made again and the post retried once.
+
+bool sfeDLIoTHTTP::send(const char *szPayload, size_t length, const char *szContentType)
+{
+    if (!_connection.setup(URL(), caCertFilename(), name()))
+        return false;
+
+    uint32_t ticks = millis();
+    bool bReused = _connection.connected();
+
+    int status = post(szPayload, length, szContentType);
+
+    if (status < 0 && bReused)
+    {
+        // the held connection went away - reconnect and retry
+        _nReconnects++;
+        closeConnection();
+        bReused = false;
+        status = post(szPayload, length, szContentType);
+    }
+    ticks = millis() - ticks;
+
+    bool bOkay = status >= 0 && status < 400;
+    if (!bOkay)
+    {
+        _nFailures++;
+        closeConnection();
+        flxLog_E(F("%s: Error posting to %s - %s"), name(), _connection.url().c_str(),
+                 status < 0 ? _connection.http().errorToString(status).c_str() : String(status).c_str());
+    }
+    else if (bReused)
+    {
+        _nReused++;
+        _msReused += ticks;
+    }
+    else
+    {
+        _nHandshakes++;
+        _msHandshakes += ticks;
+    }
+    if (!keepAlive())
+        closeConnection();
+
+    _lastPublishTicks = millis();
+
+    return bOkay;
+}
+
+//---------------------------------------------------------------------------
+// write()
+//
+// Called for each IoT payload
+
+void sfeDLIoTHTTP::write(JsonDocument &jDoc)
+{
+    // Line protocol output comes from the line protocol formatter, not the IoT payloads
+    if (!enabled() || payloadFormat() != kHTTPFormatJSON || URL().length() == 0 || !_theNetwork ||
+        !_theNetwork->isConnected())
+        return;
+
+    size_t length = measureJson(jDoc);
+    char *szPayload = new char[length + 1];
+    if (!szPayload)
+    {
+        flxLogM_E(kMsgErrAllocError, name());
+        return;
+    }
+    serializeJson(jDoc, szPayload, length + 1);
+
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+    send(szPayload, length, kHTTPContentJSON);
+    xSemaphoreGive(_hMutex);
+
+    delete[] szPayload;
+}
+
+//---------------------------------------------------------------------------
+// Line protocol output
+//---------------------------------------------------------------------------
+// flxWriter - called by the line protocol formatter with each line. Lines are held and posted in batches.
+
+void sfeDLIoTHTTP::write(const char *szLine, bool newLine, flxLineType_t type)
+{
+    if (!lineProtocolEnabled() || URL().length() == 0 || type != flxLineTypeData)
+        return;
+
+    xSemaphoreTake(_hLinesMutex, portMAX_DELAY);
+
+    if (_nLines == 0)
+        _linesStartTicks = millis();
+
+    _lines += szLine;
+    _lines += '\n';
+    _nLines++;
+
+    trimLines();
+
+    bool bDue = _nLines >= linesPerPost();
+
+    xSemaphoreGive(_hLinesMutex);
+
+    if (bDue)
+        linesDue();
+}
+
+//---------------------------------------------------------------------------
+// Can't post for a while? Drop the oldest lines - called with the lines mutex held
+
+void sfeDLIoTHTTP::trimLines(void)
+{
+    while (_lines.length() > kHTTPLineBufferMax && _nLines > 1)
+    {
+        _lines.erase(0, _lines.find('\n') + 1);
+        _nLines--;
+        _nLinesDropped++;
+    }
+}
+
+//---------------------------------------------------------------------------
+// linesDue()
+//
+// Hand the held lines to the delivery task - they're posted inline if the task isn't running
+
+void sfeDLIoTHTTP::linesDue(void)
+{
+    _bLinesDue = true;
+
+    if (!_deliveryNotify || !_deliveryNotify())
+        serviceLines();
+}
+
+//---------------------------------------------------------------------------
+// serviceLines()
+//
+// Post the held lines. Lines are only taken from the buffer for the post - new lines can be added while it
+// runs. On failure, the lines are put back for the next try.
+
+bool sfeDLIoTHTTP::serviceLines(void)
+{
+    if (!_bLinesDue)
+        return false;
+
+    _bLinesDue = false;
+
+    if (!_theNetwork || !_theNetwork->isConnected())
+        return false;
+
+    std::string lines;
+
+    xSemaphoreTake(_hLinesMutex, portMAX_DELAY);
+    lines.swap(_lines);
+    uint32_t nLines = _nLines;
+    uint32_t startTicks = _linesStartTicks;
+    _nLines = 0;
+    xSemaphoreGive(_hLinesMutex);
+
+    if (nLines == 0)
+        return false;
+
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+    bool bOkay = send(lines.c_str(), lines.length(), kHTTPContentText);
+    xSemaphoreGive(_hMutex);
+
+    if (!bOkay)
+    {
+        xSemaphoreTake(_hLinesMutex, portMAX_DELAY);
+        lines += _lines;
+        _lines.swap(lines);
+        _nLines += nLines;
+        _linesStartTicks = startTicks;
+        trimLines();
+        xSemaphoreGive(_hLinesMutex);
+    }
+    return _bLinesDue;
+}
+
+//---------------------------------------------------------------------------
+// checkIdle()
+//
+// Job - close a held connection that hasn't been used for a while.
+
+void sfeDLIoTHTTP::checkIdle(void)
+{
+    // line protocol lines that have waited long enough
+    if (_nLines > 0 && !_bLinesDue && millis() - _linesStartTicks >= lineMaxWait() * 1000)
+        linesDue();
+
+    if (!_connection.client() || _lastPublishTicks == 0 || millis() - _lastPublishTicks < idleTimeout() * 1000)
+        return;
+
+    // busy publishing? check next time
+    if (xSemaphoreTake(_hMutex, 0) != pdTRUE)
+        return;
+
+    if (_connection.connected())
+        closeConnection();
+
+    _lastPublishTicks = 0;
+
+    xSemaphoreGive(_hMutex);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTHTTP::resetStats(void)
+{
+    _nHandshakes = 0;
+    _nReused = 0;
+    _nReconnects = 0;
+    _nFailures = 0;
+    _msHandshakes = 0;
+    _msReused = 0;
+    _nLinesDropped = 0;
+}
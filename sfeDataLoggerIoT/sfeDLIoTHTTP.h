@@ -0,0 +1,186 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - HTTP Keep-Alive IoT service
+ *
+ * Posts observations to an HTTP/HTTPS URL over a persistent connection. The connection (and the TLS session
+ * on it) is held open between publishes and closed after an idle timeout, so the TCP and TLS handshakes are
+ * paid once, not on every publish.
+ *
+ * With the Line Protocol payload format, the service posts InfluxDB line protocol - from the line protocol
+ * formatter - instead of the IoT JSON payloads. Lines are held and posted in batches, from the IoT background
+ * delivery task - the logging loop only adds lines to the batch.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCore.h>
+#include <Flux/flxCoreInterface.h>
+#include <Flux/flxCoreJobs.h>
+#include <Flux/flxFS.h>
+#include <Flux/flxNetwork.h>
+
+#include <ArduinoJson.h>
+
+#include "sfeDLHTTPConnection.h"
+
+#include <functional>
+#include <string>
+
+// Default idle time (secs) before a held connection is closed
+const uint32_t kHTTPIdleTimeout = 60;
+
+// Line protocol defaults - lines per post, and the max time (secs) a line waits
+const uint32_t kHTTPLinesPerPost = 50;
+const uint32_t kHTTPLineMaxWait = 30;
+
+class sfeDLIoTHTTP : public flxActionType<sfeDLIoTHTTP>, public flxIWriterJSON, public flxWriter
+{
+  public:
+    sfeDLIoTHTTP();
+
+    ~sfeDLIoTHTTP();
+
+    void setNetwork(flxNetwork *theNetwork)
+    {
+        _theNetwork = theNetwork;
+    }
+
+    // Filesystem the CA certificate is loaded from
+    void setFileSystem(flxIFileSystem *fs)
+    {
+        _connection.setFileSystem(fs);
+    }
+
+    bool initialize(void);
+
+    // Wakes the background delivery task. Returns false if the task isn't running
+    void setDeliveryNotify(std::function<bool(void)> notify)
+    {
+        _deliveryNotify = notify;
+    }
+
+    // Called by the delivery task - posts the held line protocol lines, if due. Returns true if more are waiting
+    bool serviceLines(void);
+
+    // Is the service taking line protocol output?
+    bool lineProtocolEnabled(void)
+    {
+        return enabled() && payloadFormat() == kHTTPFormatLineProtocol;
+    }
+
+    // flxIWriterJSON - post an observation
+    void write(JsonDocument &jDoc);
+
+    // flxWriter - post line protocol output
+    void write(const char *szLine, bool newLine, flxLineType_t type);
+
+    //---------------------------------------------------------------------------
+    // Stats
+    uint32_t nHandshakes(void)
+    {
+        return _nHandshakes;
+    }
+    uint32_t nReused(void)
+    {
+        return _nReused;
+    }
+    uint32_t nReconnects(void)
+    {
+        return _nReconnects;
+    }
+    uint32_t nFailures(void)
+    {
+        return _nFailures;
+    }
+    // average time (ms) of a publish that opened a new connection
+    float handshakeTime(void)
+    {
+        return _nHandshakes > 0 ? (float)_msHandshakes / (float)_nHandshakes : 0.;
+    }
+    // average time (ms) of a publish on a held connection
+    float reusedTime(void)
+    {
+        return _nReused > 0 ? (float)_msReused / (float)_nReused : 0.;
+    }
+    // line protocol lines dropped - the output couldn't be posted
+    uint32_t nLinesDropped(void)
+    {
+        return _nLinesDropped;
+    }
+
+    void resetStats(void);
+
+    // Properties
+    flxPropertyBool<sfeDLIoTHTTP> enabled;
+
+    flxPropertyString<sfeDLIoTHTTP> URL;
+
+    flxPropertyString<sfeDLIoTHTTP> caCertFilename;
+
+    flxPropertySecureString<sfeDLIoTHTTP> authorization;
+
+    // Payload formats
+    static constexpr uint8_t kHTTPFormatJSON = 0x0;
+    static constexpr uint8_t kHTTPFormatLineProtocol = 0x1;
+
+    flxPropertyUInt8<sfeDLIoTHTTP> payloadFormat = {
+        kHTTPFormatJSON, {{"JSON", kHTTPFormatJSON}, {"Line Protocol", kHTTPFormatLineProtocol}}};
+
+    flxPropertyUInt32<sfeDLIoTHTTP> linesPerPost = {1, 500};
+
+    flxPropertyUInt32<sfeDLIoTHTTP> lineMaxWait = {1, 3600};
+
+    // Hold the connection open between publishes
+    flxPropertyBool<sfeDLIoTHTTP> keepAlive;
+
+    // seconds without a publish before a held connection is closed
+    flxPropertyUInt32<sfeDLIoTHTTP> idleTimeout = {1, 3600};
+
+  private:
+    void closeConnection(void);
+    int post(const char *szPayload, size_t length, const char *szContentType);
+    bool send(const char *szPayload, size_t length, const char *szContentType);
+    void linesDue(void);
+    void trimLines(void);
+    void checkIdle(void);
+
+    flxNetwork *_theNetwork;
+
+    sfeDLHTTPConnection _connection;
+
+    uint32_t _lastPublishTicks;
+
+    // held line protocol lines - added on the main loop, posted from the delivery task
+    std::string _lines;
+    uint32_t _nLines;
+    uint32_t _linesStartTicks;
+    volatile bool _bLinesDue;
+    SemaphoreHandle_t _hLinesMutex;
+
+    std::function<bool(void)> _deliveryNotify;
+
+    // Posts run on the IoT delivery task, the idle check on the main loop - the mutex guards the connection
+    SemaphoreHandle_t _hMutex;
+
+    flxJob _jobCheckIdle;
+
+    // stats
+    uint32_t _nHandshakes;
+    uint32_t _nReused;
+    uint32_t _nReconnects;
+    uint32_t _nFailures;
+    uint32_t _msHandshakes;
+    uint32_t _msReused;
+    uint32_t _nLinesDropped;
+};
@@ -0,0 +1,338 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - IoT publisher
+ *
+ */
+
+#include "sfeDLIoTPublisher.h"
+#include "sfeDLEvents.h"
+#include "sfeDLFmtLineProtocol.h"
+
+#include <Flux/flxCoreEvent.h>
+#include <Flux/flxCoreLog.h>
+
+// how often channel batch windows are checked (ms)
+const uint32_t kPublisherCheckPeriod = 1000;
+
+// max held payloads replayed per channel each check period
+const uint32_t kPublisherReplayPerCheck = 10;
+
+// number of encodes timed by the payload benchmark
+const uint32_t kPublisherBenchIterations = 100;
+
+// The delivery task - a TLS connection needs a large stack
+#define kDeliveryStackSize 10240
+#define kDeliveryTaskPriority 1
+
+// max time the delivery task waits for work (ms) - lets it retry after a backoff
+const uint32_t kDeliveryTaskWait = 1000;
+
+//--------------------------------------------------------------------------------
+// delivery task loop - standard C static method - for FreeRTOS
+
+static void _sfeDLIoTPublisher_TaskProcessing(void *parameter)
+{
+    sfeDLIoTPublisher *pPublisher = (sfeDLIoTPublisher *)parameter;
+
+    if (pPublisher == nullptr)
+        return;
+
+    while (true)
+    {
+        // wait for work - or timeout
+        ulTaskNotifyTake(pdTRUE, kDeliveryTaskWait / portTICK_PERIOD_MS);
+
+        pPublisher->processDelivery();
+    }
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTPublisher::initialize(void)
+{
+    if (_isInitialized)
+        return;
+
+    _jobCheckChannels.setup("iotpublish", kPublisherCheckPeriod, this, &sfeDLIoTPublisher::checkChannels);
+    flxAddJobToQueue(_jobCheckChannels);
+
+    // Alarms - observations triggered by an interrupt, button or command - flush any batched data
+    flxRegisterEventCB(flxEvent::kOnLogObservationWithSource, this, &sfeDLIoTPublisher::onLogObservationEvent);
+
+    flxRegisterEventCB(flxEvent::kOnConnectionChange, this, &sfeDLIoTPublisher::onConnectionChange);
+
+    // Setup the offline hold for each channel
+    bool bOnline = !_theNetwork || _theNetwork->isConnected();
+    char szFilename[32];
+    for (int i = 0; i < _channels.size(); i++)
+    {
+        snprintf(szFilename, sizeof(szFilename), "/iothold%d.txt", i);
+        _channels[i]->setHoldFile(_fileSystem, szFilename);
+        _channels[i]->setOnline(bOnline);
+    }
+
+    // Background delivery task. If this fails, channels publish inline
+    BaseType_t xReturnValue = xTaskCreate(_sfeDLIoTPublisher_TaskProcessing, // Delivery task function
+                                          "IoTDelivery",                     // String with name of task.
+                                          kDeliveryStackSize,                // Stack size
+                                          this,                              // Parameter passed to the task
+                                          kDeliveryTaskPriority,             // Priority of the task.
+                                          &_hTaskDelivery);                  // Task handle.
+    if (xReturnValue != pdPASS)
+    {
+        _hTaskDelivery = NULL;
+        flxLog_W(F("IoT background delivery unavailable - unable to start task"));
+    }
+
+    _isInitialized = true;
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTPublisher::notifyDelivery(void)
+{
+    if (_hTaskDelivery == NULL)
+        return false;
+
+    xTaskNotifyGive(_hTaskDelivery);
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// processDelivery()
+//
+// Round robin over the channels - one payload per channel per pass - so one busy channel doesn't hold
+// up the others. The other delivery services get a turn on each pass.
+
+void sfeDLIoTPublisher::processDelivery(void)
+{
+    bool bMore = true;
+
+    while (bMore)
+    {
+        bMore = false;
+        for (auto pChannel : _channels)
+            bMore = pChannel->serviceQueue() || bMore;
+
+        for (auto service : _services)
+            bMore = service() || bMore;
+    }
+}
+
+//---------------------------------------------------------------------------
+// write()
+//
+// Called by the JSON formatter for each observation
+
+void sfeDLIoTPublisher::write(JsonDocument &jDoc)
+{
+    _lastObservationTicks = millis();
+
+    if (_bBenchmarkPending)
+    {
+        _bBenchmarkPending = false;
+        runBenchmark(jDoc);
+    }
+
+    // encode once, shared by all channels using compact payloads
+    JsonDocument *pCompact = encodeCompact(jDoc);
+
+    for (auto pChannel : _channels)
+        pChannel->publish(jDoc, pCompact);
+
+    // an alarm is pending - make sure this observation goes out now
+    if (_bAlarmPending)
+    {
+        _bAlarmPending = false;
+        flushAll();
+    }
+}
+
+//---------------------------------------------------------------------------
+// encodeCompact()
+//
+// Returns the compact encoding of the observation, or nullptr if no channel uses it (or on error)
+
+JsonDocument *sfeDLIoTPublisher::encodeCompact(JsonDocument &jDoc)
+{
+    bool bNeeded = false;
+    for (auto pChannel : _channels)
+    {
+        if (pChannel->useCompact() && pChannel->endpointEnabled() && pChannel->publishDue())
+        {
+            bNeeded = true;
+            break;
+        }
+    }
+    if (!bNeeded)
+        return nullptr;
+
+    // The compact form is always smaller than the source document
+    if (!_compactDoc || _compactDoc->capacity() < jDoc.capacity())
+    {
+        _compactDoc.reset(new DynamicJsonDocument(jDoc.capacity()));
+        if (!_compactDoc || _compactDoc->capacity() == 0)
+        {
+            flxLogM_E(kMsgErrAllocError, "IoT compact payload");
+            _compactDoc.reset();
+            return nullptr;
+        }
+    }
+
+    if (_dictionary.update(jDoc))
+        flxLog_V(F("IoT key dictionary updated - version %u, %u sections"), _dictionary.version(), _dictionary.size());
+
+    if (!_dictionary.encode(jDoc, *_compactDoc))
+    {
+        flxLog_W(F("IoT compact payload encoding failed - sending full JSON"));
+        return nullptr;
+    }
+    return _compactDoc.get();
+}
+
+//---------------------------------------------------------------------------
+// runBenchmark()
+//
+// Times the full JSON, compact JSON, compact MessagePack and line protocol encoders on an observation
+
+void sfeDLIoTPublisher::runBenchmark(JsonDocument &jDoc)
+{
+    size_t nJSON = measureJson(jDoc);
+
+    std::unique_ptr<char[]> pBuffer(new char[nJSON + 1]);
+    DynamicJsonDocument jCompact(jDoc.capacity());
+
+    if (!pBuffer || jCompact.capacity() == 0)
+    {
+        flxLogM_E(kMsgErrAllocError, "IoT payload benchmark");
+        return;
+    }
+    _dictionary.update(jDoc);
+
+    uint32_t ticks = micros();
+    for (uint32_t i = 0; i < kPublisherBenchIterations; i++)
+        serializeJson(jDoc, pBuffer.get(), nJSON + 1);
+    uint32_t tJSON = micros() - ticks;
+
+    ticks = micros();
+    for (uint32_t i = 0; i < kPublisherBenchIterations; i++)
+    {
+        _dictionary.encode(jDoc, jCompact);
+        serializeJson(jCompact, pBuffer.get(), nJSON + 1);
+    }
+    uint32_t tCompact = micros() - ticks;
+    size_t nCompact = measureJson(jCompact);
+
+    ticks = micros();
+    for (uint32_t i = 0; i < kPublisherBenchIterations; i++)
+    {
+        _dictionary.encode(jDoc, jCompact);
+        serializeMsgPack(jCompact, pBuffer.get(), nJSON + 1);
+    }
+    uint32_t tMsgPack = micros() - ticks;
+    size_t nMsgPack = measureMsgPack(jCompact);
+
+    sfeDLLineProtocol lineProtocol;
+    std::string lines;
+    uint64_t msTimestamp = sfeDLLineProtocol::timestamp();
+
+    ticks = micros();
+    for (uint32_t i = 0; i < kPublisherBenchIterations; i++)
+    {
+        lines.clear();
+        lineProtocol.encode(jDoc.as<JsonVariantConst>(), lines, msTimestamp);
+    }
+    uint32_t tLines = micros() - ticks;
+    size_t nLines = lines.length();
+
+    flxLog_I(F("IoT payload encoders - %u iterations, %u dictionary sections"), kPublisherBenchIterations,
+             _dictionary.size());
+
+    const char *szNames[] = {"JSON", "Compact JSON", "Compact MsgPack", "Line Protocol"};
+    size_t nBytes[] = {nJSON, nCompact, nMsgPack, nLines};
+    uint32_t tTotal[] = {tJSON, tCompact, tMsgPack, tLines};
+
+    for (int i = 0; i < 4; i++)
+    {
+        float usPerObs = (float)tTotal[i] / (float)kPublisherBenchIterations;
+        flxLog_N(F("    %-16s  %5u bytes (%4.2fx)  %8.1f us/obs  %8.0f obs/sec"), szNames[i], nBytes[i],
+                 nBytes[i] > 0 ? (float)nJSON / (float)nBytes[i] : 0., usPerObs,
+                 usPerObs > 0 ? 1000000. / usPerObs : 0.);
+    }
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTPublisher::flushAll(void)
+{
+    for (auto pChannel : _channels)
+        pChannel->flush();
+}
+
+//---------------------------------------------------------------------------
+uint32_t sfeDLIoTPublisher::undelivered(void)
+{
+    uint32_t nTotal = 0;
+
+    for (auto pChannel : _channels)
+        nTotal += pChannel->pending() + pChannel->queued() + pChannel->held();
+
+    return nTotal;
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTPublisher::enabled(void)
+{
+    for (auto pChannel : _channels)
+    {
+        if (pChannel->endpointEnabled())
+            return true;
+    }
+    return false;
+}
+
+bool sfeDLIoTPublisher::online(void)
+{
+    return enabled() && (!_theNetwork || _theNetwork->isConnected());
+}
+
+//---------------------------------------------------------------------------
+// Job callback - time based batch flushing
+void sfeDLIoTPublisher::checkChannels(void)
+{
+    for (auto pChannel : _channels)
+    {
+        pChannel->checkWindow();
+        pChannel->replayHeld(kPublisherReplayPerCheck);
+    }
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTPublisher::onConnectionChange(bool bConnected)
+{
+    for (auto pChannel : _channels)
+    {
+        pChannel->setOnline(bConnected);
+        if (bConnected)
+            pChannel->resendDictionary();
+    }
+}
+
+//---------------------------------------------------------------------------
+// The event can arrive before or after the logger writes the triggered observation, so send what is
+// batched now, and flag that the next observation is sent right away. PPS and external serial data trigger
+// observations all the time - they're batched as usual.
+void sfeDLIoTPublisher::onLogObservationEvent(const char *szSource)
+{
+    if (!dlEventIsAlarm(szSource))
+        return;
+
+    flushAll();
+    _bAlarmPending = true;
+}
@@ -0,0 +1,148 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - IoT publisher
+ *
+ * Receives the JSON observations from the output formatter and hands them to the publish
+ * channel of each IoT endpoint.
+ *
+ */
+#pragma once
+
+#include <Flux/flxCoreInterface.h>
+#include <Flux/flxCoreJobs.h>
+#include <Flux/flxFS.h>
+#include <Flux/flxNetwork.h>
+
+#include <ArduinoJson.h>
+
+#include "sfeDLIoTChannel.h"
+#include "sfeDLPayload.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class sfeDLIoTPublisher : public flxIWriterJSON
+{
+  public:
+    sfeDLIoTPublisher() : _isInitialized{false}, _bAlarmPending{false}, _bBenchmarkPending{false}, _theNetwork{nullptr},
+          _fileSystem{nullptr}, _hTaskDelivery{NULL}, _lastObservationTicks{0}
+    {
+    }
+
+    // setup the publisher - start the job used to check batch windows and the background delivery task
+    void initialize(void);
+
+    void add(sfeDLIoTChannel *pChannel)
+    {
+        if (!pChannel)
+            return;
+
+        pChannel->setDictionary(&_dictionary);
+        pChannel->setDeliveryNotify([this]() { return notifyDelivery(); });
+        _channels.push_back(pChannel);
+    }
+
+    // flxIWriterJSON - called by the JSON formatter with each observation
+    void write(JsonDocument &jDoc);
+
+    // Push out all batched observations
+    void flushAll(void);
+
+    // Number of payloads and batched observations not yet delivered - over all channels
+    uint32_t undelivered(void);
+
+    // Is any channel's endpoint enabled? And is one of them able to deliver now - the network is up
+    bool enabled(void);
+    bool online(void);
+
+    // Time (ms) since the last observation was output
+    uint32_t msSinceObservation(void)
+    {
+        return millis() - _lastObservationTicks;
+    }
+
+    // Network state is tracked so payloads can be held while offline
+    void setNetwork(flxNetwork *theNetwork)
+    {
+        _theNetwork = theNetwork;
+    }
+
+    // Filesystem for payloads held on the SD card
+    void setFileSystem(flxIFileSystem *fs)
+    {
+        _fileSystem = fs;
+    }
+
+    // Called by the delivery task - services the channel queues until they are empty
+    void processDelivery(void);
+
+    // Other work done by the delivery task - the service returns true if more is waiting
+    void addDeliveryService(std::function<bool(void)> service)
+    {
+        _services.push_back(service);
+    }
+
+    // Wakes the delivery task. Returns false if the task isn't running
+    bool notifyDelivery(void);
+
+    // Time the payload encoders using the next observation
+    void requestBenchmark(void)
+    {
+        _bBenchmarkPending = true;
+    }
+
+    // for iterating over the channels
+    std::vector<sfeDLIoTChannel *>::iterator begin()
+    {
+        return _channels.begin();
+    }
+    std::vector<sfeDLIoTChannel *>::iterator end()
+    {
+        return _channels.end();
+    }
+
+  private:
+    void checkChannels(void);
+
+    // Encode the observation with the key dictionary - if any channel wants it
+    JsonDocument *encodeCompact(JsonDocument &jDoc);
+
+    void runBenchmark(JsonDocument &jDoc);
+
+    // On a new connection, send the key dictionary again
+    void onConnectionChange(bool bConnected);
+
+    // Event triggered observations from an alarm source flush batched data
+    void onLogObservationEvent(const char *);
+
+    std::vector<sfeDLIoTChannel *> _channels;
+
+    std::vector<std::function<bool(void)>> _services;
+
+    // Key dictionary and compact encoding shared by all channels
+    sfeDLKeyDictionary _dictionary;
+    std::unique_ptr<DynamicJsonDocument> _compactDoc;
+
+    bool _isInitialized;
+    bool _bAlarmPending;
+    bool _bBenchmarkPending;
+
+    flxNetwork *_theNetwork;
+    flxIFileSystem *_fileSystem;
+
+    flxJob _jobCheckChannels;
+
+    TaskHandle_t _hTaskDelivery;
+
+    uint32_t _lastObservationTicks;
+};
@@ -0,0 +1,210 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - IoT payload spool
+ *
+ */
+
+#include "sfeDLIoTSpool.h"
+
+#include <Flux/flxCoreLog.h>
+
+//---------------------------------------------------------------------------
+// Entries are stored as "<nObs>,<compact>,<json text>" - one per line in the file
+
+bool sfeDLIoTSpool::push(JsonDocument &jDoc, uint32_t nObs, bool bCompact)
+{
+    char szPrefix[16];
+    snprintf(szPrefix, sizeof(szPrefix), "%u,%u,", nObs, bCompact ? 1 : 0);
+
+    std::string entry = szPrefix;
+    serializeJson(jDoc, entry);
+
+    // Once entries go to the file, all do - until the file is drained. Keeps the order.
+    if (_nFile == 0 && _ram.size() < _maxRAM)
+    {
+        _ram.push_back(entry);
+        return true;
+    }
+    if (!_useFile || !_fileSystem)
+        return false;
+
+    return pushFile(entry);
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTSpool::pop(JsonDocument &jDoc, uint32_t &nObs, bool &bCompact)
+{
+    std::string entry;
+
+    if (!_ram.empty())
+    {
+        entry = _ram.front();
+        _ram.pop_front();
+    }
+    else if (!popFile(entry))
+        return false;
+
+    unsigned int obs, compact;
+    int nPrefix = 0;
+    if (sscanf(entry.c_str(), "%u,%u,%n", &obs, &compact, &nPrefix) != 2 || nPrefix == 0)
+        return false;
+
+    nObs = obs;
+    bCompact = compact != 0;
+
+    return deserializeJson(jDoc, entry.c_str() + nPrefix) == DeserializationError::Ok;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTSpool::clear(void)
+{
+    _ram.clear();
+
+    if (_nFile > 0 && _fileSystem)
+        _fileSystem->fileSystem().remove(_filename.c_str());
+
+    _nFile = 0;
+    _readPos = 0;
+}
+
+//---------------------------------------------------------------------------
+// File methods
+//
+// The file is "<read position>\n" - zero padded to a fixed width - followed by the entries
+//---------------------------------------------------------------------------
+
+// Header width - 10 digits and a newline
+const uint32_t kSpoolHeaderSize = 11;
+
+bool sfeDLIoTSpool::writeReadPos(File &theFile)
+{
+    char szHeader[kSpoolHeaderSize + 1];
+    snprintf(szHeader, sizeof(szHeader), "%010u\n", _readPos);
+
+    return theFile.seek(0) && theFile.write((const uint8_t *)szHeader, kSpoolHeaderSize) == kSpoolHeaderSize;
+}
+
+//---------------------------------------------------------------------------
+// recoverFile()
+//
+// Pick up a file left by the last run - the entry count is the lines past the read position
+
+void sfeDLIoTSpool::recoverFile(void)
+{
+    _nFile = 0;
+    _readPos = 0;
+
+    if (!_fileSystem || !_fileSystem->fileSystem().exists(_filename.c_str()))
+        return;
+
+    FS theFS = _fileSystem->fileSystem();
+    File theFile = theFS.open(_filename.c_str(), "r");
+    if (!theFile)
+        return;
+
+    char szHeader[kSpoolHeaderSize + 1] = {};
+    unsigned int readPos = 0;
+    size_t fileSize = theFile.size();
+
+    bool bOkay = theFile.read((uint8_t *)szHeader, kSpoolHeaderSize) == kSpoolHeaderSize &&
+                 szHeader[kSpoolHeaderSize - 1] == '\n' && sscanf(szHeader, "%u", &readPos) == 1 &&
+                 readPos >= kSpoolHeaderSize && readPos <= fileSize && theFile.seek(readPos);
+
+    uint32_t nFile = 0;
+    if (bOkay)
+    {
+        uint8_t buffer[128];
+        int nRead;
+        while ((nRead = theFile.read(buffer, sizeof(buffer))) > 0)
+        {
+            for (int i = 0; i < nRead; i++)
+                if (buffer[i] == '\n')
+                    nFile++;
+        }
+    }
+    theFile.close();
+
+    if (!bOkay || nFile == 0)
+    {
+        if (!bOkay)
+            flxLog_W(F("IoT spool file %s is invalid - discarded"), _filename.c_str());
+        theFS.remove(_filename.c_str());
+        return;
+    }
+    _nFile = nFile;
+    _readPos = readPos;
+
+    flxLog_I(F("Recovered %u held IoT payloads from %s"), _nFile, _filename.c_str());
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTSpool::pushFile(const std::string &entry)
+{
+    FS theFS = _fileSystem->fileSystem();
+
+    bool bNew = _nFile == 0;
+    if (bNew)
+        _readPos = kSpoolHeaderSize;
+
+    File theFile = theFS.open(_filename.c_str(), bNew ? "w" : "a");
+    if (!theFile)
+    {
+        flxLog_E(F("Unable to open IoT spool file %s"), _filename.c_str());
+        return false;
+    }
+    bool bOkay = (!bNew || writeReadPos(theFile)) &&
+                 theFile.write((const uint8_t *)entry.c_str(), entry.length()) == entry.length() &&
+                 theFile.write((const uint8_t *)"\n", 1) == 1;
+    theFile.close();
+
+    if (bOkay)
+        _nFile++;
+    else if (bNew)
+        theFS.remove(_filename.c_str());
+
+    return bOkay;
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTSpool::popFile(std::string &entry)
+{
+    if (_nFile == 0 || !_fileSystem)
+        return false;
+
+    FS theFS = _fileSystem->fileSystem();
+
+    // drained? The last entry doesn't need the header updated - the file is removed
+    bool bLast = _nFile == 1;
+
+    File theFile = theFS.open(_filename.c_str(), bLast ? "r" : "r+");
+    if (!theFile || !theFile.seek(_readPos))
+    {
+        // the file is gone - nothing more to replay
+        _nFile = 0;
+        _readPos = 0;
+        return false;
+    }
+    entry = theFile.readStringUntil('\n').c_str();
+    _readPos = theFile.position();
+
+    if (!bLast && !writeReadPos(theFile))
+        flxLog_W(F("Unable to update IoT spool file %s"), _filename.c_str());
+
+    theFile.close();
+
+    if (--_nFile == 0)
+    {
+        theFS.remove(_filename.c_str());
+        _readPos = 0;
+    }
+    return entry.length() > 0;
+}
@@ -0,0 +1,92 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - IoT payload spool
+ *
+ * Holds payloads that couldn't be delivered, in order, for replay later. Payloads are held in RAM up
+ * to a limit, then (optionally) appended to a file on the SD card. Each entry is stored as serialized
+ * JSON text, so a held payload costs its text size, not a JSON document allocation.
+ *
+ * The file starts with a fixed width header line - the read position of the oldest entry - which is rewritten
+ * in place as entries are replayed. At startup the file left by the last run is picked up from that position,
+ * so held payloads survive a reset, power loss or deep sleep. An entry replayed just before a reset may be sent
+ * again.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxFS.h>
+
+#include <ArduinoJson.h>
+
+#include <deque>
+#include <string>
+
+class sfeDLIoTSpool
+{
+  public:
+    sfeDLIoTSpool() : _fileSystem{nullptr}, _maxRAM{0}, _useFile{false}, _nFile{0}, _readPos{0}
+    {
+    }
+
+    // Filesystem and file used for overflow - entries left in the file by the last run are recovered
+    void setFile(flxIFileSystem *fs, const char *szFilename)
+    {
+        _fileSystem = fs;
+        _filename = szFilename;
+        recoverFile();
+    }
+
+    // Max entries held in RAM, and if entries beyond that go to the file
+    void setLimits(uint32_t maxRAM, bool useFile)
+    {
+        _maxRAM = maxRAM;
+        _useFile = useFile;
+    }
+
+    // Hold a payload - returns false if there is no room
+    bool push(JsonDocument &jDoc, uint32_t nObs, bool bCompact);
+
+    // Get the oldest payload - returns false if empty or on error
+    bool pop(JsonDocument &jDoc, uint32_t &nObs, bool &bCompact);
+
+    uint32_t size(void)
+    {
+        return _ram.size() + _nFile;
+    }
+
+    bool empty(void)
+    {
+        return size() == 0;
+    }
+
+    void clear(void);
+
+  private:
+    void recoverFile(void);
+    bool writeReadPos(File &theFile);
+    bool pushFile(const std::string &entry);
+    bool popFile(std::string &entry);
+
+    flxIFileSystem *_fileSystem;
+    std::string _filename;
+
+    uint32_t _maxRAM;
+    bool _useFile;
+
+    std::deque<std::string> _ram;
+
+    // entries in the file, and the read position of the oldest
+    uint32_t _nFile;
+    uint32_t _readPos;
+};
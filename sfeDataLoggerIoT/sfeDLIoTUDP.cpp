@@ -0,0 +1,210 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - UDP telemetry IoT service
+ *
+ */
+
+#include "sfeDLIoTUDP.h"
+
+#include <Flux/flxCoreLog.h>
+#include <Flux/flxFlux.h>
+
+// how often the batch window is checked (ms)
+const uint32_t kUDPBatchCheckPeriod = 100;
+
+// JSON document size used to pack a datagram - well over what a max sized datagram needs
+const uint32_t kUDPDatagramDocSize = 8192;
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLIoTUDP::sfeDLIoTUDP()
+    : _theNetwork{nullptr}, _nPacked{0}, _packedSize{0}, _packStartTicks{0}, _sequence{0}, _hMutex{NULL},
+      _nDatagrams{0}, _nPayloads{0}, _nBytes{0}, _nSendErrors{0}
+{
+    setName("UDP Telemetry", "Send observations as UDP datagrams to a local collector");
+
+    flxRegister(enabled, "Enabled", "Enable or Disable UDP telemetry");
+    flxRegister(host, "Host", "Host name or IP address of the collector");
+    flxRegister(port, "Port", "UDP port of the collector");
+    flxRegister(format, "Format", "Datagram encoding");
+
+    fillDatagrams.setTitle("Batching");
+    flxRegister(fillDatagrams, "Fill Datagrams", "Pack payloads into each datagram, up to the max size");
+    flxRegister(maxDatagram, "Max Datagram Size", "Max bytes in a datagram. 1472 fits an ethernet MTU");
+    flxRegister(batchWindow, "Batch Window (ms)", "Max time a payload waits to fill a datagram");
+
+    enabled = false;
+    port = kUDPPort;
+    fillDatagrams = false;
+    maxDatagram = kUDPMaxDatagram;
+    batchWindow = kUDPBatchWindow;
+
+    _hMutex = xSemaphoreCreateMutex();
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTUDP::initialize(void)
+{
+    _jobCheckBatch.setup("udpbatch", kUDPBatchCheckPeriod, this, &sfeDLIoTUDP::checkBatch);
+    flxAddJobToQueue(_jobCheckBatch);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+size_t sfeDLIoTUDP::measure(JsonDocument &jDoc)
+{
+    return format() == kUDPFormatMsgPack ? measureMsgPack(jDoc) : measureJson(jDoc);
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLIoTUDP::startDatagram(void)
+{
+    if (!_datagram)
+    {
+        _datagram.reset(new DynamicJsonDocument(kUDPDatagramDocSize));
+
+        if (!_datagram || _datagram->capacity() == 0)
+        {
+            flxLogM_E(kMsgErrAllocError, "UDP datagram buffer");
+            _datagram.reset();
+            return false;
+        }
+    }
+    _datagram->clear();
+
+    // The sequence number is assigned here - datagrams are sent in the order they are started
+    (*_datagram)["seq"] = _sequence;
+    (*_datagram)["dev"] = flux.deviceId();
+    _datagram->createNestedArray("p");
+
+    _nPacked = 0;
+    _packedSize = measure(*_datagram);
+    _packStartTicks = millis();
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// sendDatagram()
+//
+// Send the packed datagram. A lost datagram isn't resent - the collector sees the gap in the sequence numbers.
+
+void sfeDLIoTUDP::sendDatagram(void)
+{
+    if (_nPacked == 0 || !_datagram)
+        return;
+
+    size_t length = measure(*_datagram);
+    uint8_t *pBuffer = new uint8_t[length + 1];
+    if (!pBuffer)
+    {
+        flxLogM_E(kMsgErrAllocError, name());
+        return;
+    }
+    if (format() == kUDPFormatMsgPack)
+        serializeMsgPack(*_datagram, pBuffer, length);
+    else
+        serializeJson(*_datagram, (char *)pBuffer, length + 1);
+
+    bool bOkay = _udp.beginPacket(host().c_str(), port()) && _udp.write(pBuffer, length) == length &&
+                 _udp.endPacket();
+    delete[] pBuffer;
+
+    if (bOkay)
+    {
+        _nDatagrams++;
+        _nBytes += length;
+    }
+    else
+    {
+        _nSendErrors++;
+        flxLog_V(F("%s: Error sending datagram %u to %s:%u"), name(), _sequence, host().c_str(), port());
+    }
+    _sequence++;
+    _nPacked = 0;
+}
+
+//---------------------------------------------------------------------------
+// write()
+//
+// Called for each payload. Payloads are packed into the current datagram until the next one would push it
+// over the max size. A payload larger than the max size is sent on its own - IP fragments it.
+
+void sfeDLIoTUDP::write(JsonDocument &jDoc)
+{
+    if (!enabled() || host().length() == 0 || !_theNetwork || !_theNetwork->isConnected())
+        return;
+
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+
+    size_t payloadSize = measure(jDoc) + 1; // + separator
+
+    if (_nPacked > 0 && _packedSize + payloadSize > maxDatagram())
+        sendDatagram();
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (_nPacked == 0 && !startDatagram())
+            break;
+
+        JsonArray jaPayloads = (*_datagram)["p"];
+
+        if (jaPayloads.add(jDoc.as<JsonObjectConst>()) && !_datagram->overflowed())
+        {
+            _nPacked++;
+            _nPayloads++;
+            _packedSize += payloadSize;
+            break;
+        }
+
+        // Out of document memory - back out the partial add, send what is packed and try again
+        if (jaPayloads.size() > _nPacked)
+            jaPayloads.remove(_nPacked);
+
+        if (_nPacked == 0)
+        {
+            _nSendErrors++;
+            flxLog_E(F("%s: Payload too large for a datagram"), name());
+            break;
+        }
+        sendDatagram();
+    }
+
+    if (_nPacked > 0 && (!fillDatagrams() || _packedSize >= maxDatagram()))
+        sendDatagram();
+
+    xSemaphoreGive(_hMutex);
+}
+
+//---------------------------------------------------------------------------
+// Job callback - send a partly filled datagram once the batch window passes
+
+void sfeDLIoTUDP::checkBatch(void)
+{
+    if (_nPacked == 0 || (fillDatagrams() && millis() - _packStartTicks < batchWindow()))
+        return;
+
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+    sendDatagram();
+    xSemaphoreGive(_hMutex);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLIoTUDP::resetStats(void)
+{
+    _nDatagrams = 0;
+    _nPayloads = 0;
+    _nBytes = 0;
+    _nSendErrors = 0;
+}
@@ -0,0 +1,138 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - UDP telemetry IoT service
+ *
+ * Sends observations, best effort, as UDP datagrams to a collector at host:port. No connection and no
+ * acknowledgement - for local collectors that want low latency over guaranteed delivery.
+ *
+ * Each datagram is a JSON - or MessagePack - object:
+ *
+ *      {"seq":<sequence number>,"dev":"<device id>","p":[<payload>, ...]}
+ *
+ * The sequence number increments with each datagram, so the collector can detect lost datagrams. With
+ * Fill Datagrams set, payloads are packed into a datagram until the next would exceed the max datagram
+ * size, or the oldest has waited the batch window.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCore.h>
+#include <Flux/flxCoreInterface.h>
+#include <Flux/flxCoreJobs.h>
+#include <Flux/flxNetwork.h>
+
+#include <ArduinoJson.h>
+#include <WiFiUdp.h>
+
+#include <memory>
+
+// Defaults - collector port, max datagram size (bytes) and how long (ms) a payload waits to fill a datagram
+const uint32_t kUDPPort = 5005;
+const uint32_t kUDPMaxDatagram = 1400;
+const uint32_t kUDPBatchWindow = 1000;
+
+// Largest datagram that fits an ethernet MTU without fragmenting
+const uint32_t kUDPMaxMTUDatagram = 1472;
+
+class sfeDLIoTUDP : public flxActionType<sfeDLIoTUDP>, public flxIWriterJSON
+{
+  public:
+    sfeDLIoTUDP();
+
+    void setNetwork(flxNetwork *theNetwork)
+    {
+        _theNetwork = theNetwork;
+    }
+
+    bool initialize(void);
+
+    // flxIWriterJSON - send (or pack) a payload
+    void write(JsonDocument &jDoc);
+
+    //---------------------------------------------------------------------------
+    // Stats
+    uint32_t nDatagrams(void)
+    {
+        return _nDatagrams;
+    }
+    uint32_t nPayloads(void)
+    {
+        return _nPayloads;
+    }
+    uint32_t nBytes(void)
+    {
+        return _nBytes;
+    }
+    uint32_t nSendErrors(void)
+    {
+        return _nSendErrors;
+    }
+    uint32_t sequence(void)
+    {
+        return _sequence;
+    }
+
+    void resetStats(void);
+
+    // Datagram formats
+    static constexpr uint8_t kUDPFormatJSON = 0x0;
+    static constexpr uint8_t kUDPFormatMsgPack = 0x1;
+
+    // Properties
+    flxPropertyBool<sfeDLIoTUDP> enabled;
+
+    flxPropertyString<sfeDLIoTUDP> host;
+
+    flxPropertyUInt32<sfeDLIoTUDP> port = {1, 65535};
+
+    flxPropertyUInt8<sfeDLIoTUDP> format = {
+        kUDPFormatJSON, {{"JSON", kUDPFormatJSON}, {"MessagePack", kUDPFormatMsgPack}}};
+
+    // Pack payloads into MTU sized datagrams
+    flxPropertyBool<sfeDLIoTUDP> fillDatagrams;
+
+    flxPropertyUInt32<sfeDLIoTUDP> maxDatagram = {128, kUDPMaxMTUDatagram};
+
+    flxPropertyUInt32<sfeDLIoTUDP> batchWindow = {10, 60000};
+
+  private:
+    bool startDatagram(void);
+    size_t measure(JsonDocument &jDoc);
+    void sendDatagram(void);
+    void checkBatch(void);
+
+    flxNetwork *_theNetwork;
+
+    WiFiUDP _udp;
+
+    // the datagram being packed, and its serialized form
+    std::unique_ptr<DynamicJsonDocument> _datagram;
+    std::unique_ptr<uint8_t[]> _buffer;
+    uint32_t _nPacked;
+    size_t _packedSize;
+    uint32_t _packStartTicks;
+
+    uint32_t _sequence;
+
+    // write() runs on the IoT delivery task, the batch check on the main loop
+    SemaphoreHandle_t _hMutex;
+
+    flxJob _jobCheckBatch;
+
+    // stats
+    uint32_t _nDatagrams;
+    uint32_t _nPayloads;
+    uint32_t _nBytes;
+    uint32_t _nSendErrors;
+};
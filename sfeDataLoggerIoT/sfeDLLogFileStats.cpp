@@ -0,0 +1,395 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - log file write timing
+ *
+ */
+
+#include "sfeDLLogFileStats.h"
+
+#include <Flux/flxCoreLog.h>
+
+#include <diskio.h>
+#include <esp_attr.h>
+#include <esp_sleep.h>
+
+#include <algorithm>
+#include <string.h>
+#include <string>
+#include <time.h>
+
+#define kLogFileStatsMagic 0x53464C44  // "DLFS"
+#define kLogFileCursorMagic 0x43464C44 // "DLFC"
+
+// How often (ms) a resumed log file is synced to the card - and the cursor saved
+const uint32_t kLogFileSyncPeriod = 1000;
+
+// Max length of the saved log file name
+const uint8_t kLogFileNameMax = 32;
+
+// Same line ending as flxFileRotate
+static const char *kLogFileNewLine = "\n";
+
+// The first write of recent startups - a ring, kept across deep sleep
+typedef struct
+{
+    uint32_t magic;
+    uint32_t next;
+    uint32_t count;
+    sfeDLLogFileOpen_t entries[kLogFileHistory];
+} sfeDLLogFileHistory_t;
+
+RTC_DATA_ATTR static sfeDLLogFileHistory_t _rtcHistory;
+
+// The end of the current log file - kept across deep sleep. clust is 0 until the file has been opened and
+// positioned here - the file flxFileRotate had open is found with one seek to its end.
+typedef struct
+{
+    uint32_t magic;
+    char filename[kLogFileNameMax];
+    uint32_t openTime; // when the file was first seen open - for the rotation period
+    uint32_t volSerial;
+    uint32_t size;
+    uint32_t sclust;
+    uint32_t clust;
+} sfeDLLogFileCursor_t;
+
+RTC_DATA_ATTR static sfeDLLogFileCursor_t _rtcCursor;
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLLogFileStats::sfeDLLogFileStats()
+    : _pFile{nullptr}, _pFS{nullptr}, _bResumed{false}, _bUnsynced{false}, _nWrites{0}, _usFirstWrite{0},
+      _usAppendTotal{0}, _usAppendMax{0}
+{
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLLogFileStats::initialize(void)
+{
+    _jobCheckFile.setup("logfilesync", kLogFileSyncPeriod, this, &sfeDLLogFileStats::checkFile);
+    flxAddJobToQueue(_jobCheckFile);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+std::string sfeDLLogFileStats::currentFilename(void)
+{
+    if (_bResumed)
+        return std::string("/") + _rtcCursor.filename;
+
+    return _pFile ? _pFile->currentFilename() : "";
+}
+
+//---------------------------------------------------------------------------
+// volumeSerial()
+//
+// The volume serial number from the card's boot sector - read into the file buffer, before the file is positioned
+
+uint32_t sfeDLLogFileStats::volumeSerial(void)
+{
+    FATFS *fs = _theFile.obj.fs;
+
+    if (disk_read(fs->pdrv, _theFile.buf, fs->volbase, 1) != RES_OK)
+        return 0;
+
+    uint32_t offset = fs->fs_type == FS_FAT32 ? 67 : 39; // BS_VolID32 : BS_VolID
+#if FF_FS_EXFAT
+    if (fs->fs_type == FS_EXFAT)
+        offset = 100; // BPB_VolIDEx
+#endif
+    uint8_t *pID = _theFile.buf + offset;
+    uint32_t serial = pID[0] | pID[1] << 8 | pID[2] << 16 | (uint32_t)pID[3] << 24;
+
+    memset(_theFile.buf, 0, sizeof(_theFile.buf));
+
+    return serial;
+}
+
+//---------------------------------------------------------------------------
+// seekCursor()
+//
+// Set the file position from the cursor - what f_lseek() does, without walking the cluster chain. The sector
+// with the end of the file is read into the file buffer, as FatFs expects for a partial sector.
+
+bool sfeDLLogFileStats::seekCursor(void)
+{
+    FATFS *fs = _theFile.obj.fs;
+
+    if (_rtcCursor.clust < 2 || _rtcCursor.clust >= fs->n_fatent)
+        return false;
+
+#if FF_MAX_SS == FF_MIN_SS
+    uint32_t sectorSize = FF_MAX_SS;
+#else
+    uint32_t sectorSize = fs->ssize;
+#endif
+
+    _theFile.fptr = _rtcCursor.size;
+    _theFile.clust = _rtcCursor.clust;
+
+    if (_rtcCursor.size % sectorSize == 0)
+        return true;
+
+    LBA_t sector = fs->database + (LBA_t)fs->csize * (_rtcCursor.clust - 2) +
+                   ((_rtcCursor.size / sectorSize) & (fs->csize - 1));
+    if (disk_read(fs->pdrv, _theFile.buf, sector, 1) != RES_OK)
+        return false;
+
+    _theFile.sect = sector;
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// resume()
+//
+// On a wake from sleep, open the log file the last run was writing, at its end. Returns false if the normal
+// path should be taken - flxFileRotate opens the file.
+
+bool sfeDLLogFileStats::resume(void)
+{
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER || _rtcCursor.magic != kLogFileCursorMagic ||
+        strlen(_rtcCursor.filename) == 0 || !_pFS || !_pFS->enabled())
+        return false;
+
+    // time for a new file? flxFileRotate starts it
+    uint32_t secsRotate = _pFile->rotatePeriod() * 3600;
+    if (secsRotate > 0 && (uint32_t)time(nullptr) - _rtcCursor.openTime >= secsRotate)
+        return false;
+
+    // The card is mounted on one of the FatFs drives - the file's directory entry is looked up, no chain walk
+    bool bOpen = false;
+    for (uint8_t drive = 0; drive < FF_VOLUMES && !bOpen; drive++)
+    {
+        std::string path = std::to_string(drive) + ":/" + _rtcCursor.filename;
+        bOpen = f_open(&_theFile, path.c_str(), FA_WRITE | FA_OPEN_EXISTING) == FR_OK;
+    }
+    if (!bOpen)
+        return false;
+
+    bool bPositioned;
+
+    if (_rtcCursor.clust == 0)
+    {
+        // the file flxFileRotate had open - one seek to its end, the cursor is kept from here
+        bPositioned = f_lseek(&_theFile, f_size(&_theFile)) == FR_OK;
+        _rtcCursor.volSerial = volumeSerial();
+    }
+    else
+    {
+        // same card, and the file hasn't changed since it was synced?
+        bPositioned = volumeSerial() == _rtcCursor.volSerial && f_size(&_theFile) == _rtcCursor.size &&
+                      _theFile.obj.sclust == _rtcCursor.sclust && seekCursor();
+    }
+
+    if (!bPositioned)
+    {
+        flxLog_V(F("Log file %s changed - opening it again"), _rtcCursor.filename);
+        f_close(&_theFile);
+        _rtcCursor.clust = 0;
+        return false;
+    }
+
+    _bResumed = true;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// saveCursor()
+//
+// The cursor is saved once the file is synced - so it matches the directory entry on the card
+
+void sfeDLLogFileStats::saveCursor(void)
+{
+    _rtcCursor.size = f_size(&_theFile);
+    _rtcCursor.sclust = _theFile.obj.sclust;
+    _rtcCursor.clust = _theFile.clust;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLLogFileStats::closeResumed(void)
+{
+    if (!_bResumed)
+        return;
+
+    f_close(&_theFile);
+    _bResumed = false;
+    _bUnsynced = false;
+
+    // flxFileRotate writes the file from here - the position isn't known
+    _rtcCursor.clust = 0;
+}
+
+//---------------------------------------------------------------------------
+// checkFile()
+//
+// Job - sync a resumed file, and hand it back to flxFileRotate when it's time to rotate
+
+void sfeDLLogFileStats::checkFile(void)
+{
+    if (!_bResumed)
+        return;
+
+    uint32_t secsRotate = _pFile->rotatePeriod() * 3600;
+    if (secsRotate > 0 && (uint32_t)time(nullptr) - _rtcCursor.openTime >= secsRotate)
+    {
+        closeResumed();
+        return;
+    }
+
+    if (!_bUnsynced)
+        return;
+
+    if (f_sync(&_theFile) != FR_OK)
+    {
+        flxLog_E(F("Error syncing log file %s"), _rtcCursor.filename);
+        closeResumed();
+        return;
+    }
+    _bUnsynced = false;
+    saveCursor();
+}
+
+//---------------------------------------------------------------------------
+// flush()
+//
+// Before sleep. A resumed file is synced and the cursor saved. Otherwise the name of the file flxFileRotate has
+// open is saved - with no position, it's found by a seek on the next wake.
+
+void sfeDLLogFileStats::flush(void)
+{
+    if (_bResumed)
+    {
+        _bUnsynced = true;
+        checkFile();
+        return;
+    }
+
+    std::string filename = _pFile ? _pFile->currentFilename() : "";
+    if (filename.length() > 0 && filename[0] == '/')
+        filename.erase(0, 1);
+
+    // nothing opened this time - the saved cursor still holds
+    if (filename.length() == 0 || filename.length() >= kLogFileNameMax)
+        return;
+
+    if (_rtcCursor.magic != kLogFileCursorMagic || filename != _rtcCursor.filename)
+    {
+        memset(&_rtcCursor, 0, sizeof(_rtcCursor));
+        _rtcCursor.magic = kLogFileCursorMagic;
+        memcpy(_rtcCursor.filename, filename.c_str(), filename.length());
+        _rtcCursor.openTime = time(nullptr);
+    }
+    _rtcCursor.clust = 0;
+}
+
+//---------------------------------------------------------------------------
+// fileSize()
+//
+// Size of the current log file - from its directory entry, no seek
+
+uint32_t sfeDLLogFileStats::fileSize(void)
+{
+    if (_bResumed)
+        return f_size(&_theFile);
+
+    if (!_pFS || !_pFS->enabled())
+        return 0;
+
+    std::string filename = _pFile->currentFilename();
+    if (filename.length() == 0)
+        return 0;
+    if (filename[0] != '/')
+        filename = "/" + filename;
+
+    File theFile = _pFS->fileSystem().open(filename.c_str(), "r");
+    if (!theFile)
+        return 0;
+
+    uint32_t size = theFile.size();
+    theFile.close();
+
+    return size;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLLogFileStats::write(const char *szLine, bool newLine, flxLineType_t type)
+{
+    if (!_pFile)
+        return;
+
+    uint32_t ticks = micros();
+
+    if (_nWrites == 0)
+        resume();
+
+    if (_bResumed)
+    {
+        UINT nWritten;
+        UINT length = strlen(szLine);
+        if (f_write(&_theFile, szLine, length, &nWritten) != FR_OK || nWritten != length ||
+            (newLine && f_write(&_theFile, kLogFileNewLine, 1, &nWritten) != FR_OK))
+        {
+            // the line goes through flxFileRotate
+            flxLog_E(F("Error writing log file %s"), _rtcCursor.filename);
+            closeResumed();
+        }
+        else
+            _bUnsynced = true;
+    }
+
+    if (!_bResumed)
+        _pFile->write(szLine, newLine, type);
+
+    uint32_t usWrite = micros() - ticks;
+
+    _nWrites++;
+
+    if (_nWrites > 1)
+    {
+        _usAppendTotal += usWrite;
+        _usAppendMax = std::max(_usAppendMax, usWrite);
+        return;
+    }
+
+    // The first write opened the file
+    _usFirstWrite = usWrite;
+
+    if (_rtcHistory.magic != kLogFileStatsMagic || _rtcHistory.next >= kLogFileHistory)
+    {
+        memset(&_rtcHistory, 0, sizeof(_rtcHistory));
+        _rtcHistory.magic = kLogFileStatsMagic;
+    }
+    _rtcHistory.entries[_rtcHistory.next].fileSize = fileSize();
+    _rtcHistory.entries[_rtcHistory.next].usFirstWrite = usWrite;
+    _rtcHistory.entries[_rtcHistory.next].bResumed = _bResumed;
+
+    _rtcHistory.next = (_rtcHistory.next + 1) % kLogFileHistory;
+    if (_rtcHistory.count < kLogFileHistory)
+        _rtcHistory.count++;
+}
+
+//---------------------------------------------------------------------------
+uint8_t sfeDLLogFileStats::history(sfeDLLogFileOpen_t entries[kLogFileHistory])
+{
+    if (_rtcHistory.magic != kLogFileStatsMagic || _rtcHistory.count > kLogFileHistory ||
+        _rtcHistory.next >= kLogFileHistory)
+        return 0;
+
+    uint32_t first = (_rtcHistory.next + kLogFileHistory - _rtcHistory.count) % kLogFileHistory;
+    for (uint32_t i = 0; i < _rtcHistory.count; i++)
+        entries[i] = _rtcHistory.entries[(first + i) % kLogFileHistory];
+
+    return _rtcHistory.count;
+}
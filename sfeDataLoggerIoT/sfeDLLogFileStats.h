@@ -0,0 +1,126 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - log file write timing
+ *
+ * Passes SD card log lines to the log file, timing each write. The first write after startup includes opening
+ * the current log file and seeking to its end - on FAT the seek walks the file's cluster chain, so the time grows
+ * with the file size. The first write time and the file size are kept in RTC memory for the last few startups,
+ * so the cost can be followed across wakes from sleep (!log-file-stats).
+ *
+ * To skip that walk on a wake from sleep, the position at the end of the log file is kept in RTC memory - the
+ * file name, its size, first and last cluster and the card's volume serial number. On a wake the file is opened
+ * directly in the FAT file system, the cursor checked against the file's directory entry and the card, and the
+ * position set from it. The writes of that wake go to the file from here. The normal path, through
+ * flxFileRotate, is taken after a cold start, when the card or file changed, or when the file is due to rotate.
+ * The file left open by flxFileRotate is picked up, with one seek to its end, on the next wake.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCoreInterface.h>
+#include <Flux/flxCoreJobs.h>
+#include <Flux/flxFS.h>
+#include <Flux/flxFileRotate.h>
+
+#include <ff.h>
+
+#include <string>
+
+// Startups kept in the open history
+const uint8_t kLogFileHistory = 8;
+
+// The first write of a startup - open, seek to the end and append
+typedef struct
+{
+    uint32_t fileSize;
+    uint32_t usFirstWrite;
+    bool bResumed; // opened at the saved position
+} sfeDLLogFileOpen_t;
+
+class sfeDLLogFileStats : public flxWriter
+{
+  public:
+    sfeDLLogFileStats();
+
+    void setOutput(flxFileRotate *pFile, flxIFileSystem *pFS)
+    {
+        _pFile = pFile;
+        _pFS = pFS;
+    }
+
+    // Start the job that syncs a resumed log file
+    bool initialize(void);
+
+    // flxWriter - write to the log file, timed
+    void write(const char *szLine, bool newLine, flxLineType_t type);
+
+    // Save the log file position for the next wake - call before sleep
+    void flush(void);
+
+    // The log file being written - resumed, or opened by flxFileRotate
+    std::string currentFilename(void);
+
+    // Is the log file written from the saved position?
+    bool resumed(void)
+    {
+        return _bResumed;
+    }
+
+    //---------------------------------------------------------------------------
+    // Stats - this startup
+    uint32_t nWrites(void)
+    {
+        return _nWrites;
+    }
+    uint32_t usFirstWrite(void)
+    {
+        return _usFirstWrite;
+    }
+    // the writes after the first - appends to an open file
+    uint32_t usAppendAvg(void)
+    {
+        return _nWrites > 1 ? _usAppendTotal / (_nWrites - 1) : 0;
+    }
+    uint32_t usAppendMax(void)
+    {
+        return _usAppendMax;
+    }
+
+    // The first write of recent startups, oldest first - returns the number of entries
+    uint8_t history(sfeDLLogFileOpen_t entries[kLogFileHistory]);
+
+  private:
+    uint32_t fileSize(void);
+
+    bool resume(void);
+    bool seekCursor(void);
+    uint32_t volumeSerial(void);
+    void closeResumed(void);
+    void saveCursor(void);
+    void checkFile(void);
+
+    flxFileRotate *_pFile;
+    flxIFileSystem *_pFS;
+
+    // the log file, when written from the saved position
+    bool _bResumed;
+    FIL _theFile;
+    bool _bUnsynced;
+
+    flxJob _jobCheckFile;
+
+    uint32_t _nWrites;
+    uint32_t _usFirstWrite;
+    uint32_t _usAppendTotal;
+    uint32_t _usAppendMax;
+};
@@ -0,0 +1,162 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - compact observation payloads
+ *
+ */
+
+#include "sfeDLPayload.h"
+
+#include <Flux/flxFlux.h>
+
+//---------------------------------------------------------------------------
+// Search helpers - start at the hint position, wrap around.
+//---------------------------------------------------------------------------
+int sfeDLKeyDictionary::findSection(const char *szName)
+{
+    int nSections = _sections.size();
+
+    for (int i = 0; i < nSections; i++)
+    {
+        int iSection = (_lastSection + i) % nSections;
+        if (_sections[iSection].name == szName)
+        {
+            _lastSection = iSection;
+            return iSection;
+        }
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------------------
+int sfeDLKeyDictionary::findParam(section_t &section, const char *szName, int hint)
+{
+    int nParams = section.params.size();
+
+    for (int i = 0; i < nParams; i++)
+    {
+        int iParam = (hint + i) % nParams;
+        if (section.params[iParam] == szName)
+            return iParam;
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------------------
+// update()
+//
+// Returns true if the observation added entries to the dictionary.
+
+bool sfeDLKeyDictionary::update(JsonDocument &jObs)
+{
+    bool bChanged = false;
+
+    for (JsonPairConst kvSection : jObs.as<JsonObjectConst>())
+    {
+        const char *szSection = kvSection.key().c_str();
+        JsonObjectConst jParams = kvSection.value().as<JsonObjectConst>();
+
+        int iSection = findSection(szSection);
+        if (iSection < 0)
+        {
+            _sections.push_back({szSection, !jParams.isNull(), {}});
+            iSection = _sections.size() - 1;
+            _lastSection = iSection;
+            bChanged = true;
+        }
+        section_t &theSection = _sections[iSection];
+
+        if (!theSection.isObject)
+            continue;
+
+        int iParam = 0;
+        for (JsonPairConst kvParam : jParams)
+        {
+            iParam = findParam(theSection, kvParam.key().c_str(), iParam);
+            if (iParam < 0)
+            {
+                theSection.params.push_back(kvParam.key().c_str());
+                iParam = theSection.params.size() - 1;
+                bChanged = true;
+            }
+            iParam++;
+        }
+    }
+    if (bChanged)
+        _version++;
+
+    return bChanged;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLKeyDictionary::reset(void)
+{
+    _sections.clear();
+    _lastSection = 0;
+    _version++;
+}
+
+//---------------------------------------------------------------------------
+// encode()
+//
+// Values are output in dictionary parameter order - a parameter missing from the observation is null
+
+bool sfeDLKeyDictionary::encode(JsonDocument &jObs, JsonDocument &jOut)
+{
+    jOut.clear();
+    jOut["dv"] = _version;
+    JsonArray jaObs = jOut.createNestedArray("o");
+
+    for (JsonPairConst kvSection : jObs.as<JsonObjectConst>())
+    {
+        int iSection = findSection(kvSection.key().c_str());
+        if (iSection < 0)
+            return false; // dictionary out of date
+
+        section_t &theSection = _sections[iSection];
+
+        JsonArray jaSection = jaObs.createNestedArray();
+        jaSection.add(iSection);
+
+        if (!theSection.isObject)
+            jaSection.add(kvSection.value());
+        else
+        {
+            JsonObjectConst jParams = kvSection.value().as<JsonObjectConst>();
+            for (auto &param : theSection.params)
+                jaSection.add(jParams[param.c_str()]);
+        }
+    }
+    return !jOut.overflowed();
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLKeyDictionary::toJSON(JsonDocument &jDict)
+{
+    jDict.clear();
+    jDict["dictionary"] = _version;
+    jDict["board"] = flux.localName();
+    jDict["id"] = (char *)flux.deviceId(); // char * cast - so JSON copies string
+
+    JsonArray jaSections = jDict.createNestedArray("sections");
+
+    for (int i = 0; i < _sections.size(); i++)
+    {
+        JsonObject jSection = jaSections.createNestedObject();
+        jSection["id"] = i;
+        jSection["name"] = _sections[i].name;
+
+        JsonArray jaParams = jSection.createNestedArray("params");
+        for (auto &param : _sections[i].params)
+            jaParams.add(param);
+    }
+    return !jDict.overflowed();
+}
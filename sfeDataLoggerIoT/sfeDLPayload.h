@@ -0,0 +1,86 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - compact observation payloads
+ *
+ * An observation from the JSON formatter has the form:
+ *
+ *      {"<device>": {"<parameter>": value, ...}, ...}
+ *
+ * The device and parameter names make up most of the payload. The key dictionary assigns each
+ * device (section) an integer ID and fixes the order of its parameters. A compact observation is then:
+ *
+ *      {"dv": <dictionary version>, "o": [[<section id>, value, value, ...], ...]}
+ *
+ * The dictionary itself is published as:
+ *
+ *      {"dictionary": <version>, "board": "...", "id": "...",
+ *       "sections": [{"id": 0, "name": "<device>", "params": ["<parameter>", ...]}, ...]}
+ *
+ * A section that is a single value, not an object, has an empty "params" list and is encoded as
+ * [<section id>, value].
+ *
+ */
+#pragma once
+
+#include <ArduinoJson.h>
+
+#include <string>
+#include <vector>
+
+class sfeDLKeyDictionary
+{
+  public:
+    sfeDLKeyDictionary() : _version{1}, _lastSection{0}
+    {
+    }
+
+    // Add any new sections/parameters in the observation to the dictionary. Returns true if the
+    // dictionary changed (new version)
+    bool update(JsonDocument &jObs);
+
+    // Drop all entries - IDs are reassigned as observations arrive
+    void reset(void);
+
+    // Encode an observation using the dictionary
+    bool encode(JsonDocument &jObs, JsonDocument &jOut);
+
+    // The dictionary as a JSON document - for publishing
+    bool toJSON(JsonDocument &jDict);
+
+    uint32_t version(void)
+    {
+        return _version;
+    }
+
+    size_t size(void)
+    {
+        return _sections.size();
+    }
+
+  private:
+    typedef struct
+    {
+        std::string name;
+        bool isObject;
+        std::vector<std::string> params;
+    } section_t;
+
+    int findSection(const char *szName);
+    int findParam(section_t &section, const char *szName, int hint);
+
+    std::vector<section_t> _sections;
+
+    uint32_t _version;
+
+    // observations arrive in the same order each time - start searches where the last match was
+    int _lastSection;
+};
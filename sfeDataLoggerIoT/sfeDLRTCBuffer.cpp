@@ -0,0 +1,198 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - record buffer for RTC memory
+ *
+ */
+
+#include "sfeDLRTCBuffer.h"
+
+#include <string.h>
+
+#define kRTCBufferMagic 0x42524C44 // "DLRB"
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLRTCBuffer::sfeDLRTCBuffer() : _pHeaders{nullptr}, _pData{nullptr}, _capacity{0}, _current{0}
+{
+}
+
+//---------------------------------------------------------------------------
+// crc32()
+//
+// Bitwise - the buffer is small, and this keeps it free of platform code
+
+uint32_t sfeDLRTCBuffer::crc32(const uint8_t *pData, size_t length, uint32_t crc)
+{
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *pData++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+//---------------------------------------------------------------------------
+uint32_t sfeDLRTCBuffer::headerCRC(const header_t &theHeader)
+{
+    return crc32((const uint8_t *)&theHeader, offsetof(header_t, crc));
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLRTCBuffer::isValid(const header_t &theHeader)
+{
+    return theHeader.magic == kRTCBufferMagic && theHeader.capacity == _capacity && theHeader.used <= _capacity &&
+           theHeader.crc == headerCRC(theHeader);
+}
+
+//---------------------------------------------------------------------------
+// commit()
+//
+// Write a header to the other slot - it becomes current
+
+void sfeDLRTCBuffer::commit(header_t &theHeader)
+{
+    int next = _current ^ 1;
+
+    theHeader.magic = kRTCBufferMagic;
+    theHeader.sequence = _pHeaders[_current].sequence + 1;
+    theHeader.capacity = _capacity;
+    theHeader.crc = headerCRC(theHeader);
+
+    _pHeaders[next] = theHeader;
+    _current = next;
+}
+
+//---------------------------------------------------------------------------
+// attach()
+//
+// Find the current header - if neither is valid, the buffer is cleared
+
+bool sfeDLRTCBuffer::attach(void *pMemory, size_t size)
+{
+    _pHeaders = (header_t *)pMemory;
+    _pData = (uint8_t *)pMemory + 2 * sizeof(header_t);
+    _capacity = size > 2 * sizeof(header_t) ? size - 2 * sizeof(header_t) : 0;
+
+    bool bValid0 = isValid(_pHeaders[0]);
+    bool bValid1 = isValid(_pHeaders[1]);
+
+    if (bValid0 && bValid1)
+        _current = (int32_t)(_pHeaders[1].sequence - _pHeaders[0].sequence) > 0 ? 1 : 0;
+    else if (bValid0 || bValid1)
+        _current = bValid1 ? 1 : 0;
+    else
+    {
+        // start the sequence over - the other slot is written first
+        memset(_pHeaders, 0, 2 * sizeof(header_t));
+        _current = 1;
+        clear();
+        return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLRTCBuffer::append(uint8_t type, const uint8_t *pData, uint16_t length)
+{
+    if (!_pHeaders)
+        return false;
+
+    header_t theHeader = _pHeaders[_current];
+    if (recordSize(length) > _capacity - theHeader.used)
+        return false;
+
+    // the record goes past the end of the used area - it's not in the buffer until the header is written
+    uint8_t *pRecord = _pData + theHeader.used;
+    pRecord[0] = type;
+    memcpy(pRecord + 1, &length, sizeof(length));
+    memcpy(pRecord + 3, pData, length);
+
+    uint32_t crc = crc32(pRecord, 3 + length);
+    memcpy(pRecord + 3 + length, &crc, sizeof(crc));
+
+    theHeader.used += recordSize(length);
+    theHeader.count++;
+    commit(theHeader);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLRTCBuffer::read(size_t &offset, uint8_t &type, const uint8_t *&pData, uint16_t &length)
+{
+    if (!_pHeaders)
+        return false;
+
+    size_t used = _pHeaders[_current].used;
+    if (offset + kRecordOverhead > used)
+        return false;
+
+    const uint8_t *pRecord = _pData + offset;
+    uint16_t recLength;
+    memcpy(&recLength, pRecord + 1, sizeof(recLength));
+
+    if (offset + recordSize(recLength) > used)
+        return false;
+
+    uint32_t crc;
+    memcpy(&crc, pRecord + 3 + recLength, sizeof(crc));
+    if (crc != crc32(pRecord, 3 + recLength))
+        return false;
+
+    type = pRecord[0];
+    pData = pRecord + 3;
+    length = recLength;
+    offset += recordSize(recLength);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLRTCBuffer::clear(void)
+{
+    if (!_pHeaders)
+        return;
+
+    header_t theHeader = {};
+    commit(theHeader);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLRTCBuffer::countWake(void)
+{
+    if (!_pHeaders)
+        return;
+
+    header_t theHeader = _pHeaders[_current];
+    if (theHeader.wakes < UINT16_MAX)
+        theHeader.wakes++;
+    commit(theHeader);
+}
+
+//---------------------------------------------------------------------------
+uint16_t sfeDLRTCBuffer::wakes(void)
+{
+    return _pHeaders ? _pHeaders[_current].wakes : 0;
+}
+
+uint16_t sfeDLRTCBuffer::count(void)
+{
+    return _pHeaders ? _pHeaders[_current].count : 0;
+}
+
+size_t sfeDLRTCBuffer::used(void)
+{
+    return _pHeaders ? _pHeaders[_current].used : 0;
+}
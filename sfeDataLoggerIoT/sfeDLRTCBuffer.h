@@ -0,0 +1,96 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - record buffer for RTC memory
+ *
+ * Records kept in a block of memory that survives deep sleep. No Arduino or ESP32 dependencies - the memory
+ * block is given by the caller - so the buffer builds and runs on a host, against a plain array.
+ *
+ * The block starts with two header slots, followed by the records:
+ *
+ *      header:  <magic> <sequence> <capacity> <bytes used> <record count> <wake count> <crc32>
+ *      record:  <type:u8> <length:u16> <data> <crc32:u32>
+ *
+ * A header is valid if its magic, capacity and CRC are good - the valid header with the higher sequence is
+ * current. Each update writes the other slot, so the current header is never overwritten. A record is written
+ * past the end of the used area, then a header update adds it to the buffer - a brown out during a write loses
+ * that record, not the buffer. The record CRC is checked when it's read.
+ *
+ * Integers are in the byte order of the machine - the buffer is only read by the machine that wrote it.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class sfeDLRTCBuffer
+{
+  public:
+    sfeDLRTCBuffer();
+
+    // Use a memory block (4 byte aligned). Returns true if it holds a valid buffer - if not, it's cleared
+    bool attach(void *pMemory, size_t size);
+
+    // Add a record - returns false if there isn't room
+    bool append(uint8_t type, const uint8_t *pData, uint16_t length);
+
+    // Read the record at offset (start at 0), and move offset to the next record. Returns false at the end of the
+    // buffer, or for a damaged record - offset is less than used() for a damaged record
+    bool read(size_t &offset, uint8_t &type, const uint8_t *&pData, uint16_t &length);
+
+    // Remove all records - and reset the wake count
+    void clear(void);
+
+    // Wakes since the buffer was cleared
+    void countWake(void);
+    uint16_t wakes(void);
+
+    uint16_t count(void);
+    size_t used(void);
+    size_t capacity(void)
+    {
+        return _capacity;
+    }
+
+    // Space taken by a record of this length
+    static size_t recordSize(uint16_t length)
+    {
+        return kRecordOverhead + length;
+    }
+
+    // CRC32 - the same as zlib crc32()
+    static uint32_t crc32(const uint8_t *pData, size_t length, uint32_t crc = 0);
+
+  private:
+    typedef struct
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t capacity;
+        uint32_t used;
+        uint16_t count;
+        uint16_t wakes;
+        uint32_t crc;
+    } header_t;
+
+    static constexpr size_t kRecordOverhead = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t);
+
+    bool isValid(const header_t &theHeader);
+    uint32_t headerCRC(const header_t &theHeader);
+    void commit(header_t &theHeader);
+
+    header_t *_pHeaders;
+    uint8_t *_pData;
+    size_t _capacity;
+
+    // the current header slot
+    int _current;
+};
@@ -0,0 +1,518 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - WiFi on demand
+ *
+ */
+
+#include "sfeDLRadioManager.h"
+#include "sfeDLEvents.h"
+
+#include <Flux/flxCoreEvent.h>
+#include <Flux/flxCoreLog.h>
+#include <Flux/flxFlux.h>
+
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <string.h>
+#include <time.h>
+
+// How often (ms) the radio state is checked
+const uint32_t kRadioCheckPeriod = 1000;
+
+// The connect task - joins the network, the connection change handlers run on the main loop
+#define kRadioConnectStackSize 4096
+#define kRadioConnectTaskPriority 1
+
+// Clock times before this aren't set (2020-01-01)
+const time_t kRadioValidEpoch = 1577836800;
+
+// The link of the last connection - kept across deep sleep, for a fast reconnect
+RTC_DATA_ATTR static sfeDLWiFiLink_t _rtcWiFiLink;
+
+#define kRadioStateMagic 0x4D524C44 // "DLRM"
+
+// Window state kept across deep sleep
+typedef struct
+{
+    uint32_t magic;
+    uint32_t lastWindowTime; // clock time (secs) the last window closed - 0 if the clock wasn't set
+    uint32_t nQueued;        // observations held since the last window
+} sfeDLRadioState_t;
+
+RTC_DATA_ATTR static sfeDLRadioState_t _rtcRadio;
+
+//--------------------------------------------------------------------------------
+// The fast reconnect driver - the Arduino WiFi station. The credentials come from the WiFi settings
+
+class sfeDLWiFiDriverESP32 : public sfeDLWiFiDriver
+{
+  public:
+    sfeDLWiFiDriverESP32() : _theWiFi{nullptr}
+    {
+    }
+
+    void setWiFi(flxWiFiESP32 *theWiFi)
+    {
+        _theWiFi = theWiFi;
+    }
+
+    bool begin(const sfeDLWiFiLink_t &theLink, bool bStaticIP)
+    {
+        // the network of the settings - it may have changed since the link was cached
+        if (!_theWiFi || _theWiFi->SSID() != theLink.ssid)
+            return false;
+
+        WiFi.mode(WIFI_STA);
+
+        // a zero address is DHCP
+        if (bStaticIP)
+            WiFi.config(IPAddress(theLink.ip), IPAddress(theLink.gateway), IPAddress(theLink.subnet),
+                        IPAddress(theLink.dns));
+        else
+            WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+
+        WiFi.begin(theLink.ssid, _theWiFi->password().c_str(), theLink.channel, theLink.bssid, true);
+        return true;
+    }
+
+    bool isConnected(void)
+    {
+        return WiFi.status() == WL_CONNECTED;
+    }
+
+    bool getLink(sfeDLWiFiLink_t &theLink)
+    {
+        if (!isConnected())
+            return false;
+
+        // the network of the connection - as given to the station
+        wifi_config_t theConfig;
+        if (esp_wifi_get_config(WIFI_IF_STA, &theConfig) != ESP_OK)
+            return false;
+
+        memcpy(theLink.ssid, theConfig.sta.ssid, sizeof(theLink.ssid) - 1);
+
+        uint8_t *pBSSID = WiFi.BSSID();
+        if (!pBSSID)
+            return false;
+        memcpy(theLink.bssid, pBSSID, sizeof(theLink.bssid));
+
+        theLink.channel = WiFi.channel();
+        theLink.ip = WiFi.localIP();
+        theLink.gateway = WiFi.gatewayIP();
+        theLink.subnet = WiFi.subnetMask();
+        theLink.dns = WiFi.dnsIP();
+
+        return true;
+    }
+
+    void reset(void)
+    {
+        WiFi.disconnect(false);
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+
+    uint32_t ticks(void)
+    {
+        return millis();
+    }
+
+    uint32_t now(void)
+    {
+        time_t theTime = time(nullptr);
+        return theTime >= kRadioValidEpoch ? (uint32_t)theTime : 0;
+    }
+
+    void wait(uint32_t ms)
+    {
+        delay(ms);
+    }
+
+    void join(void)
+    {
+        if (!_theWiFi)
+            return;
+
+        WiFi.mode(WIFI_STA);
+        WiFi.begin(_theWiFi->SSID().c_str(), _theWiFi->password().c_str());
+    }
+
+  private:
+    flxWiFiESP32 *_theWiFi;
+};
+
+static sfeDLWiFiDriverESP32 _theWiFiDriver;
+
+//--------------------------------------------------------------------------------
+// connect task - standard C static method - for FreeRTOS. Makes one connection, then exits
+
+static void _sfeDLRadioManager_TaskConnect(void *parameter)
+{
+    sfeDLRadioManager *pManager = (sfeDLRadioManager *)parameter;
+
+    if (pManager != nullptr)
+        pManager->processConnect();
+
+    vTaskDelete(NULL);
+}
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLRadioManager::sfeDLRadioManager()
+    : _theWiFi{nullptr}, _msMinConnected{0}, _bOnDemand{false}, _isInitialized{false}, _bWindowRequested{false},
+      _bConnecting{false}, _state{kRadioOff}, _bLinkUp{false}, _windowStartTicks{0}, _connectedTicks{0},
+      _radioOnTicks{0}, _lastWindowTicks{0}, _nWindows{0}, _nTimeouts{0}, _nObservations{0}, _msOn{0},
+      _statsStartTicks{0}
+{
+    setName("WiFi On Demand", "Keep WiFi off and connect only to upload held data");
+
+    flxRegister(onDemand, "Connect On Demand",
+                "Keep WiFi off between upload windows. Requires Hold While Offline on the IoT services");
+    flxRegister(batchSize, "Batch Size", "Number of observations that opens an upload window");
+    flxRegister(uploadInterval, "Upload Interval (sec)", "Max time between upload windows");
+    flxRegister(windowTimeout, "Window Timeout (sec)", "Max time the WiFi is on for an upload window");
+    flxRegister(fastReconnect, "Fast Reconnect",
+                "Reconnect to the last access point and channel, without a scan. Falls back to a full scan");
+    flxRegister(leaseTime, "DHCP Lease (sec)",
+                "Time the last address is reused without DHCP on a fast reconnect. 0 always uses DHCP");
+
+    batchSize = kRadioBatchSize;
+    uploadInterval = kRadioUploadInterval;
+    windowTimeout = kRadioWindowTimeout;
+    fastReconnect = true;
+    leaseTime = kFastConnectLeaseSecs;
+
+    _fastConnect.setDriver(&_theWiFiDriver);
+    _fastConnect.attach(&_rtcWiFiLink);
+
+    flux.add(this);
+}
+
+//---------------------------------------------------------------------------
+// onDemand property - the mode change is made by the radio check job
+void sfeDLRadioManager::set_onDemand(bool bOnDemand)
+{
+    _bOnDemand = bOnDemand;
+}
+
+bool sfeDLRadioManager::get_onDemand(void)
+{
+    return _bOnDemand;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLRadioManager::initialize(bool bStartupWindow)
+{
+    if (_isInitialized || !_theWiFi)
+        return;
+
+    // the fast reconnect driver takes the credentials from the WiFi settings
+    _theWiFiDriver.setWiFi(_theWiFi);
+
+    // Alarms - observations triggered by an interrupt, button or command - open a window
+    flxRegisterEventCB(flxEvent::kOnLogObservationWithSource, this, &sfeDLRadioManager::onLogObservationEvent);
+
+    _jobCheckRadio.setup("radiomgr", kRadioCheckPeriod, this, &sfeDLRadioManager::checkRadio);
+    flxAddJobToQueue(_jobCheckRadio);
+
+    _statsStartTicks = millis();
+    _lastWindowTicks = millis();
+
+    // cold boot - no window state
+    if (_rtcRadio.magic != kRadioStateMagic)
+    {
+        memset(&_rtcRadio, 0, sizeof(_rtcRadio));
+        _rtcRadio.magic = kRadioStateMagic;
+    }
+
+    if (_bOnDemand)
+    {
+        // The first window sets the clock. After a wake, the window state carried across sleep decides.
+        if (bStartupWindow)
+            requestWindow();
+        checkRadio();
+    }
+    else
+    {
+        _radioOnTicks = millis();
+        _state = kRadioOn;
+        connect();
+    }
+
+    _isInitialized = true;
+}
+
+//---------------------------------------------------------------------------
+// connect()
+//
+// Connecting to the network can take seconds - it's done on a task, so startup and logging continue. The state
+// machine watches for the connection.
+
+void sfeDLRadioManager::connect(void)
+{
+    // already connecting?
+    if (_bConnecting)
+        return;
+
+    _bConnecting = true;
+
+    BaseType_t xReturnValue = xTaskCreate(_sfeDLRadioManager_TaskConnect, // Connect task function
+                                          "RadioConnect",                 // String with name of task.
+                                          kRadioConnectStackSize,         // Stack size
+                                          this,                           // Parameter passed to the task
+                                          kRadioConnectTaskPriority,      // Priority of the task.
+                                          NULL);                          // Task handle.
+    if (xReturnValue != pdPASS)
+    {
+        flxLog_W(F("%s: Unable to start the connect task"), name());
+        processConnect();
+    }
+}
+
+//---------------------------------------------------------------------------
+// processConnect()
+//
+// Join the network - the fast reconnect first, if enabled. The handlers of the connection change run on the
+// main loop, see updateLink()
+
+void sfeDLRadioManager::processConnect(void)
+{
+    if (_onConnect)
+        _onConnect(false);
+
+    _fastConnect.setLeaseSecs(leaseTime());
+    if (!fastReconnect())
+        _fastConnect.invalidate();
+
+    _fastConnect.connect();
+
+    if (_onConnect)
+        _onConnect(true);
+
+    _bConnecting = false;
+}
+
+//---------------------------------------------------------------------------
+// updateLink()
+//
+// Send the connection change - on the main loop - once the connect task is done, and when a connection drops
+
+void sfeDLRadioManager::updateLink(void)
+{
+    bool bLinkUp = !_bConnecting && _theWiFiDriver.isConnected();
+    if (bLinkUp == _bLinkUp)
+        return;
+
+    _bLinkUp = bLinkUp;
+    flxSendEvent(flxEvent::kOnConnectionChange, bLinkUp);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLRadioManager::write(JsonDocument &jDoc)
+{
+    _nObservations++;
+
+    if (_state != kRadioOn)
+        _rtcRadio.nQueued++;
+}
+
+//---------------------------------------------------------------------------
+uint32_t sfeDLRadioManager::nQueued(void)
+{
+    return _rtcRadio.nQueued;
+}
+
+//---------------------------------------------------------------------------
+// intervalDue()
+//
+// Has the upload interval passed since the last window? By the clock if it's set - it carries across deep
+// sleep, the ticks don't.
+
+bool sfeDLRadioManager::intervalDue(uint32_t ticks)
+{
+    uint32_t now = _theWiFiDriver.now();
+    if (now != 0 && _rtcRadio.lastWindowTime != 0 && now >= _rtcRadio.lastWindowTime)
+        return now - _rtcRadio.lastWindowTime >= uploadInterval();
+
+    return ticks - _lastWindowTicks >= uploadInterval() * 1000;
+}
+
+//---------------------------------------------------------------------------
+// PPS and external serial data trigger observations all the time - they wait for the next window
+void sfeDLRadioManager::onLogObservationEvent(const char *szSource)
+{
+    if (_bOnDemand && dlEventIsAlarm(szSource))
+        requestWindow();
+}
+
+//---------------------------------------------------------------------------
+void sfeDLRadioManager::onEditFinished(void)
+{
+    _fastConnect.invalidate();
+}
+
+//---------------------------------------------------------------------------
+// Radio state machine - run from a job
+//
+//      Off -> Connecting       a window is triggered - batch size, upload interval or an alarm
+//      Connecting -> Draining  connected
+//      Draining -> Off         held data is delivered, or the window timed out
+//
+// When on demand mode is off, the radio is On and stays on.
+
+void sfeDLRadioManager::checkRadio(void)
+{
+    updateLink();
+
+    uint32_t ticks = millis();
+    bool bTimeout = ticks - _windowStartTicks >= windowTimeout() * 1000;
+
+    // switched to always on?
+    if (!_bOnDemand && _state != kRadioOn)
+    {
+        if (_state == kRadioOff)
+        {
+            _radioOnTicks = ticks;
+            connect();
+        }
+        _state = kRadioOn;
+        return;
+    }
+
+    switch (_state)
+    {
+    case kRadioOn:
+        // switched to on demand - treat the current connection as a window, so it closes once drained
+        if (_bOnDemand)
+        {
+            _windowStartTicks = ticks;
+            _connectedTicks = ticks;
+            _state = kRadioDraining;
+        }
+        break;
+
+    case kRadioOff:
+        if (_bWindowRequested || _rtcRadio.nQueued >= batchSize() || intervalDue(ticks))
+            radioUp();
+        break;
+
+    case kRadioConnecting:
+        if (_bLinkUp)
+        {
+            _connectedTicks = ticks;
+            _state = kRadioDraining;
+            if (_onWindowStart)
+                _onWindowStart();
+        }
+        else if (bTimeout)
+            radioDown(true);
+        break;
+
+    case kRadioDraining:
+        if (bTimeout)
+            radioDown(true);
+        else if (!_bLinkUp)
+            _state = kRadioConnecting; // the connection dropped - wait for it to come back
+        else if (ticks - _connectedTicks >= _msMinConnected && (!_isDrained || _isDrained()))
+            radioDown(false);
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------
+void sfeDLRadioManager::radioUp(void)
+{
+    flxLog_V(F("%s: Opening upload window - %u observations held"), name(), _rtcRadio.nQueued);
+
+    _nWindows++;
+    _windowStartTicks = millis();
+    _radioOnTicks = _windowStartTicks;
+    _bWindowRequested = false;
+    _state = kRadioConnecting;
+
+    connect();
+}
+
+//---------------------------------------------------------------------------
+void sfeDLRadioManager::radioDown(bool bTimeout)
+{
+    _theWiFi->disconnect();
+    updateLink();
+
+    uint32_t ticks = millis();
+    _msOn += ticks - _radioOnTicks;
+
+    if (bTimeout)
+    {
+        _nTimeouts++;
+        flxLog_W(F("%s: Upload window timed out"), name());
+    }
+    else
+        flxLog_V(F("%s: Upload window closed after %u ms"), name(), ticks - _windowStartTicks);
+
+    // A timed out window still starts a new batch - the held data is sent with the next window
+    _lastWindowTicks = ticks;
+    _rtcRadio.lastWindowTime = _theWiFiDriver.now();
+    _rtcRadio.nQueued = 0;
+    _state = kRadioOff;
+}
+
+//---------------------------------------------------------------------------
+// Stats
+//---------------------------------------------------------------------------
+uint32_t sfeDLRadioManager::msRadioOn(void)
+{
+    return _msOn + (_state != kRadioOff ? millis() - _radioOnTicks : 0);
+}
+
+//---------------------------------------------------------------------------
+float sfeDLRadioManager::radioOnPerHour(void)
+{
+    uint32_t msRun = millis() - _statsStartTicks;
+
+    return msRun > 0 ? (float)msRadioOn() * 3600. / (float)msRun : 0.;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLRadioManager::resetStats(void)
+{
+    uint32_t ticks = millis();
+
+    _nWindows = 0;
+    _nTimeouts = 0;
+    _nObservations = 0;
+    _msOn = 0;
+    _statsStartTicks = ticks;
+    _fastConnect.resetStats();
+
+    // the time the radio has been on is counted from now
+    if (_state != kRadioOff)
+        _radioOnTicks = ticks;
+}
+
+//---------------------------------------------------------------------------
+const char *sfeDLRadioManager::stateName(void)
+{
+    switch (_state)
+    {
+    case kRadioOn:
+        return "On";
+    case kRadioOff:
+        return "Off";
+    case kRadioConnecting:
+        return "Connecting";
+    case kRadioDraining:
+        return "Uploading";
+    }
+    return "Unknown";
+}
@@ -0,0 +1,206 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - WiFi on demand
+ *
+ * For battery deployments. When enabled, the WiFi radio is kept off and observations are held by the IoT
+ * publish channels (Hold While Offline). The radio is brought up for an upload window when:
+ *
+ *      - the number of observations since the last window reaches the batch size
+ *      - the upload interval has passed since the last window
+ *      - an observation is triggered by an event (interrupt, button ...) - an alarm
+ *
+ * During the window the held payloads are sent and the NTP client updates the clock. Once everything is
+ * delivered - or the window times out - the radio is turned off again.
+ *
+ * The time of the last window (clock time) and the observations held since are kept across deep sleep, so a
+ * logger that sleeps between observations still opens its windows by batch size and upload interval.
+ *
+ * Connections - in either mode - are made on a task, so startup and logging don't wait on the network. The task
+ * only joins the network; the connection change event (NTP, IoT clients ...) is sent from the radio check job,
+ * on the main loop. The access point, channel and address of the last connection are kept across sleep, for a
+ * fast reconnect.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCore.h>
+#include <Flux/flxCoreInterface.h>
+#include <Flux/flxCoreJobs.h>
+#include <Flux/flxWiFiESP32.h>
+
+#include <ArduinoJson.h>
+
+#include "sfeDLFastConnect.h"
+
+#include <functional>
+
+// Defaults - observations per window, secs between windows and the max length of a window (secs)
+const uint32_t kRadioBatchSize = 30;
+const uint32_t kRadioUploadInterval = 900;
+const uint32_t kRadioWindowTimeout = 90;
+
+class sfeDLRadioManager : public flxActionType<sfeDLRadioManager>, public flxIWriterJSON
+{
+  private:
+    void set_onDemand(bool bOnDemand);
+    bool get_onDemand(void);
+
+  public:
+    sfeDLRadioManager();
+
+    void setWiFi(flxWiFiESP32 *theWiFi)
+    {
+        _theWiFi = theWiFi;
+    }
+
+    // Returns true when all held data is delivered and the window can close
+    void setDrainedCheck(std::function<bool(void)> isDrained)
+    {
+        _isDrained = isDrained;
+    }
+
+    // Called when a window is connected - push out batched data
+    void setWindowStart(std::function<void(void)> onStart)
+    {
+        _onWindowStart = onStart;
+    }
+
+    // Called from the connect task - before (false) and after (true) each attempt to join the network
+    void setConnectCallback(std::function<void(bool)> onConnect)
+    {
+        _onConnect = onConnect;
+    }
+
+    // Minimum time (ms) a window stays connected - gives the NTP client time to update the clock
+    void setMinConnected(uint32_t msMin)
+    {
+        _msMinConnected = msMin;
+    }
+
+    // Start the radio - on demand mode opens a window at startup, to set the clock, unless told otherwise. At a
+    // wake from sleep (no startup window), a window is opened if one is due.
+    void initialize(bool bStartupWindow = true);
+
+    // flxIWriterJSON - counts observations
+    void write(JsonDocument &jDoc);
+
+    // Make a connection - run by the connect task
+    void processConnect(void);
+
+    // open an upload window now
+    void requestWindow(void)
+    {
+        _bWindowRequested = true;
+    }
+
+    // Settings edits can change the WiFi network - the next connection is a full one. Called on the main loop
+    // when an edit session finishes.
+    void onEditFinished(void);
+
+    // Radio states
+    static constexpr uint8_t kRadioOn = 0x0;
+    static constexpr uint8_t kRadioOff = 0x1;
+    static constexpr uint8_t kRadioConnecting = 0x2;
+    static constexpr uint8_t kRadioDraining = 0x3;
+
+    uint8_t state(void)
+    {
+        return _state;
+    }
+    const char *stateName(void);
+
+    //---------------------------------------------------------------------------
+    // Stats
+    uint32_t nWindows(void)
+    {
+        return _nWindows;
+    }
+    uint32_t nTimeouts(void)
+    {
+        return _nTimeouts;
+    }
+    uint32_t nObservations(void)
+    {
+        return _nObservations;
+    }
+    // observations held since the last window
+    uint32_t nQueued(void);
+    // total radio on time (ms) - includes the current window
+    uint32_t msRadioOn(void);
+
+    // radio on time (secs) per hour of run time
+    float radioOnPerHour(void);
+
+    void resetStats(void);
+
+    // Fast reconnect stats
+    sfeDLFastConnect &fastConnect(void)
+    {
+        return _fastConnect;
+    }
+
+    // Properties
+    flxPropertyRWBool<sfeDLRadioManager, &sfeDLRadioManager::get_onDemand, &sfeDLRadioManager::set_onDemand>
+        onDemand;
+
+    flxPropertyUInt32<sfeDLRadioManager> batchSize = {1, 1000};
+
+    flxPropertyUInt32<sfeDLRadioManager> uploadInterval = {60, 86400};
+
+    flxPropertyUInt32<sfeDLRadioManager> windowTimeout = {10, 600};
+
+    flxPropertyBool<sfeDLRadioManager> fastReconnect;
+
+    flxPropertyUInt32<sfeDLRadioManager> leaseTime = {0, 86400};
+
+  private:
+    void checkRadio(void);
+    void connect(void);
+    void radioUp(void);
+    void radioDown(bool bTimeout);
+    bool intervalDue(uint32_t ticks);
+    void updateLink(void);
+    void onLogObservationEvent(const char *);
+
+    flxWiFiESP32 *_theWiFi;
+    std::function<bool(void)> _isDrained;
+    std::function<void(void)> _onWindowStart;
+    std::function<void(bool)> _onConnect;
+    uint32_t _msMinConnected;
+
+    bool _bOnDemand;
+    bool _isInitialized;
+    bool _bWindowRequested;
+    volatile bool _bConnecting;
+    uint8_t _state;
+
+    // the connection state last sent with kOnConnectionChange
+    bool _bLinkUp;
+
+    uint32_t _windowStartTicks;
+    uint32_t _connectedTicks;
+    uint32_t _radioOnTicks;
+    uint32_t _lastWindowTicks;
+
+    flxJob _jobCheckRadio;
+
+    sfeDLFastConnect _fastConnect;
+
+    // stats
+    uint32_t _nWindows;
+    uint32_t _nTimeouts;
+    uint32_t _nObservations;
+    uint32_t _msOn;
+    uint32_t _statsStartTicks;
+};
@@ -0,0 +1,218 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - file download over the serial console
+ *
+ */
+
+#include "sfeDLSerialDownload.h"
+#include "sfeDLFmtBinary.h"
+
+#include <Flux/flxCoreLog.h>
+
+#include <esp_rom_crc.h>
+
+#include <algorithm>
+
+// longest host command line
+const size_t kDownloadMaxCommand = 32;
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLSerialDownload::sfeDLSerialDownload() : _fileSize{0}, _sentTo{0}, _nBytes{0}, _nResent{0}
+{
+}
+
+//---------------------------------------------------------------------------
+// readCommand()
+//
+// Read a command line from the host - returns false if the host is quiet for the idle timeout
+
+bool sfeDLSerialDownload::readCommand(std::string &command)
+{
+    command.clear();
+
+    uint32_t lastTicks = millis();
+    while (millis() - lastTicks < kDownloadIdleTimeout)
+    {
+        if (!Serial.available())
+        {
+            delay(1);
+            continue;
+        }
+        lastTicks = millis();
+
+        char chIn = Serial.read();
+        if (chIn == '\n' || chIn == '\r')
+        {
+            if (command.length() > 0)
+                return true;
+        }
+        else if (command.length() < kDownloadMaxCommand)
+            command += chIn;
+    }
+    return false;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSerialDownload::sendFrame(void)
+{
+    sfeDLFmtBinary::encodeFrame(_frame, _encoded);
+    Serial.write(_encoded.data(), _encoded.size());
+}
+
+//---------------------------------------------------------------------------
+// sendWindow()
+//
+// Send the blocks of a window - or the end frame if the offset is at the end of the file
+
+void sfeDLSerialDownload::sendWindow(File &theFile, uint32_t offset)
+{
+    if (offset >= _fileSize)
+    {
+        _frame.clear();
+        _frame.push_back('E');
+        pack<uint32_t>(_fileSize);
+        sendFrame();
+        return;
+    }
+
+    // the host missed blocks?
+    if (offset < _sentTo)
+        _nResent += _sentTo - offset;
+
+    if (!theFile.seek(offset))
+        return; // the host times out and asks again
+
+    for (int i = 0; i < kDownloadWindow && offset < _fileSize; i++)
+    {
+        size_t length = std::min((size_t)kDownloadBlockSize, (size_t)(_fileSize - offset));
+        if (theFile.read(_block.data(), length) != length)
+            return;
+
+        _frame.clear();
+        _frame.push_back('B');
+        pack<uint32_t>(offset);
+        _frame.insert(_frame.end(), _block.begin(), _block.begin() + length);
+        sendFrame();
+
+        offset += length;
+        _nBytes += length;
+    }
+    _sentTo = std::max(_sentTo, offset);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSerialDownload::sendVerify(File &theFile, uint32_t length)
+{
+    length = std::min(length, _fileSize);
+
+    uint32_t crc = 0;
+    uint32_t offset = 0;
+
+    if (theFile.seek(0))
+    {
+        while (offset < length)
+        {
+            size_t blockLength = std::min((size_t)kDownloadBlockSize, (size_t)(length - offset));
+            if (theFile.read(_block.data(), blockLength) != blockLength)
+                break;
+
+            crc = esp_rom_crc32_le(crc, _block.data(), blockLength);
+            offset += blockLength;
+        }
+    }
+
+    _frame.clear();
+    _frame.push_back('V');
+    pack<uint32_t>(offset);
+    pack<uint32_t>(crc);
+    sendFrame();
+}
+
+//---------------------------------------------------------------------------
+// send()
+//
+// Send the header, then answer host requests until it ends the transfer
+
+bool sfeDLSerialDownload::send(flxIFileSystem *theFS, const char *szFile)
+{
+    if (!theFS || !theFS->enabled())
+    {
+        flxLog_E(F("Download: SD card not available"));
+        return false;
+    }
+    if (!szFile || strlen(szFile) == 0)
+    {
+        flxLog_E(F("Download: no file given - usage: !download <file>"));
+        return false;
+    }
+    std::string filename = szFile;
+    if (filename[0] != '/')
+        filename = "/" + filename;
+
+    File theFile = theFS->fileSystem().open(filename.c_str(), "r");
+    if (!theFile || theFile.isDirectory())
+    {
+        flxLog_E(F("Download: unable to open %s"), filename.c_str());
+        return false;
+    }
+
+    _block.resize(kDownloadBlockSize);
+    _fileSize = theFile.size();
+    _sentTo = 0;
+    _nBytes = 0;
+    _nResent = 0;
+
+    _frame.clear();
+    _frame.push_back('H');
+    pack<uint8_t>(kDownloadVersion);
+    pack<uint32_t>(_fileSize);
+    pack<uint16_t>(kDownloadBlockSize);
+    pack<uint8_t>(kDownloadWindow);
+    _frame.insert(_frame.end(), filename.begin(), filename.end());
+    sendFrame();
+
+    uint32_t startTicks = millis();
+    bool bDone = false;
+    std::string command;
+
+    while (!bDone && readCommand(command))
+    {
+        uint32_t value = strtoul(command.c_str() + 1, nullptr, 10);
+
+        switch (command[0])
+        {
+        case 'G':
+            sendWindow(theFile, value);
+            break;
+
+        case 'V':
+            sendVerify(theFile, value);
+            break;
+
+        case 'Q':
+            bDone = true;
+            break;
+        }
+    }
+    theFile.close();
+
+    if (!bDone)
+    {
+        flxLog_W(F("Download: %s - the host stopped responding"), filename.c_str());
+        return false;
+    }
+    flxLog_I(F("Download: %s - %u bytes sent in %.1f secs, %u resent"), filename.c_str(), _nBytes,
+             (millis() - startTicks) / 1000., _nResent);
+    return true;
+}
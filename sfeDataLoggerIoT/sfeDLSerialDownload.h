@@ -0,0 +1,92 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - file download over the serial console
+ *
+ * Started by the !download <file> command. Unlike most commands it isn't handed to the main loop - it stays on
+ * the console task, which runs while the main loop waits between passes, so logging continues during the
+ * transfer. Serial log output is paused while the console is busy. The host tool (tools/dl_serial_download.py)
+ * drives the transfer with text commands, one per line:
+ *
+ *      G <offset>  - send a window of blocks, starting at offset
+ *      V <length>  - send the CRC32 of the first length bytes of the file - to check a partial download
+ *      Q           - the transfer is done
+ *
+ * The device answers with frames - COBS encoded with a CRC32, between 0x00 delimiters, as the binary serial
+ * output (see sfeDLFmtBinary.h). Integers are little endian:
+ *
+ *      Header:  'H' <version:u8> <file size:u32> <block size:u16> <window:u8> <file name>
+ *      Block:   'B' <offset:u32> <data>
+ *      Verify:  'V' <length:u32> <crc32:u32>
+ *      End:     'E' <file size:u32> - sent for a window request at the end of the file
+ *
+ * A lost or damaged block is requested again in the next window - console text between frames is skipped by
+ * the host. A resumed download checks the partial file with a verify request, then continues from its end.
+ * The transfer ends if the host is quiet for the idle timeout.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxFS.h>
+
+#include <string>
+#include <vector>
+
+// Version of the download protocol - in the header frame
+const uint8_t kDownloadVersion = 1;
+
+// Block size (bytes), blocks sent per window request, and how long (ms) to wait on the host
+const uint16_t kDownloadBlockSize = 1024;
+const uint8_t kDownloadWindow = 16;
+const uint32_t kDownloadIdleTimeout = 15000;
+
+class sfeDLSerialDownload
+{
+  public:
+    sfeDLSerialDownload();
+
+    // Send a file - returns true when the host ends the transfer, false on error or timeout
+    bool send(flxIFileSystem *theFS, const char *szFile);
+
+    uint32_t nBytes(void)
+    {
+        return _nBytes;
+    }
+    uint32_t nResent(void)
+    {
+        return _nResent;
+    }
+
+  private:
+    bool readCommand(std::string &command);
+    void sendFrame(void);
+    void sendWindow(File &theFile, uint32_t offset);
+    void sendVerify(File &theFile, uint32_t length);
+
+    template <typename T> void pack(T value)
+    {
+        const uint8_t *pValue = (const uint8_t *)&value;
+        _frame.insert(_frame.end(), pValue, pValue + sizeof(T));
+    }
+
+    uint32_t _fileSize;
+
+    // the furthest offset sent - requests before it are resends
+    uint32_t _sentTo;
+
+    std::vector<uint8_t> _block;
+    std::vector<uint8_t> _frame;
+    std::vector<uint8_t> _encoded;
+
+    uint32_t _nBytes;
+    uint32_t _nResent;
+};
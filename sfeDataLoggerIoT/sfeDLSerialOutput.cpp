@@ -0,0 +1,288 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - buffered serial log output
+ *
+ */
+
+#include "sfeDLSerialOutput.h"
+
+#include <Flux/flxCoreLog.h>
+
+#include <algorithm>
+
+// The drain task - it only writes to the serial port, so a small stack
+#define kSerialOutStackSize 4096
+#define kSerialOutTaskPriority 1
+
+// Max time the drain task waits for a record (ms), and the poll period while blocked on a full buffer
+const uint32_t kSerialOutDrainWait = 100;
+const uint32_t kSerialOutBlockPoll = 2;
+
+// each record in the ring is preceded by its length
+const size_t kSerialOutRecordHeader = sizeof(uint16_t);
+
+//--------------------------------------------------------------------------------
+// drain task loop - standard C static method - for FreeRTOS
+
+static void _sfeDLSerialOutput_TaskDrain(void *parameter)
+{
+    sfeDLSerialOutput *pOutput = (sfeDLSerialOutput *)parameter;
+
+    if (pOutput == nullptr)
+        return;
+
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, kSerialOutDrainWait / portTICK_PERIOD_MS);
+        pOutput->drain();
+    }
+}
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLSerialOutput::sfeDLSerialOutput()
+    : _policy{kPolicyBlock}, _pBuffer{nullptr}, _head{0}, _tail{0}, _used{0}, _pRecord{nullptr}, _bSending{false},
+      _hMutex{NULL}, _hTaskDrain{NULL}, _nRecords{0}, _nDropped{0}, _nDroppedBytes{0}, _msBlocked{0}, _highWater{0}
+{
+    _hMutex = xSemaphoreCreateMutex();
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLSerialOutput::initialize(void)
+{
+    if (_hTaskDrain != NULL)
+        return true;
+
+    if (_hMutex == NULL)
+        return false;
+
+    _pBuffer = new uint8_t[kSerialOutBufferSize];
+    _pRecord = new uint8_t[kSerialOutMaxRecord];
+    if (!_pBuffer || !_pRecord)
+    {
+        flxLogM_E(kMsgErrAllocError, "Serial output buffer");
+        delete[] _pBuffer;
+        delete[] _pRecord;
+        _pBuffer = nullptr;
+        _pRecord = nullptr;
+        return false;
+    }
+
+    BaseType_t xReturnValue = xTaskCreate(_sfeDLSerialOutput_TaskDrain, // Drain task function
+                                          "SerialOutput",               // String with name of task.
+                                          kSerialOutStackSize,          // Stack size
+                                          this,                         // Parameter passed to the task
+                                          kSerialOutTaskPriority,       // Priority of the task.
+                                          &_hTaskDrain);                // Task handle.
+    if (xReturnValue != pdPASS)
+    {
+        _hTaskDrain = NULL;
+        flxLog_E(F("Unable to start the serial output task"));
+
+        // no buffering - records are written straight to the serial port
+        delete[] _pBuffer;
+        delete[] _pRecord;
+        _pBuffer = nullptr;
+        _pRecord = nullptr;
+        return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Ring buffer helpers - the mutex is held by the caller
+
+void sfeDLSerialOutput::ringWrite(const uint8_t *pData, size_t length)
+{
+    size_t first = std::min(length, (size_t)(kSerialOutBufferSize - _tail));
+    memcpy(_pBuffer + _tail, pData, first);
+    memcpy(_pBuffer, pData + first, length - first);
+
+    _tail = (_tail + length) % kSerialOutBufferSize;
+    _used += length;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSerialOutput::ringRead(uint8_t *pData, size_t length)
+{
+    size_t first = std::min(length, (size_t)(kSerialOutBufferSize - _head));
+    if (pData)
+    {
+        memcpy(pData, _pBuffer + _head, first);
+        memcpy(pData + first, _pBuffer, length - first);
+    }
+    _head = (_head + length) % kSerialOutBufferSize;
+    _used -= length;
+}
+
+//---------------------------------------------------------------------------
+// Drop the oldest queued record
+
+void sfeDLSerialOutput::dropOldest(void)
+{
+    uint16_t length;
+    ringRead((uint8_t *)&length, kSerialOutRecordHeader);
+    ringRead(nullptr, length);
+
+    _nDropped++;
+    _nDroppedBytes += length;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSerialOutput::write(const char *szLine, bool newLine, flxLineType_t type)
+{
+    if (szLine)
+        queue((const uint8_t *)szLine, strlen(szLine), newLine);
+}
+
+//---------------------------------------------------------------------------
+// queue()
+//
+// Queue a record - and wake the drain task. Records that don't fit are handled by the full policy.
+
+void sfeDLSerialOutput::queue(const uint8_t *pData, size_t length, bool newLine)
+{
+    // not buffered?
+    if (!_pBuffer)
+    {
+        Serial.write(pData, length);
+        if (newLine)
+            Serial.write("\r\n");
+        return;
+    }
+
+    // too large to queue?
+    uint16_t recordLength = std::min(length + (newLine ? 2 : 0), (size_t)kSerialOutMaxRecord + 1);
+    if (recordLength > kSerialOutMaxRecord)
+    {
+        _nDropped++;
+        _nDroppedBytes += length;
+        return;
+    }
+    size_t needed = recordLength + kSerialOutRecordHeader;
+
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+
+    if (_used + needed > kSerialOutBufferSize)
+    {
+        if (_policy == kPolicyDropRecord)
+        {
+            _nDropped++;
+            _nDroppedBytes += recordLength;
+            xSemaphoreGive(_hMutex);
+            return;
+        }
+        else if (_policy == kPolicyDropOldest)
+        {
+            while (_used > 0 && _used + needed > kSerialOutBufferSize)
+                dropOldest();
+        }
+        else
+        {
+            // block - wait for the drain task to make room
+            uint32_t startTicks = millis();
+            while (_used + needed > kSerialOutBufferSize)
+            {
+                xSemaphoreGive(_hMutex);
+                xTaskNotifyGive(_hTaskDrain);
+                vTaskDelay(kSerialOutBlockPoll / portTICK_PERIOD_MS);
+                xSemaphoreTake(_hMutex, portMAX_DELAY);
+            }
+            _msBlocked += millis() - startTicks;
+        }
+    }
+
+    ringWrite((const uint8_t *)&recordLength, kSerialOutRecordHeader);
+    ringWrite(pData, length);
+    if (newLine)
+        ringWrite((const uint8_t *)"\r\n", 2);
+
+    _nRecords++;
+    if (_used > _highWater)
+        _highWater = _used;
+
+    xSemaphoreGive(_hMutex);
+
+    xTaskNotifyGive(_hTaskDrain);
+}
+
+//---------------------------------------------------------------------------
+// Send the oldest record - returns false if the buffer is empty
+
+bool sfeDLSerialOutput::drainRecord(void)
+{
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+
+    if (_used == 0)
+    {
+        xSemaphoreGive(_hMutex);
+        return false;
+    }
+    uint16_t length;
+    ringRead((uint8_t *)&length, kSerialOutRecordHeader);
+    ringRead(_pRecord, length);
+    _bSending = true;
+
+    xSemaphoreGive(_hMutex);
+
+    // The serial driver buffers and sends from its interrupt - this waits only when its buffer is full
+    Serial.write(_pRecord, length);
+    _bSending = false;
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSerialOutput::drain(void)
+{
+    while (drainRecord())
+        ;
+}
+
+//---------------------------------------------------------------------------
+// flush()
+//
+// The records are left to the drain task - so they go out in order - this waits for it to finish
+
+bool sfeDLSerialOutput::flush(uint32_t msTimeout)
+{
+    bool bSent = true;
+
+    if (_pBuffer)
+    {
+        uint32_t startTicks = millis();
+        while (_used > 0 || _bSending)
+        {
+            if (millis() - startTicks >= msTimeout)
+            {
+                bSent = false;
+                break;
+            }
+            xTaskNotifyGive(_hTaskDrain);
+            vTaskDelay(kSerialOutBlockPoll / portTICK_PERIOD_MS);
+        }
+    }
+    Serial.flush();
+
+    return bSent;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSerialOutput::resetStats(void)
+{
+    _nRecords = 0;
+    _nDropped = 0;
+    _nDroppedBytes = 0;
+    _msBlocked = 0;
+    _highWater = _used;
+}
@@ -0,0 +1,145 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - buffered serial log output
+ *
+ * Log records written to the serial console are queued in a ring buffer and sent by a drain task, so a log
+ * cycle doesn't wait on the terminal baud rate. At 115200 baud a 1.5K JSON record takes about 130 ms to send.
+ *
+ * When the buffer is full, the full policy decides what happens to a new record:
+ *
+ *      Block       - wait for space (the time spent waiting is counted)
+ *      Drop Record - drop the new record
+ *      Drop Oldest - drop queued records, oldest first, to make room
+ *
+ * Records are queued whole, so a dropped record never leaves a partial line on the console.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCoreInterface.h>
+
+// Ring buffer size, and the largest record queued - over the max JSON buffer size (bytes)
+const uint32_t kSerialOutBufferSize = 8192;
+const uint32_t kSerialOutMaxRecord = 5120;
+
+// Max time (ms) a flush waits for the queued records to be sent - a full buffer at 9600 baud
+const uint32_t kSerialOutFlushTimeout = 10000;
+
+class sfeDLSerialOutput : public flxWriter
+{
+  public:
+    sfeDLSerialOutput();
+
+    // Allocate the buffer and start the drain task. Until then - or if this fails - records are written
+    // straight to the serial port
+    bool initialize(void);
+
+    // flxWriter - queue a record
+    void write(const char *szLine, bool newLine, flxLineType_t type);
+
+    // queue a binary record
+    void writeBytes(const uint8_t *pData, size_t length)
+    {
+        queue(pData, length, false);
+    }
+
+    // Full policies
+    static constexpr uint8_t kPolicyBlock = 0x0;
+    static constexpr uint8_t kPolicyDropRecord = 0x1;
+    static constexpr uint8_t kPolicyDropOldest = 0x2;
+
+    uint8_t policy(void)
+    {
+        return _policy;
+    }
+    void setPolicy(uint8_t policy)
+    {
+        _policy = policy;
+    }
+    const char *policyName(void)
+    {
+        return _policy == kPolicyDropRecord ? "Drop Record" : (_policy == kPolicyDropOldest ? "Drop Oldest" : "Block");
+    }
+
+    //---------------------------------------------------------------------------
+    // Stats
+    uint32_t nRecords(void)
+    {
+        return _nRecords;
+    }
+    uint32_t nDropped(void)
+    {
+        return _nDropped;
+    }
+    uint32_t nDroppedBytes(void)
+    {
+        return _nDroppedBytes;
+    }
+    uint32_t msBlocked(void)
+    {
+        return _msBlocked;
+    }
+    uint32_t highWater(void)
+    {
+        return _highWater;
+    }
+    uint32_t used(void)
+    {
+        return _used;
+    }
+    uint32_t size(void)
+    {
+        return _pBuffer ? kSerialOutBufferSize : 0;
+    }
+
+    void resetStats(void);
+
+    // Send the queued records - called by the drain task
+    void drain(void);
+
+    // Wait for the drain task to send the queued records, and for the serial port to send them - before sleep.
+    // Returns false if the records weren't sent within msTimeout
+    bool flush(uint32_t msTimeout = kSerialOutFlushTimeout);
+
+  private:
+    void queue(const uint8_t *pData, size_t length, bool newLine);
+    void ringWrite(const uint8_t *pData, size_t length);
+    void ringRead(uint8_t *pData, size_t length);
+    void dropOldest(void);
+    bool drainRecord(void);
+
+    uint8_t _policy;
+
+    // the ring buffer - records are stored as a 16 bit length, then the record
+    uint8_t *_pBuffer;
+    size_t _head;
+    size_t _tail;
+    size_t _used;
+
+    // a record is copied out of the ring and sent from here - the ring isn't locked while sending
+    uint8_t *_pRecord;
+
+    // the drain task has a record out of the ring, not yet written to the serial port
+    volatile bool _bSending;
+
+    SemaphoreHandle_t _hMutex;
+    TaskHandle_t _hTaskDrain;
+
+    // stats
+    uint32_t _nRecords;
+    uint32_t _nDropped;
+    uint32_t _nDroppedBytes;
+    uint32_t _msBlocked;
+    uint32_t _highWater;
+};
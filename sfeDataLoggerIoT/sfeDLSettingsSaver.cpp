@@ -0,0 +1,140 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - deferred settings save
+ *
+ */
+
+#include "sfeDLSettingsSaver.h"
+
+#include <Flux/flxCoreLog.h>
+#include <Flux/flxFlux.h>
+#include <Flux/flxSettings.h>
+
+// How often (ms) a pending save is checked
+const uint32_t kSettingsSaveCheckPeriod = 500;
+
+// Quiet time (ms) before a save - after an edit, and after a new file
+const uint32_t kSettingsSaveEditDelay = 1000;
+const uint32_t kSettingsSaveFileDelay = 5000;
+
+// A pending save is made at most this long (ms) after the first request
+const uint32_t kSettingsSaveMaxDelay = 30000;
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLSettingsSaver::sfeDLSettingsSaver()
+    : _bPending{false}, _bFallback{false}, _firstRequestTicks{0}, _dueTicks{0}, _nRequests{0}, _nSaves{0}, _nFailed{0},
+      _nFallbackSaves{0}, _msSaveTotal{0}, _msSaveMax{0}, _msLastSave{0}, _hMutex{NULL}
+{
+    _hMutex = xSemaphoreCreateMutex();
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSettingsSaver::initialize(void)
+{
+    _jobSave.setup("settingssave", kSettingsSaveCheckPeriod, this, &sfeDLSettingsSaver::checkSave);
+    flxAddJobToQueue(_jobSave);
+}
+
+//---------------------------------------------------------------------------
+// requestSave()
+//
+// Each request moves the save out to its delay - up to the max delay after the first request
+
+void sfeDLSettingsSaver::requestSave(bool bFallback, uint32_t msDelay)
+{
+    uint32_t ticks = millis();
+
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+
+    _nRequests++;
+
+    if (!_bPending)
+    {
+        _bPending = true;
+        _bFallback = false;
+        _firstRequestTicks = ticks;
+        _dueTicks = ticks + msDelay;
+    }
+    else if ((int32_t)(ticks + msDelay - _dueTicks) > 0)
+        _dueTicks = ticks + msDelay;
+
+    if ((int32_t)(_dueTicks - (_firstRequestTicks + kSettingsSaveMaxDelay)) > 0)
+        _dueTicks = _firstRequestTicks + kSettingsSaveMaxDelay;
+
+    _bFallback = _bFallback || bFallback;
+
+    xSemaphoreGive(_hMutex);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSettingsSaver::onEditFinished(void)
+{
+    requestSave(true, kSettingsSaveEditDelay);
+}
+
+void sfeDLSettingsSaver::onNewFile(void)
+{
+    requestSave(false, kSettingsSaveFileDelay);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSettingsSaver::checkSave(void)
+{
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+    if (_bPending && (int32_t)(millis() - _dueTicks) >= 0)
+        save();
+    xSemaphoreGive(_hMutex);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSettingsSaver::flush(void)
+{
+    xSemaphoreTake(_hMutex, portMAX_DELAY);
+    if (_bPending)
+        save();
+    xSemaphoreGive(_hMutex);
+}
+
+//---------------------------------------------------------------------------
+// save()
+//
+// Save the settings - to the primary storage only, unless a request asked for the fallback. Called with the mutex
+// held
+
+void sfeDLSettingsSaver::save(void)
+{
+    bool bFallback = _bFallback;
+    _bPending = false;
+    _bFallback = false;
+
+    uint32_t ticks = millis();
+    bool status = flxSettings.save(&flux, !bFallback);
+    uint32_t msSave = millis() - ticks;
+
+    if (!status)
+    {
+        _nFailed++;
+        flxLog_E(F("Error saving settings"));
+        return;
+    }
+
+    _nSaves++;
+    if (bFallback)
+        _nFallbackSaves++;
+
+    _msLastSave = msSave;
+    _msSaveTotal += msSave;
+    if (msSave > _msSaveMax)
+        _msSaveMax = msSave;
+}
@@ -0,0 +1,106 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - deferred settings save
+ *
+ * Settings saves requested by events - an edit session finishing, or a new log file - are made from a job, not
+ * in the event. Requests are coalesced: a save is made once no request has come in for a short time, but never
+ * later than a max delay after the first request.
+ *
+ * A new log file only changes the file number, so it saves to the primary (NVS) settings storage only - the SD
+ * card JSON fallback isn't rewritten while the logger is busy with a new file. Edits save to both. The primary
+ * storage only writes NVS if a value changed.
+ *
+ * A pending save is flushed before the device sleeps or restarts - flush() can be called from the console task.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCoreJobs.h>
+
+class sfeDLSettingsSaver
+{
+  public:
+    sfeDLSettingsSaver();
+
+    // Start the save job
+    void initialize(void);
+
+    // Save after msDelay without a new request - bFallback also saves to the fallback storage
+    void requestSave(bool bFallback, uint32_t msDelay);
+
+    // Event handlers
+    void onEditFinished(void);
+    void onNewFile(void);
+
+    // Make a pending save now - before sleep or a restart
+    void flush(void);
+
+    bool pending(void)
+    {
+        return _bPending;
+    }
+
+    //---------------------------------------------------------------------------
+    // Stats
+    uint32_t nRequests(void)
+    {
+        return _nRequests;
+    }
+    uint32_t nSaves(void)
+    {
+        return _nSaves;
+    }
+    uint32_t nFailed(void)
+    {
+        return _nFailed;
+    }
+    // saves that also wrote the fallback storage
+    uint32_t nFallbackSaves(void)
+    {
+        return _nFallbackSaves;
+    }
+    uint32_t msSaveAvg(void)
+    {
+        return _nSaves > 0 ? _msSaveTotal / _nSaves : 0;
+    }
+    uint32_t msSaveMax(void)
+    {
+        return _msSaveMax;
+    }
+    uint32_t msLastSave(void)
+    {
+        return _msLastSave;
+    }
+
+  private:
+    void checkSave(void);
+    void save(void);
+
+    flxJob _jobSave;
+
+    // a save from the console task (a restart) and the save job
+    SemaphoreHandle_t _hMutex;
+
+    bool _bPending;
+    bool _bFallback;
+    uint32_t _firstRequestTicks;
+    uint32_t _dueTicks;
+
+    uint32_t _nRequests;
+    uint32_t _nSaves;
+    uint32_t _nFailed;
+    uint32_t _nFallbackSaves;
+    uint32_t _msSaveTotal;
+    uint32_t _msSaveMax;
+    uint32_t _msLastSave;
+};
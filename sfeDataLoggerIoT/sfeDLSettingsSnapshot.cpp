@@ -0,0 +1,544 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - settings snapshot storage
+ *
+ */
+
+#include "sfeDLSettingsSnapshot.h"
+#include "sfeDLRTCBuffer.h"
+
+#include <Flux/flxCoreLog.h>
+
+#include <Preferences.h>
+
+#include <algorithm>
+#include <string.h>
+
+// NVS namespace and key of the snapshot blob
+static const char *kSnapshotPrefsName = "dlsettings";
+static const char *kSnapshotPrefsKey = "snapshot";
+
+#define kSnapshotMagic 0x53534C44 // "DLSS"
+
+// The blob layout version - a blob of another version isn't used
+const uint16_t kSnapshotVersion = 1;
+
+// Value types
+const uint8_t kSnapshotBool = 'b';
+const uint8_t kSnapshotInt8 = 'c';
+const uint8_t kSnapshotInt16 = 's';
+const uint8_t kSnapshotInt32 = 'i';
+const uint8_t kSnapshotUInt8 = 'C';
+const uint8_t kSnapshotUInt16 = 'S';
+const uint8_t kSnapshotUInt32 = 'I';
+const uint8_t kSnapshotFloat = 'f';
+const uint8_t kSnapshotDouble = 'd';
+const uint8_t kSnapshotString = 'z';
+const uint8_t kSnapshotBytes = 'y';
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t length;
+    uint32_t crc;
+} sfeDLSnapshotHeader_t;
+
+//---------------------------------------------------------------------------
+// sfeDLSnapshotBlock
+//---------------------------------------------------------------------------
+
+void sfeDLSnapshotBlock::open(sfeDLSettingsSnapshot *pStore, const char *name)
+{
+    _pStore = pStore;
+    _name = name;
+    _pLegacy = nullptr;
+    _bLegacyChecked = false;
+}
+
+void sfeDLSnapshotBlock::close(void)
+{
+    if (_pLegacy && _pStore->_pLegacy)
+        _pStore->_pLegacy->endBlock(_pLegacy);
+
+    _pLegacy = nullptr;
+    _bLegacyChecked = false;
+}
+
+//---------------------------------------------------------------------------
+flxStorageBlock *sfeDLSnapshotBlock::legacy(void)
+{
+    if (!_bLegacyChecked && _pStore->_pLegacy)
+    {
+        _pLegacy = _pStore->_pLegacy->getBlock(_name.c_str());
+        _bLegacyChecked = true;
+    }
+    return _pLegacy;
+}
+
+//---------------------------------------------------------------------------
+// writeValue()
+//
+// Set a value - the store is marked dirty only if it changed
+
+bool sfeDLSnapshotBlock::writeValue(const char *tag, uint8_t type, const void *pData, size_t length)
+{
+    if (!_pStore || _pStore->_bReadOnly || !tag || length > UINT16_MAX)
+        return false;
+
+    std::string theValue(1, (char)type);
+    theValue.append((const char *)pData, length);
+
+    _pStore->_nLastSaved++;
+
+    std::string &current = _pStore->_values[key(tag)];
+    if (current != theValue)
+    {
+        current = theValue;
+        _pStore->_nLastChanged++;
+        _pStore->_bDirty = true;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+const std::string *sfeDLSnapshotBlock::findValue(const char *tag, uint8_t type)
+{
+    if (!_pStore || !tag)
+        return nullptr;
+
+    auto it = _pStore->_values.find(key(tag));
+    if (it == _pStore->_values.end() || it->second.length() == 0 || (uint8_t)it->second[0] != type)
+        return nullptr;
+
+    return &it->second;
+}
+
+//---------------------------------------------------------------------------
+// readValue()
+//
+// From the snapshot - or the per key storage if it's not there
+
+template <typename T> bool sfeDLSnapshotBlock::readValue(const char *tag, uint8_t type, T &value, T defaultValue)
+{
+    const std::string *pValue = findValue(tag, type);
+    if (pValue && pValue->length() == sizeof(T) + 1)
+    {
+        memcpy(&value, pValue->data() + 1, sizeof(T));
+        return true;
+    }
+
+    flxStorageBlock *pLegacy = legacy();
+    if (pLegacy && pLegacy->read(tag, value))
+    {
+        _pStore->_nLegacyReads++;
+        return true;
+    }
+
+    value = defaultValue;
+    return false;
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLSnapshotBlock::writeBool(const char *tag, bool data)
+{
+    return writeValue(tag, kSnapshotBool, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeInt8(const char *tag, int8_t data)
+{
+    return writeValue(tag, kSnapshotInt8, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeInt16(const char *tag, int16_t data)
+{
+    return writeValue(tag, kSnapshotInt16, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeInt32(const char *tag, int32_t data)
+{
+    return writeValue(tag, kSnapshotInt32, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeUInt8(const char *tag, uint8_t data)
+{
+    return writeValue(tag, kSnapshotUInt8, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeUInt16(const char *tag, uint16_t data)
+{
+    return writeValue(tag, kSnapshotUInt16, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeUInt32(const char *tag, uint32_t data)
+{
+    return writeValue(tag, kSnapshotUInt32, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeFloat(const char *tag, float data)
+{
+    return writeValue(tag, kSnapshotFloat, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeDouble(const char *tag, double data)
+{
+    return writeValue(tag, kSnapshotDouble, &data, sizeof(data));
+}
+bool sfeDLSnapshotBlock::writeString(const char *tag, const char *data)
+{
+    if (!data)
+        data = "";
+    return writeValue(tag, kSnapshotString, data, strlen(data));
+}
+bool sfeDLSnapshotBlock::writeBytes(const char *tag, size_t sz, const uint8_t *data)
+{
+    return writeValue(tag, kSnapshotBytes, data, data ? sz : 0);
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLSnapshotBlock::readBool(const char *tag, bool &value, bool defaultValue)
+{
+    return readValue(tag, kSnapshotBool, value, defaultValue);
+}
+bool sfeDLSnapshotBlock::readInt8(const char *tag, int8_t &value, int8_t defaultValue)
+{
+    return readValue(tag, kSnapshotInt8, value, defaultValue);
+}
+bool sfeDLSnapshotBlock::readInt16(const char *tag, int16_t &value, int16_t defaultValue)
+{
+    return readValue(tag, kSnapshotInt16, value, defaultValue);
+}
+bool sfeDLSnapshotBlock::readInt32(const char *tag, int32_t &value, int32_t defaultValue)
+{
+    return readValue(tag, kSnapshotInt32, value, defaultValue);
+}
+bool sfeDLSnapshotBlock::readUInt8(const char *tag, uint8_t &value, uint8_t defaultValue)
+{
+    return readValue(tag, kSnapshotUInt8, value, defaultValue);
+}
+bool sfeDLSnapshotBlock::readUInt16(const char *tag, uint16_t &value, uint16_t defaultValue)
+{
+    return readValue(tag, kSnapshotUInt16, value, defaultValue);
+}
+bool sfeDLSnapshotBlock::readUInt32(const char *tag, uint32_t &value, uint32_t defaultValue)
+{
+    return readValue(tag, kSnapshotUInt32, value, defaultValue);
+}
+bool sfeDLSnapshotBlock::readFloat(const char *tag, float &value, float defaultValue)
+{
+    return readValue(tag, kSnapshotFloat, value, defaultValue);
+}
+bool sfeDLSnapshotBlock::readDouble(const char *tag, double &value, double defaultValue)
+{
+    return readValue(tag, kSnapshotDouble, value, defaultValue);
+}
+
+//---------------------------------------------------------------------------
+// Strings and bytes - lengths don't include a null terminator
+
+size_t sfeDLSnapshotBlock::getStringLength(const char *tag)
+{
+    const std::string *pValue = findValue(tag, kSnapshotString);
+    if (pValue)
+        return pValue->length() - 1;
+
+    flxStorageBlock *pLegacy = legacy();
+    return pLegacy ? pLegacy->getStringLength(tag) : 0;
+}
+
+size_t sfeDLSnapshotBlock::readString(const char *tag, char *data, size_t len)
+{
+    if (!data || len == 0)
+        return 0;
+
+    const std::string *pValue = findValue(tag, kSnapshotString);
+    if (!pValue)
+    {
+        flxStorageBlock *pLegacy = legacy();
+        if (!pLegacy)
+            return 0;
+
+        _pStore->_nLegacyReads++;
+        return pLegacy->readString(tag, data, len);
+    }
+
+    size_t length = std::min(pValue->length() - 1, len - 1);
+    memcpy(data, pValue->data() + 1, length);
+    data[length] = '\0';
+
+    return length;
+}
+
+size_t sfeDLSnapshotBlock::getBytesLength(const char *tag)
+{
+    const std::string *pValue = findValue(tag, kSnapshotBytes);
+    if (pValue)
+        return pValue->length() - 1;
+
+    flxStorageBlock *pLegacy = legacy();
+    return pLegacy ? pLegacy->getBytesLength(tag) : 0;
+}
+
+size_t sfeDLSnapshotBlock::readBytes(const char *tag, size_t sz, uint8_t *data)
+{
+    if (!data)
+        return 0;
+
+    const std::string *pValue = findValue(tag, kSnapshotBytes);
+    if (!pValue)
+    {
+        flxStorageBlock *pLegacy = legacy();
+        if (!pLegacy)
+            return 0;
+
+        _pStore->_nLegacyReads++;
+        return pLegacy->readBytes(tag, sz, data);
+    }
+
+    size_t length = std::min(pValue->length() - 1, sz);
+    memcpy(data, pValue->data() + 1, length);
+
+    return length;
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLSnapshotBlock::valueExists(const char *tag)
+{
+    if (_pStore && tag && _pStore->_values.count(key(tag)) > 0)
+        return true;
+
+    flxStorageBlock *pLegacy = legacy();
+    return pLegacy && pLegacy->valueExists(tag);
+}
+
+//---------------------------------------------------------------------------
+// sfeDLSettingsSnapshot
+//---------------------------------------------------------------------------
+
+sfeDLSettingsSnapshot::sfeDLSettingsSnapshot()
+    : _pLegacy{nullptr}, _bLoaded{false}, _bRestored{false}, _bReadOnly{true}, _bDirty{false}, _usRestore{0}, _size{0},
+      _nLegacyReads{0}, _nSaves{0}, _nWrites{0}, _nLastSaved{0}, _nLastChanged{0}, _saveStartTicks{0}, _msLastSave{0}
+{
+}
+
+//---------------------------------------------------------------------------
+// load()
+//
+// Read the blob - once. A bad or missing blob leaves the snapshot empty, and values come from the per key storage
+
+void sfeDLSettingsSnapshot::load(void)
+{
+    if (_bLoaded)
+        return;
+
+    _bLoaded = true;
+
+    uint32_t ticks = micros();
+
+    Preferences prefs;
+    if (!prefs.begin(kSnapshotPrefsName, true))
+        return;
+
+    size_t length = prefs.getBytesLength(kSnapshotPrefsKey);
+    if (length < sizeof(sfeDLSnapshotHeader_t))
+    {
+        prefs.end();
+        return;
+    }
+
+    std::string theBlob(length, '\0');
+    prefs.getBytes(kSnapshotPrefsKey, &theBlob[0], length);
+    prefs.end();
+
+    sfeDLSnapshotHeader_t theHeader;
+    memcpy(&theHeader, theBlob.data(), sizeof(theHeader));
+
+    const uint8_t *pData = (const uint8_t *)theBlob.data() + sizeof(theHeader);
+
+    if (theHeader.magic != kSnapshotMagic || theHeader.version != kSnapshotVersion ||
+        theHeader.length != length - sizeof(theHeader) ||
+        theHeader.crc != sfeDLRTCBuffer::crc32(pData, theHeader.length))
+    {
+        flxLog_W(F("Settings snapshot not valid - using per setting storage"));
+        return;
+    }
+
+    // the values - <key length:u8> <key> <type:u8> <length:u16> <data>
+    const uint8_t *pEnd = pData + theHeader.length;
+    for (uint16_t i = 0; i < theHeader.count; i++)
+    {
+        if (pEnd - pData < 1 || pEnd - pData < 1 + pData[0] + 3)
+            break;
+
+        std::string theKey((const char *)pData + 1, pData[0]);
+        pData += 1 + pData[0];
+
+        uint8_t type = pData[0];
+        uint16_t valueLength;
+        memcpy(&valueLength, pData + 1, sizeof(valueLength));
+        pData += 3;
+
+        if (pEnd - pData < valueLength)
+            break;
+
+        std::string &theValue = _values[theKey];
+        theValue.assign(1, (char)type);
+        theValue.append((const char *)pData, valueLength);
+        pData += valueLength;
+    }
+
+    _size = length;
+    _bRestored = true;
+    _usRestore = micros() - ticks;
+}
+
+//---------------------------------------------------------------------------
+// save()
+//
+// Write the blob - one NVS write
+
+bool sfeDLSettingsSnapshot::save(void)
+{
+    std::string theBlob(sizeof(sfeDLSnapshotHeader_t), '\0');
+
+    for (auto &entry : _values)
+    {
+        if (entry.first.length() > UINT8_MAX || entry.second.length() == 0)
+            continue;
+
+        uint16_t valueLength = entry.second.length() - 1;
+
+        theBlob += (char)entry.first.length();
+        theBlob += entry.first;
+        theBlob += entry.second[0];
+        theBlob.append((const char *)&valueLength, sizeof(valueLength));
+        theBlob.append(entry.second, 1, std::string::npos);
+    }
+
+    sfeDLSnapshotHeader_t theHeader;
+    theHeader.magic = kSnapshotMagic;
+    theHeader.version = kSnapshotVersion;
+    theHeader.count = _values.size();
+    theHeader.length = theBlob.length() - sizeof(theHeader);
+    theHeader.crc = sfeDLRTCBuffer::crc32((const uint8_t *)theBlob.data() + sizeof(theHeader), theHeader.length);
+    memcpy(&theBlob[0], &theHeader, sizeof(theHeader));
+
+    Preferences prefs;
+    if (!prefs.begin(kSnapshotPrefsName, false))
+        return false;
+
+    bool status = prefs.putBytes(kSnapshotPrefsKey, theBlob.data(), theBlob.length()) == theBlob.length();
+    prefs.end();
+
+    if (status)
+    {
+        _size = theBlob.length();
+        _nWrites++;
+    }
+    return status;
+}
+
+//---------------------------------------------------------------------------
+// begin()
+//
+// Start a restore (read only) or a save
+
+bool sfeDLSettingsSnapshot::begin(bool readonly)
+{
+    load();
+
+    _bReadOnly = readonly;
+
+    if (!readonly)
+    {
+        _bDirty = false;
+        _nLastSaved = 0;
+        _nLastChanged = 0;
+        _saveStartTicks = millis();
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// end()
+//
+// At the end of a save, write the blob if a value changed
+
+void sfeDLSettingsSnapshot::end(void)
+{
+    if (_bReadOnly)
+        return;
+
+    _nSaves++;
+
+    if (_bDirty && !save())
+        flxLog_E(F("Error writing the settings snapshot"));
+
+    _bDirty = false;
+    _bReadOnly = true;
+    _msLastSave = millis() - _saveStartTicks;
+}
+
+//---------------------------------------------------------------------------
+// Blocks - there's one block in use at a time
+
+flxStorageBlock *sfeDLSettingsSnapshot::beginBlock(const char *tag)
+{
+    if (!tag || _bReadOnly)
+        return nullptr;
+
+    _theBlock.open(this, tag);
+    return &_theBlock;
+}
+
+flxStorageBlock *sfeDLSettingsSnapshot::getBlock(const char *tag)
+{
+    if (!tag)
+        return nullptr;
+
+    load();
+
+    _theBlock.open(this, tag);
+
+    // any values for this block - in the snapshot, or the per key storage?
+    std::string prefix = _theBlock.key("");
+    auto it = _values.lower_bound(prefix);
+    if (it != _values.end() && it->first.compare(0, prefix.length(), prefix) == 0)
+        return &_theBlock;
+
+    if (_theBlock.legacy())
+        return &_theBlock;
+
+    _theBlock.close();
+    return nullptr;
+}
+
+void sfeDLSettingsSnapshot::endBlock(flxStorageBlock *pBlock)
+{
+    if (pBlock == &_theBlock)
+        _theBlock.close();
+}
+
+//---------------------------------------------------------------------------
+// resetStorage()
+//
+// Erase the snapshot and the per key storage
+
+void sfeDLSettingsSnapshot::resetStorage(void)
+{
+    _values.clear();
+    _size = 0;
+    _bDirty = false;
+
+    Preferences prefs;
+    if (prefs.begin(kSnapshotPrefsName, false))
+    {
+        prefs.clear();
+        prefs.end();
+    }
+
+    if (_pLegacy)
+        _pLegacy->resetStorage();
+}
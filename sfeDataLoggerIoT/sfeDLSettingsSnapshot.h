@@ -0,0 +1,199 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - settings snapshot storage
+ *
+ * A settings storage for the framework that keeps all settings in one NVS blob, not an NVS key per property.
+ * The blob is read once - at the first use, which is the startup properties read before serial starts - and
+ * settings are restored from memory. A save writes the blob once, and only if a value changed.
+ *
+ *      blob:   <magic> <version> <value count> <data length> <crc32> <values>
+ *      value:  <key length:u8> <block/tag key> <type:u8> <length:u16> <data>
+ *
+ * A blob with a bad CRC, or of another version, isn't used. A value not in the blob is read from the per key
+ * (flxPreferences) storage - so settings saved by earlier firmware are restored, and are moved into the blob at
+ * the next save.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxStorage.h>
+
+#include <map>
+#include <string>
+
+class sfeDLSettingsSnapshot;
+
+//---------------------------------------------------------------------------
+// A block of the snapshot - the values of one object
+
+class sfeDLSnapshotBlock : public flxStorageBlock
+{
+  public:
+    sfeDLSnapshotBlock() : _pStore{nullptr}, _pLegacy{nullptr}, _bLegacyChecked{false}
+    {
+    }
+
+    bool writeBool(const char *tag, bool data);
+    bool writeInt8(const char *tag, int8_t data);
+    bool writeInt16(const char *tag, int16_t data);
+    bool writeInt32(const char *tag, int32_t data);
+    bool writeUInt8(const char *tag, uint8_t data);
+    bool writeUInt16(const char *tag, uint16_t data);
+    bool writeUInt32(const char *tag, uint32_t data);
+    bool writeFloat(const char *tag, float data);
+    bool writeDouble(const char *tag, double data);
+    bool writeString(const char *tag, const char *data);
+    bool writeBytes(const char *tag, size_t sz, const uint8_t *data);
+
+    bool readBool(const char *tag, bool &value, bool defaultValue = false);
+    bool readInt8(const char *tag, int8_t &value, int8_t defaultValue = 0);
+    bool readInt16(const char *tag, int16_t &value, int16_t defaultValue = 0);
+    bool readInt32(const char *tag, int32_t &value, int32_t defaultValue = 0);
+    bool readUInt8(const char *tag, uint8_t &value, uint8_t defaultValue = 0);
+    bool readUInt16(const char *tag, uint16_t &value, uint16_t defaultValue = 0);
+    bool readUInt32(const char *tag, uint32_t &value, uint32_t defaultValue = 0);
+    bool readFloat(const char *tag, float &value, float defaultValue = 0.0);
+    bool readDouble(const char *tag, double &value, double defaultValue = 0.0);
+    size_t readString(const char *tag, char *data, size_t len);
+    size_t getStringLength(const char *tag);
+    size_t readBytes(const char *tag, size_t sz, uint8_t *data);
+    size_t getBytesLength(const char *tag);
+
+    bool valueExists(const char *tag);
+
+  private:
+    friend sfeDLSettingsSnapshot;
+
+    void open(sfeDLSettingsSnapshot *pStore, const char *name);
+    void close(void);
+
+    std::string key(const char *tag)
+    {
+        return _name + "/" + tag;
+    }
+    bool writeValue(const char *tag, uint8_t type, const void *pData, size_t length);
+    const std::string *findValue(const char *tag, uint8_t type);
+
+    template <typename T> bool readValue(const char *tag, uint8_t type, T &value, T defaultValue);
+
+    // the per key storage block of the object, for values not in the snapshot
+    flxStorageBlock *legacy(void);
+
+    sfeDLSettingsSnapshot *_pStore;
+    std::string _name;
+
+    flxStorageBlock *_pLegacy;
+    bool _bLegacyChecked;
+};
+
+//---------------------------------------------------------------------------
+class sfeDLSettingsSnapshot : public flxStorage
+{
+  public:
+    sfeDLSettingsSnapshot();
+
+    // The per key storage - read for values not in the snapshot, and cleared with it
+    void setLegacy(flxStorage *pLegacy)
+    {
+        _pLegacy = pLegacy;
+    }
+
+    // flxStorage
+    flxStorageKind_t kind(void)
+    {
+        return flxStorageKindInternal;
+    }
+    bool begin(bool readonly = false);
+    void end(void);
+
+    flxStorageBlock *beginBlock(const char *tag);
+    flxStorageBlock *getBlock(const char *tag);
+    void endBlock(flxStorageBlock *);
+
+    void resetStorage(void);
+
+    //---------------------------------------------------------------------------
+    // Stats
+    // the snapshot was valid at startup
+    bool restored(void)
+    {
+        return _bRestored;
+    }
+    // time (us) to read the snapshot
+    uint32_t usRestore(void)
+    {
+        return _usRestore;
+    }
+    uint32_t nValues(void)
+    {
+        return _values.size();
+    }
+    // size of the blob (bytes)
+    uint32_t size(void)
+    {
+        return _size;
+    }
+    uint32_t nLegacyReads(void)
+    {
+        return _nLegacyReads;
+    }
+    uint32_t nSaves(void)
+    {
+        return _nSaves;
+    }
+    // NVS writes - the blob is written once per save, if a value changed
+    uint32_t nWrites(void)
+    {
+        return _nWrites;
+    }
+    // the last save - values saved, values changed and time (ms)
+    uint32_t nLastSaved(void)
+    {
+        return _nLastSaved;
+    }
+    uint32_t nLastChanged(void)
+    {
+        return _nLastChanged;
+    }
+    uint32_t msLastSave(void)
+    {
+        return _msLastSave;
+    }
+
+  private:
+    friend sfeDLSnapshotBlock;
+
+    void load(void);
+    bool save(void);
+
+    // the values - by "<block>/<tag>", a type byte then the data
+    std::map<std::string, std::string> _values;
+
+    flxStorage *_pLegacy;
+    sfeDLSnapshotBlock _theBlock;
+
+    bool _bLoaded;
+    bool _bRestored;
+    bool _bReadOnly;
+    bool _bDirty;
+
+    uint32_t _usRestore;
+    uint32_t _size;
+    uint32_t _nLegacyReads;
+    uint32_t _nSaves;
+    uint32_t _nWrites;
+    uint32_t _nLastSaved;
+    uint32_t _nLastChanged;
+    uint32_t _saveStartTicks;
+    uint32_t _msLastSave;
+};
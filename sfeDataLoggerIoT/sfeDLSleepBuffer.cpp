@@ -0,0 +1,260 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - observation buffering across deep sleep
+ *
+ */
+
+#include "sfeDLSleepBuffer.h"
+
+#include <Flux/flxCoreLog.h>
+
+#include <esp_attr.h>
+#include <esp_sleep.h>
+
+// Record types - a log line: <line type:u8> <new line:u8> <text, null terminated>, or an observation as
+// MessagePack
+const uint8_t kSleepRecordLine = 'L';
+const uint8_t kSleepRecordJSON = 'J';
+
+// Document size for an observation read back from MessagePack - strings are copied into the document
+const size_t kSleepBufferDocSize = 4096;
+
+// How often (ms) held IoT observations are checked for delivery
+const uint32_t kSleepBufferHeldCheckPeriod = 2000;
+
+// Not initialized at boot - so the buffer survives a reset or brown out, as well as deep sleep. The buffer
+// headers tell if the contents are good.
+RTC_NOINIT_ATTR static uint32_t _rtcSleepBuffer[kSleepBufferSize / sizeof(uint32_t)];
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLSleepBuffer::sfeDLSleepBuffer()
+    : _pFile{nullptr}, _pIoT{nullptr}, _isInitialized{false}, _bActive{false}, _flushWakes{0}, _nRecovered{0},
+      _nFlushes{0}, _nFlushed{0}, _nFull{0}, _nDamaged{0}, _nHeld{0}
+{
+}
+
+//---------------------------------------------------------------------------
+// initialize()
+//
+// A wake from sleep keeps buffering - unless it's time to flush. Any other start writes out what's buffered.
+
+void sfeDLSleepBuffer::initialize(void)
+{
+    if (_isInitialized)
+        return;
+
+    bool bWake = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+
+    if (_theBuffer.attach(_rtcSleepBuffer, sizeof(_rtcSleepBuffer)))
+        _nRecovered = _theBuffer.count();
+    else if (bWake)
+        flxLog_W(F("Sleep buffer: RTC memory not valid - buffered observations lost"));
+
+    _isInitialized = true;
+
+    if (!bWake || !buffering() || _theBuffer.wakes() >= _flushWakes ||
+        _theBuffer.used() * 100 >= _theBuffer.capacity() * kSleepBufferFlushFill)
+        flush();
+
+    if (buffering())
+        _theBuffer.countWake();
+
+    _jobCheckHeld.setup("sleepbuffer", kSleepBufferHeldCheckPeriod, this, &sfeDLSleepBuffer::checkHeld);
+    flxAddJobToQueue(_jobCheckHeld);
+}
+
+//---------------------------------------------------------------------------
+// checkHeld()
+//
+// Job - the network is up, write out the IoT observations a flush held back
+
+void sfeDLSleepBuffer::checkHeld(void)
+{
+    if (_nHeld > 0 && iotEnabled() && iotOnline())
+        flush();
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSleepBuffer::setActive(bool bActive)
+{
+    _bActive = bActive;
+
+    if (!buffering() && _isInitialized && _theBuffer.count() > 0)
+        flush();
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSleepBuffer::setFlushWakes(uint32_t nWakes)
+{
+    _flushWakes = nWakes;
+
+    if (!buffering() && _isInitialized && _theBuffer.count() > 0)
+        flush();
+}
+
+//---------------------------------------------------------------------------
+// replay()
+//
+// Send a record to its output
+
+static void replay(uint8_t type, const uint8_t *pData, uint16_t length, flxWriter *pFile, flxIWriterJSON *pIoT,
+                   JsonDocument &jDoc)
+{
+    if (type == kSleepRecordLine && length > 2)
+    {
+        if (pFile)
+            pFile->write((const char *)pData + 2, pData[1] != 0, (flxLineType_t)pData[0]);
+    }
+    else if (type == kSleepRecordJSON)
+    {
+        jDoc.clear();
+        if (pIoT && deserializeMsgPack(jDoc, pData, length) == DeserializationError::Ok)
+            pIoT->write(jDoc);
+    }
+}
+
+//---------------------------------------------------------------------------
+// append()
+//
+// Buffer a record - if the buffer is full, flush it first. If held IoT observations still fill it, they go to
+// the publisher. A record too large for the buffer is written out
+
+void sfeDLSleepBuffer::append(uint8_t type, const uint8_t *pData, size_t length)
+{
+    if (length <= UINT16_MAX && _theBuffer.append(type, pData, length))
+        return;
+
+    _nFull++;
+    flush();
+
+    if (length <= UINT16_MAX && _theBuffer.append(type, pData, length))
+        return;
+
+    if (_nHeld > 0)
+    {
+        flush(true);
+        if (length <= UINT16_MAX && _theBuffer.append(type, pData, length))
+            return;
+    }
+
+    DynamicJsonDocument jDoc(kSleepBufferDocSize);
+    replay(type, pData, length, _pFile, _pIoT, jDoc);
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSleepBuffer::write(const char *szLine, bool newLine, flxLineType_t type)
+{
+    if (!buffering())
+    {
+        if (_isInitialized && _theBuffer.count() > _nHeld)
+            flush();
+        if (_pFile)
+            _pFile->write(szLine, newLine, type);
+        return;
+    }
+
+    size_t length = strlen(szLine);
+
+    _record.resize(length + 3);
+    _record[0] = (uint8_t)type;
+    _record[1] = newLine ? 1 : 0;
+    memcpy(_record.data() + 2, szLine, length + 1);
+
+    append(kSleepRecordLine, _record.data(), _record.size());
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSleepBuffer::write(JsonDocument &jDoc)
+{
+    if (!buffering())
+    {
+        if (_isInitialized && _theBuffer.count() > _nHeld)
+            flush();
+        if (_pIoT)
+            _pIoT->write(jDoc);
+        return;
+    }
+
+    // no IoT service to deliver to - don't spend RTC memory on it
+    if (!iotEnabled())
+        return;
+
+    _record.resize(measureMsgPack(jDoc));
+    serializeMsgPack(jDoc, _record.data(), _record.size());
+
+    append(kSleepRecordJSON, _record.data(), _record.size());
+}
+
+//---------------------------------------------------------------------------
+// flush()
+//
+// Write the records, in order, to the outputs. While the publisher is offline, IoT observations are kept - they're
+// put back in the cleared buffer. Reading stops at a damaged record - the rest are lost
+
+void sfeDLSleepBuffer::flush(bool bForce)
+{
+    uint16_t nRecords = _theBuffer.count();
+    uint16_t nWritten = 0;
+    uint16_t nHeld = 0;
+
+    // held records - <type:u8> <length:u16> <data>. Copied out, as the buffer is rewritten from the start
+    std::vector<uint8_t> held;
+
+    if (nRecords > 0)
+    {
+        bool bHoldIoT = !bForce && iotEnabled() && !iotOnline();
+
+        DynamicJsonDocument jDoc(kSleepBufferDocSize);
+
+        size_t offset = 0;
+        uint8_t type;
+        const uint8_t *pData;
+        uint16_t length;
+
+        while (_theBuffer.read(offset, type, pData, length))
+        {
+            if (bHoldIoT && type == kSleepRecordJSON)
+            {
+                held.push_back(type);
+                held.push_back(length & 0xFF);
+                held.push_back(length >> 8);
+                held.insert(held.end(), pData, pData + length);
+                nHeld++;
+                continue;
+            }
+            replay(type, pData, length, _pFile, _pIoT, jDoc);
+            nWritten++;
+        }
+        if (nWritten + nHeld < nRecords)
+        {
+            _nDamaged += nRecords - nWritten - nHeld;
+            flxLog_W(F("Sleep buffer: %u damaged records skipped"), nRecords - nWritten - nHeld);
+        }
+        flxLog_V(F("Sleep buffer: wrote %u records from %u wakes, %u held for IoT"), nWritten, _theBuffer.wakes(),
+                 nHeld);
+
+        _nFlushes++;
+        _nFlushed += nWritten;
+    }
+    _theBuffer.clear();
+
+    // they came out of the buffer, so they fit back in
+    for (size_t i = 0; i + 3 <= held.size();)
+    {
+        uint16_t length = held[i + 1] | (held[i + 2] << 8);
+        _theBuffer.append(held[i], held.data() + i + 3, length);
+        i += 3 + length;
+    }
+    _nHeld = nHeld;
+}
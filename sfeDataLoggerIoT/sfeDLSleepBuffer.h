@@ -0,0 +1,178 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - observation buffering across deep sleep
+ *
+ * Sits between the log formatters and the SD card file and IoT publisher. With sleep enabled and buffering set,
+ * SD card log lines and IoT observations (as MessagePack) are kept in RTC memory (see sfeDLRTCBuffer.h)
+ * instead of being written on every wake. The buffer is written out - in order, to the file and publisher -
+ * when:
+ *
+ *      - a wake starts, and the buffer holds the given number of wakes, or is nearly full
+ *      - the buffer is full
+ *      - a start that isn't a wake from sleep (reset, power on) finds records in the buffer
+ *      - buffering is turned off
+ *
+ * Otherwise, output passes straight through. IoT observations are only buffered while an IoT service is enabled,
+ * and a flush keeps them in RTC memory until the publisher can deliver them - they're written out once the
+ * network is up. Only a buffer full of them sends them to an offline publisher.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCoreInterface.h>
+#include <Flux/flxCoreJobs.h>
+
+#include <ArduinoJson.h>
+
+#include "sfeDLRTCBuffer.h"
+
+#include <functional>
+#include <vector>
+
+// RTC memory used for the buffer (bytes)
+const size_t kSleepBufferSize = 4096;
+
+// A wake starts with a flush if the buffer is this full (percent)
+const uint32_t kSleepBufferFlushFill = 75;
+
+class sfeDLSleepBuffer : public flxWriter, public flxIWriterJSON
+{
+  public:
+    sfeDLSleepBuffer();
+
+    // Where the buffered output goes - the log file and the IoT publisher
+    void setOutputs(flxWriter *pFile, flxIWriterJSON *pIoT)
+    {
+        _pFile = pFile;
+        _pIoT = pIoT;
+    }
+
+    // Is IoT output wanted - any service enabled - and can it be delivered now
+    void setIoTState(std::function<bool(void)> isEnabled, std::function<bool(void)> isOnline)
+    {
+        _isIoTEnabled = isEnabled;
+        _isIoTOnline = isOnline;
+    }
+
+    // Attach the RTC buffer and count the wake - flushes if due. Call at startup, once the outputs are ready
+    void initialize(void);
+
+    // Buffer output when sleep is enabled, flushing every N wakes - 0 or 1 turns buffering off
+    void setActive(bool bActive);
+    void setFlushWakes(uint32_t nWakes);
+
+    uint32_t flushWakes(void)
+    {
+        return _flushWakes;
+    }
+    bool buffering(void)
+    {
+        return _isInitialized && _bActive && _flushWakes > 1;
+    }
+
+    // flxWriter - SD card log lines
+    void write(const char *szLine, bool newLine, flxLineType_t type);
+
+    // flxIWriterJSON - IoT observations
+    void write(JsonDocument &jDoc);
+
+    // Write the buffered records to the outputs, and clear the buffer. IoT observations stay in the buffer
+    // while the publisher is offline - unless bForce is set
+    void flush(bool bForce = false);
+
+    //---------------------------------------------------------------------------
+    // Stats
+    uint16_t count(void)
+    {
+        return _theBuffer.count();
+    }
+    size_t used(void)
+    {
+        return _theBuffer.used();
+    }
+    size_t capacity(void)
+    {
+        return _theBuffer.capacity();
+    }
+    uint16_t wakes(void)
+    {
+        return _theBuffer.wakes();
+    }
+    // records found in RTC memory at startup
+    uint32_t nRecovered(void)
+    {
+        return _nRecovered;
+    }
+    uint32_t nFlushes(void)
+    {
+        return _nFlushes;
+    }
+    uint32_t nFlushed(void)
+    {
+        return _nFlushed;
+    }
+    // flushes because the buffer was full
+    uint32_t nFull(void)
+    {
+        return _nFull;
+    }
+    // records lost to a damaged buffer, or too large to buffer
+    uint32_t nDamaged(void)
+    {
+        return _nDamaged;
+    }
+    // IoT observations kept in the buffer by the last flush - waiting for the network
+    uint32_t nHeld(void)
+    {
+        return _nHeld;
+    }
+
+  private:
+    void append(uint8_t type, const uint8_t *pData, size_t length);
+
+    bool iotEnabled(void)
+    {
+        return _pIoT && (!_isIoTEnabled || _isIoTEnabled());
+    }
+    bool iotOnline(void)
+    {
+        return !_isIoTOnline || _isIoTOnline();
+    }
+
+    // Job - write out held IoT observations once the publisher is online
+    void checkHeld(void);
+
+    sfeDLRTCBuffer _theBuffer;
+
+    flxWriter *_pFile;
+    flxIWriterJSON *_pIoT;
+
+    std::function<bool(void)> _isIoTEnabled;
+    std::function<bool(void)> _isIoTOnline;
+
+    flxJob _jobCheckHeld;
+
+    bool _isInitialized;
+    bool _bActive;
+    uint32_t _flushWakes;
+
+    // a record being built
+    std::vector<uint8_t> _record;
+
+    uint32_t _nRecovered;
+    uint32_t _nFlushes;
+    uint32_t _nFlushed;
+    uint32_t _nFull;
+    uint32_t _nDamaged;
+    uint32_t _nHeld;
+};
@@ -0,0 +1,497 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - Log file sync
+ *
+ */
+
+#include "sfeDLSyncEngine.h"
+
+#include <Flux/flxCoreLog.h>
+#include <Flux/flxFlux.h>
+
+#include <Preferences.h>
+#include <esp_random.h>
+#include <esp_rom_crc.h>
+
+#include <algorithm>
+
+// NVS namespace for the sync state
+static const char *kSyncPrefsName = "dlsync";
+
+// File on the SD card with the card ID
+static const char *kSyncCardIdFile = "/dlsync.id";
+
+// Wait times (ms) - when there's nothing to do, the system is busy, or after a failure (max backoff)
+const uint32_t kSyncIdleWait = 5000;
+const uint32_t kSyncScanWait = 60000;
+const uint32_t kSyncBusyWait = 1000;
+const uint32_t kSyncMaxBackoff = 120000;
+
+// the sync state is saved every N chunks - and at the end of each file
+const uint32_t kSyncSaveChunks = 8;
+
+// time to wait for a server response (ms)
+const uint16_t kSyncResponseTimeout = 15000;
+
+// HTTP status codes of the sync protocol
+const int kSyncStatusOffset = 409;
+const int kSyncStatusCRC = 422;
+
+// The sync task - a TLS connection needs a large stack
+#define kSyncStackSize 10240
+#define kSyncTaskPriority 1
+
+//--------------------------------------------------------------------------------
+// sync task loop - standard C static method - for FreeRTOS
+
+static void _sfeDLSyncEngine_TaskProcessing(void *parameter)
+{
+    sfeDLSyncEngine *pSync = (sfeDLSyncEngine *)parameter;
+
+    if (pSync == nullptr)
+        return;
+
+    // let startup finish
+    vTaskDelay(kSyncIdleWait / portTICK_PERIOD_MS);
+
+    while (true)
+        pSync->processSync();
+}
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLSyncEngine::sfeDLSyncEngine()
+    : _theNetwork{nullptr}, _fileSystem{nullptr}, _fileRotate{nullptr}, _cardId{0}, _bCardChecked{false},
+      _syncedNumber{0}, _hFileMutex{NULL}, _currentNumber{0}, _offset{0}, _fileSize{0}, _nUnsaved{0}, _nFailures{0},
+      _pBuffer{nullptr}, _bufferSize{0}, _bResetPending{false}, _hTaskSync{NULL}, _nFilesSynced{0}, _nChunks{0},
+      _nRetries{0}, _nBytes{0}
+{
+    setName("Log File Sync", "Upload closed log files to an HTTP server");
+
+    flxRegister(enabled, "Enabled", "Enable or Disable log file uploads");
+    flxRegister(URL, "URL", "URL to upload log files to");
+    flxRegister(caCertFilename, "CA Cert Filename", "File to load the CA certificate from");
+    flxRegister(chunkSize, "Chunk Size", "Number of bytes sent in each upload request");
+    flxRegister(chunkInterval, "Chunk Interval (ms)", "Pause between upload requests");
+
+    enabled = false;
+    chunkSize = kSyncChunkSize;
+    chunkInterval = kSyncChunkInterval;
+
+    _hFileMutex = xSemaphoreCreateMutex();
+
+    flux.add(this);
+}
+
+//---------------------------------------------------------------------------
+bool sfeDLSyncEngine::initialize(void)
+{
+    if (_hTaskSync != NULL)
+        return true;
+
+    loadState();
+
+    BaseType_t xReturnValue = xTaskCreate(_sfeDLSyncEngine_TaskProcessing, // Sync task function
+                                          "LogFileSync",                   // String with name of task.
+                                          kSyncStackSize,                  // Stack size
+                                          this,                            // Parameter passed to the task
+                                          kSyncTaskPriority,               // Priority of the task.
+                                          &_hTaskSync);                    // Task handle.
+    if (xReturnValue != pdPASS)
+    {
+        _hTaskSync = NULL;
+        flxLog_E(F("%s: Unable to start the sync task"), name());
+        return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// State methods
+//---------------------------------------------------------------------------
+void sfeDLSyncEngine::loadState(void)
+{
+    Preferences prefs;
+    if (!prefs.begin(kSyncPrefsName, true))
+        return;
+
+    _cardId = prefs.getUInt("card", 0);
+    _syncedNumber = prefs.getUInt("synced", 0);
+    setCurrentFile(prefs.getString("file", "").c_str());
+    _offset = prefs.getUInt("offset", 0);
+
+    prefs.end();
+
+    // the file is found again, and the offset checked, on the first scan
+    if (_currentFile.length() == 0)
+        _offset = 0;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSyncEngine::saveState(void)
+{
+    Preferences prefs;
+    if (!prefs.begin(kSyncPrefsName, false))
+        return;
+
+    prefs.putUInt("card", _cardId);
+    prefs.putUInt("synced", _syncedNumber);
+    prefs.putString("file", _currentFile.c_str());
+    prefs.putUInt("offset", _offset);
+
+    prefs.end();
+    _nUnsaved = 0;
+}
+
+//---------------------------------------------------------------------------
+// The reset is done by the sync task - between chunks
+
+void sfeDLSyncEngine::resetSync(void)
+{
+    _bResetPending = true;
+}
+
+//---------------------------------------------------------------------------
+// The current file name is read by the status command, on another task - so it's only changed, and copied,
+// under the mutex
+
+void sfeDLSyncEngine::setCurrentFile(const std::string &theFile)
+{
+    xSemaphoreTake(_hFileMutex, portMAX_DELAY);
+    _currentFile = theFile;
+    xSemaphoreGive(_hFileMutex);
+}
+
+//---------------------------------------------------------------------------
+std::string sfeDLSyncEngine::currentFile(void)
+{
+    xSemaphoreTake(_hFileMutex, portMAX_DELAY);
+    std::string theFile = _currentFile;
+    xSemaphoreGive(_hFileMutex);
+
+    return theFile;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSyncEngine::clearState(void)
+{
+    _bResetPending = false;
+    _syncedNumber = 0;
+    setCurrentFile("");
+    _offset = 0;
+    _fileSize = 0;
+    saveState();
+}
+
+//---------------------------------------------------------------------------
+// checkCard()
+//
+// Make sure the sync state is for the card in the logger - a card without an ID is given one. A sync state
+// saved before card IDs were kept (ID 0) is taken as being for this card. Returns false on error.
+
+bool sfeDLSyncEngine::checkCard(void)
+{
+    FS theFS = _fileSystem->fileSystem();
+
+    uint32_t cardId = 0;
+
+    File theFile = theFS.open(kSyncCardIdFile, "r");
+    if (theFile)
+    {
+        cardId = strtoul(theFile.readString().c_str(), nullptr, 16);
+        theFile.close();
+    }
+    if (cardId == 0)
+    {
+        while (cardId == 0)
+            cardId = esp_random();
+
+        char szId[12];
+        snprintf(szId, sizeof(szId), "%08x\n", cardId);
+
+        theFile = theFS.open(kSyncCardIdFile, "w");
+        if (!theFile || theFile.write((const uint8_t *)szId, strlen(szId)) != strlen(szId))
+        {
+            if (theFile)
+                theFile.close();
+            flxLog_E(F("%s: Unable to write the card ID to %s"), name(), kSyncCardIdFile);
+            return false;
+        }
+        theFile.close();
+    }
+
+    if (cardId != _cardId)
+    {
+        if (_cardId != 0)
+        {
+            flxLog_I(F("%s: A different SD card was inserted - syncing it from the first log file"), name());
+            _syncedNumber = 0;
+            setCurrentFile("");
+            _offset = 0;
+            _fileSize = 0;
+        }
+        _cardId = cardId;
+        saveState();
+    }
+    _bCardChecked = true;
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// File methods
+//---------------------------------------------------------------------------
+// fileNumber()
+//
+// Log files are named <prefix><number><suffix>. Returns false if the name isn't a log file
+
+bool sfeDLSyncEngine::fileNumber(const char *szName, uint32_t &number)
+{
+    if (!szName)
+        return false;
+
+    // skip any path
+    const char *szBase = strrchr(szName, '/');
+    szBase = szBase ? szBase + 1 : szName;
+
+    std::string sPrefix = _fileRotate->filePrefix();
+    if (sPrefix.length() == 0 || strncmp(szBase, sPrefix.c_str(), sPrefix.length()) != 0)
+        return false;
+
+    char *szEnd;
+    number = strtoul(szBase + sPrefix.length(), &szEnd, 10);
+
+    return szEnd != szBase + sPrefix.length() && strcmp(szEnd, flxFileRotate::kLogFileSuffix) == 0;
+}
+
+//---------------------------------------------------------------------------
+// findNextFile()
+//
+// The next file to sync is the lowest numbered closed log file above the last synced file.
+
+bool sfeDLSyncEngine::findNextFile(void)
+{
+    FS theFS = _fileSystem->fileSystem();
+
+    File theRoot = theFS.open("/");
+    if (!theRoot || !theRoot.isDirectory())
+        return false;
+
+    // the open log file isn't closed - skip it
+    uint32_t openNumber = 0;
+    std::string openFile = _openFilename ? _openFilename() : _fileRotate->currentFilename();
+    bool hasOpen = fileNumber(openFile.c_str(), openNumber);
+
+    uint32_t number, nextNumber = 0;
+    std::string nextFile;
+    uint32_t nextSize = 0;
+
+    File theFile = theRoot.openNextFile();
+    while (theFile)
+    {
+        if (!theFile.isDirectory() && fileNumber(theFile.name(), number) && number > _syncedNumber &&
+            !(hasOpen && number == openNumber) && (nextFile.length() == 0 || number < nextNumber))
+        {
+            nextNumber = number;
+            nextFile = theFile.name();
+            nextSize = theFile.size();
+        }
+        theFile.close();
+        theFile = theRoot.openNextFile();
+    }
+    theRoot.close();
+
+    if (nextFile.length() == 0)
+        return false;
+
+    if (nextFile[0] != '/')
+        nextFile = "/" + nextFile;
+
+    // resuming a saved transfer?
+    if (nextFile != _currentFile || _offset > nextSize)
+        _offset = 0;
+
+    setCurrentFile(nextFile);
+    _currentNumber = nextNumber;
+    _fileSize = nextSize;
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLSyncEngine::fileDone(void)
+{
+    flxLog_I(F("%s: %s uploaded (%u bytes)"), name(), _currentFile.c_str(), _fileSize);
+
+    _syncedNumber = _currentNumber;
+    setCurrentFile("");
+    _offset = 0;
+    _fileSize = 0;
+    _nFilesSynced++;
+
+    saveState();
+}
+
+//---------------------------------------------------------------------------
+// Upload methods
+//---------------------------------------------------------------------------
+// sendChunk()
+//
+// Returns the HTTP status, or < 0 on error
+
+int sfeDLSyncEngine::sendChunk(File &theFile)
+{
+    uint32_t length = std::min(chunkSize(), _fileSize - _offset);
+
+    if (!theFile.seek(_offset) || theFile.read(_pBuffer, length) != length)
+    {
+        flxLog_E(F("%s: Error reading %s"), name(), _currentFile.c_str());
+        return HTTPC_ERROR_STREAM_WRITE;
+    }
+    char szCRC[12];
+    snprintf(szCRC, sizeof(szCRC), "%08x", esp_rom_crc32_le(0, _pBuffer, length));
+
+    HTTPClient &theHTTP = _connection.http();
+
+    if (!theHTTP.begin(*_connection.client(), _connection.url().c_str()))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+
+    const char *headerKeys[] = {"X-DL-Offset"};
+    theHTTP.collectHeaders(headerKeys, 1);
+    theHTTP.setReuse(true);
+    theHTTP.setTimeout(kSyncResponseTimeout);
+
+    theHTTP.addHeader("Content-Type", "application/octet-stream");
+    theHTTP.addHeader("X-DL-Device", flux.deviceId());
+    theHTTP.addHeader("X-DL-File", _currentFile.c_str() + 1); // skip the leading /
+    theHTTP.addHeader("X-DL-File-Size", String(_fileSize));
+    theHTTP.addHeader("X-DL-Offset", String(_offset));
+    theHTTP.addHeader("X-DL-CRC32", szCRC);
+
+    int status = theHTTP.POST(_pBuffer, length);
+
+    if (status >= 200 && status < 300)
+    {
+        _offset += length;
+        _nBytes += length;
+        _nChunks++;
+        _nUnsaved++;
+    }
+    else if (status == kSyncStatusOffset && theHTTP.hasHeader("X-DL-Offset"))
+    {
+        // the server has a different position in the file - use it
+        _offset = std::min((uint32_t)strtoul(theHTTP.header("X-DL-Offset").c_str(), nullptr, 10), _fileSize);
+        flxLog_V(F("%s: Resuming %s at offset %u"), name(), _currentFile.c_str(), _offset);
+    }
+    theHTTP.end();
+
+    return status;
+}
+
+//---------------------------------------------------------------------------
+// processSync()
+//
+// One step of the sync - a chunk is sent per call. Waits before returning.
+
+void sfeDLSyncEngine::processSync(void)
+{
+    uint32_t waitMS = chunkInterval();
+
+    if (_bResetPending)
+        clearState();
+
+    if (_fileSystem && !_fileSystem->enabled())
+        _bCardChecked = false; // no card - check the next one inserted
+
+    if (!enabled() || URL().length() == 0 || !_fileSystem || !_fileRotate || !_theNetwork ||
+        !_theNetwork->isConnected() || !_fileSystem->enabled())
+        waitMS = kSyncIdleWait;
+
+    else if (!_bCardChecked && !checkCard())
+        waitMS = kSyncIdleWait;
+
+    else if (_isBusy && _isBusy())
+        waitMS = kSyncBusyWait;
+
+    else if (_fileSize == 0 && !findNextFile())
+        waitMS = kSyncScanWait; // nothing to upload
+
+    else if (_offset >= _fileSize)
+        fileDone(); // empty file, or a resumed upload that already completed
+
+    else if (!_connection.setup(URL(), caCertFilename(), name()))
+        waitMS = kSyncIdleWait;
+
+    else
+    {
+        // chunk buffer - sized to the chunk size property
+        if (!_pBuffer || _bufferSize != chunkSize())
+        {
+            if (_pBuffer)
+                delete[] _pBuffer;
+
+            _bufferSize = chunkSize();
+            _pBuffer = new uint8_t[_bufferSize];
+            if (!_pBuffer)
+            {
+                flxLogM_E(kMsgErrAllocError, name());
+                _bufferSize = 0;
+                vTaskDelay(kSyncIdleWait / portTICK_PERIOD_MS);
+                return;
+            }
+        }
+
+        File theFile = _fileSystem->fileSystem().open(_currentFile.c_str(), "r");
+        if (!theFile)
+        {
+            // the file was removed - move on
+            flxLog_W(F("%s: %s no longer available"), name(), _currentFile.c_str());
+            _syncedNumber = _currentNumber;
+            setCurrentFile("");
+            _offset = 0;
+            _fileSize = 0;
+            saveState();
+        }
+        else
+        {
+            int status = sendChunk(theFile);
+            theFile.close();
+
+            if (status >= 200 && status < 300)
+            {
+                _nFailures = 0;
+
+                if (_offset >= _fileSize)
+                    fileDone();
+                else if (_nUnsaved >= kSyncSaveChunks)
+                    saveState();
+            }
+            else if (status == kSyncStatusOffset || status == kSyncStatusCRC)
+                _nRetries++;
+            else
+            {
+                // failed - back off, and start with a new connection
+                _nFailures++;
+                _nRetries++;
+                _connection.close();
+
+                waitMS = std::min(kSyncIdleWait << std::min(_nFailures, (uint32_t)5), kSyncMaxBackoff);
+
+                if (_nFailures == 1)
+                    flxLog_W(F("%s: Upload of %s failed - %s"), name(), _currentFile.c_str(),
+                             status < 0 ? _connection.http().errorToString(status).c_str() : String(status).c_str());
+            }
+        }
+    }
+    vTaskDelay(std::max(waitMS, (uint32_t)1) / portTICK_PERIOD_MS);
+}
@@ -0,0 +1,191 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - Log file sync
+ *
+ * Uploads closed log files to an HTTP endpoint, in order, from a background task. Each file is sent in
+ * chunks - one POST per chunk - with the following headers:
+ *
+ *      X-DL-Device:    device ID
+ *      X-DL-File:      file name
+ *      X-DL-File-Size: total file size
+ *      X-DL-Offset:    offset of this chunk in the file
+ *      X-DL-CRC32:     CRC32 of the chunk (hex)
+ *
+ * The server replies:
+ *      2xx             chunk stored
+ *      409             offset mismatch - the X-DL-Offset response header has the offset the server expects
+ *      422             CRC mismatch - the chunk is sent again
+ *
+ * Files are synced in file number order. The last synced file number, and the offset into the file being
+ * sent, are kept in NVS so a sync resumes after a restart or deep sleep.
+ *
+ * File numbers only mean something on the card they came from. Each card is given an ID - a random number in
+ * a small file on the card - which is kept in NVS with the sync state. If a different card is inserted, the
+ * sync state is cleared and that card is synced from its first file.
+ *
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCore.h>
+#include <Flux/flxFS.h>
+#include <Flux/flxFileRotate.h>
+#include <Flux/flxNetwork.h>
+
+#include "sfeDLHTTPConnection.h"
+
+#include <functional>
+#include <string>
+
+// Default chunk size (bytes)
+const uint32_t kSyncChunkSize = 4096;
+
+// Default pause (ms) between chunks
+const uint32_t kSyncChunkInterval = 250;
+
+class sfeDLSyncEngine : public flxActionType<sfeDLSyncEngine>
+{
+  public:
+    sfeDLSyncEngine();
+
+    void setNetwork(flxNetwork *theNetwork)
+    {
+        _theNetwork = theNetwork;
+    }
+
+    void setFileSystem(flxIFileSystem *fs)
+    {
+        _fileSystem = fs;
+        _connection.setFileSystem(fs);
+    }
+
+    // The log file rotation manager - for the file name prefix and the currently open file
+    void setFileRotate(flxFileRotate *fileRotate)
+    {
+        _fileRotate = fileRotate;
+    }
+
+    // The log file being written - it isn't synced until it's closed. Defaults to the file rotation manager's file
+    void setOpenFilename(std::function<std::string(void)> openFilename)
+    {
+        _openFilename = openFilename;
+    }
+
+    // Returns true when the system is busy (logging, web downloads ...) and the sync should pause
+    void setBusyCheck(std::function<bool(void)> isBusy)
+    {
+        _isBusy = isBusy;
+    }
+
+    // Load the sync state and start the sync task
+    bool initialize(void);
+
+    // Called by the sync task
+    void processSync(void);
+
+    // Clear the sync state - all files on the card are sent again
+    void resetSync(void);
+
+    //---------------------------------------------------------------------------
+    // Status
+    // The name of the file being sent - a copy, the sync task can change it at any time
+    std::string currentFile(void);
+    uint32_t currentOffset(void)
+    {
+        return _offset;
+    }
+    uint32_t currentSize(void)
+    {
+        return _fileSize;
+    }
+    uint32_t lastSyncedNumber(void)
+    {
+        return _syncedNumber;
+    }
+    // ID of the card the sync state is for - 0 if not known yet
+    uint32_t cardId(void)
+    {
+        return _cardId;
+    }
+    uint32_t nFilesSynced(void)
+    {
+        return _nFilesSynced;
+    }
+    uint32_t nChunks(void)
+    {
+        return _nChunks;
+    }
+    uint32_t nRetries(void)
+    {
+        return _nRetries;
+    }
+    uint32_t nBytes(void)
+    {
+        return _nBytes;
+    }
+
+    // Properties
+    flxPropertyBool<sfeDLSyncEngine> enabled;
+
+    flxPropertyString<sfeDLSyncEngine> URL;
+
+    flxPropertyString<sfeDLSyncEngine> caCertFilename;
+
+    flxPropertyUInt32<sfeDLSyncEngine> chunkSize = {512, 16384};
+
+    flxPropertyUInt32<sfeDLSyncEngine> chunkInterval = {0, 60000};
+
+  private:
+    bool fileNumber(const char *szName, uint32_t &number);
+    bool checkCard(void);
+    bool findNextFile(void);
+    int sendChunk(File &theFile);
+    void fileDone(void);
+    void loadState(void);
+    void saveState(void);
+    void clearState(void);
+    void setCurrentFile(const std::string &theFile);
+
+    flxNetwork *_theNetwork;
+    flxIFileSystem *_fileSystem;
+    flxFileRotate *_fileRotate;
+    std::function<std::string(void)> _openFilename;
+    std::function<bool(void)> _isBusy;
+
+    sfeDLHTTPConnection _connection;
+
+    // sync state
+    uint32_t _cardId;
+    bool _bCardChecked;
+    uint32_t _syncedNumber;
+    std::string _currentFile;
+    SemaphoreHandle_t _hFileMutex;
+    uint32_t _currentNumber;
+    uint32_t _offset;
+    uint32_t _fileSize;
+    uint32_t _nUnsaved;
+    uint32_t _nFailures;
+
+    uint8_t *_pBuffer;
+    uint32_t _bufferSize;
+
+    bool _bResetPending;
+
+    TaskHandle_t _hTaskSync;
+
+    // stats
+    uint32_t _nFilesSynced;
+    uint32_t _nChunks;
+    uint32_t _nRetries;
+    uint32_t _nBytes;
+};
@@ -0,0 +1,205 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - wall clock across deep sleep
+ *
+ */
+
+#include "sfeDLTimeKeeper.h"
+
+#include <Flux/flxCoreLog.h>
+
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define kTimeKeeperMagic 0x4B544C44 // "DLTK"
+
+// How often (ms) the clock is checked
+const uint32_t kTimeCheckPeriod = 1000;
+
+// A jump between checks over this (secs) is a step of the clock
+const double kTimeStepMin = 0.25;
+
+// The drift estimate is updated from a step after at least this much sleep (secs) - and is held to a max (ppm)
+const uint32_t kTimeDriftMinSleep = 600;
+const float kTimeDriftMaxPPM = 50000.;
+
+// Times before this aren't set (2020-01-01)
+const time_t kTimeValidEpoch = 1577836800;
+
+// Clock state kept across deep sleep
+typedef struct
+{
+    uint32_t magic;
+    double sleepTime;    // system time when sleep started
+    uint32_t secsAsleep; // since the clock was last set
+    float driftPPM;      // RTC slow clock - (true - system) / system time, over sleep
+} sfeDLTimeState_t;
+
+RTC_DATA_ATTR static sfeDLTimeState_t _rtcTime;
+
+//---------------------------------------------------------------------------
+static double systemTime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec / 1000000.;
+}
+
+static void setSystemTime(double newTime)
+{
+    struct timeval tv;
+    tv.tv_sec = (time_t)newTime;
+    tv.tv_usec = (suseconds_t)((newTime - tv.tv_sec) * 1000000.);
+    settimeofday(&tv, nullptr);
+}
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLTimeKeeper::sfeDLTimeKeeper()
+    : _sampleTime{0}, _sampleTimer{0}, _startSource{kTimeSourceNone}, _startCorrection{0}, _lastStep{0}, _nSteps{0},
+      _nCorrections{0}
+{
+}
+
+//---------------------------------------------------------------------------
+void sfeDLTimeKeeper::takeSample(void)
+{
+    _sampleTimer = esp_timer_get_time();
+    _sampleTime = systemTime();
+}
+
+//---------------------------------------------------------------------------
+// initialize()
+//
+// On a wake from sleep - or if the clock isn't set - use the RTC if there is one. Otherwise, on a wake, correct
+// the time asleep by the drift estimate.
+
+void sfeDLTimeKeeper::initialize(flxDevRV8803 *pRTC)
+{
+    bool bWake = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && _rtcTime.magic == kTimeKeeperMagic;
+    if (_rtcTime.magic != kTimeKeeperMagic)
+    {
+        memset(&_rtcTime, 0, sizeof(_rtcTime));
+        _rtcTime.magic = kTimeKeeperMagic;
+    }
+
+    double now = systemTime();
+    double asleep = bWake && _rtcTime.sleepTime > 0 ? now - _rtcTime.sleepTime : 0;
+
+    if (asleep > 0)
+        _rtcTime.secsAsleep += (uint32_t)asleep;
+
+    if (pRTC && (bWake || now < kTimeValidEpoch))
+    {
+        time_t rtcTime = pRTC->get_epoch();
+        if (rtcTime >= kTimeValidEpoch)
+        {
+            // the RTC has whole seconds - keep the system clock's fraction if it's within a second
+            double newTime = fabs(now - rtcTime) < 1. ? now : (double)rtcTime;
+            _startCorrection = newTime - now;
+            _startSource = kTimeSourceRTC;
+            setSystemTime(newTime);
+        }
+    }
+    if (_startSource == kTimeSourceNone && asleep > 0 && now >= kTimeValidEpoch && _rtcTime.driftPPM != 0.)
+    {
+        _startCorrection = asleep * _rtcTime.driftPPM / 1000000.;
+        _startSource = kTimeSourceDrift;
+        setSystemTime(now + _startCorrection);
+    }
+    _rtcTime.sleepTime = 0;
+
+    if (_startSource != kTimeSourceNone)
+        flxLog_V(F("Clock corrected by %.3f secs at startup - %s"), _startCorrection, startSourceName());
+
+    takeSample();
+
+    _jobCheck.setup("timekeeper", kTimeCheckPeriod, this, &sfeDLTimeKeeper::checkClock);
+    flxAddJobToQueue(_jobCheck);
+}
+
+//---------------------------------------------------------------------------
+// checkClock()
+//
+// Compare the system clock with the high resolution timer since the last check - a difference is a step
+
+void sfeDLTimeKeeper::checkClock(void)
+{
+    int64_t timer = esp_timer_get_time();
+    double now = systemTime();
+
+    double step = now - (_sampleTime + (timer - _sampleTimer) / 1000000.);
+
+    _sampleTimer = timer;
+    _sampleTime = now;
+
+    if (fabs(step) < kTimeStepMin)
+        return;
+
+    _nSteps++;
+    _lastStep = step;
+
+    // a step from an unset clock isn't drift, or worth a correction
+    if (now - step < kTimeValidEpoch)
+    {
+        _rtcTime.secsAsleep = 0;
+        return;
+    }
+
+    // what's left after the drift correction made at each wake - adjust the estimate
+    if (_rtcTime.secsAsleep >= kTimeDriftMinSleep)
+    {
+        float driftPPM = _rtcTime.driftPPM + step / _rtcTime.secsAsleep * 1000000.;
+        _rtcTime.driftPPM = fmax(-kTimeDriftMaxPPM, fmin(kTimeDriftMaxPPM, driftPPM));
+    }
+    _rtcTime.secsAsleep = 0;
+
+    if (fabs(step) >= kTimeCorrectionThreshold)
+    {
+        _nCorrections++;
+        if (_onCorrection)
+            _onCorrection(step);
+    }
+}
+
+//---------------------------------------------------------------------------
+void sfeDLTimeKeeper::sleep(void)
+{
+    _rtcTime.sleepTime = systemTime();
+}
+
+//---------------------------------------------------------------------------
+float sfeDLTimeKeeper::driftPPM(void)
+{
+    return _rtcTime.magic == kTimeKeeperMagic ? _rtcTime.driftPPM : 0.;
+}
+
+uint32_t sfeDLTimeKeeper::secsAsleep(void)
+{
+    return _rtcTime.magic == kTimeKeeperMagic ? _rtcTime.secsAsleep : 0;
+}
+
+//---------------------------------------------------------------------------
+const char *sfeDLTimeKeeper::startSourceName(void)
+{
+    switch (_startSource)
+    {
+    case kTimeSourceRTC:
+        return "RTC";
+    case kTimeSourceDrift:
+        return "Drift Estimate";
+    }
+    return "None";
+}
@@ -0,0 +1,110 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - wall clock across deep sleep
+ *
+ * The system clock keeps running during deep sleep, but on the RTC slow clock - which drifts. So the first
+ * observations of a wake don't wait on NTP, the clock is corrected at startup:
+ *
+ *      - from an attached RV8803 real time clock, if there is one - it's kept in step by the system clock
+ *      - otherwise by the drift estimate, over the time asleep
+ *
+ * The clock is checked every second against the high resolution timer. A step - an NTP update, or the clock
+ * being set - that is after sleep updates the drift estimate. The estimate, and the time sleep started, are kept
+ * in RTC memory.
+ *
+ * Observations logged before a large step carry timestamps that are off by it - a time correction message is
+ * logged with the step, so those timestamps can be fixed afterwards.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCoreJobs.h>
+#include <Flux/flxDevRV8803.h>
+
+#include <functional>
+
+// A step over this (secs) logs a time correction
+const float kTimeCorrectionThreshold = 2.0;
+
+class sfeDLTimeKeeper
+{
+  public:
+    sfeDLTimeKeeper();
+
+    // Correct the clock at startup, and start checking it. Call once the clocks are setup - pRTC is an attached
+    // RV8803, or nullptr
+    void initialize(flxDevRV8803 *pRTC);
+
+    // Save the clock state - call just before deep sleep
+    void sleep(void);
+
+    // Called when the clock steps by more than the correction threshold - the step is in secs
+    void setCorrectionCallback(std::function<void(double)> onCorrection)
+    {
+        _onCorrection = onCorrection;
+    }
+
+    // How the clock was set at startup
+    static constexpr uint8_t kTimeSourceNone = 0x0;
+    static constexpr uint8_t kTimeSourceRTC = 0x1;
+    static constexpr uint8_t kTimeSourceDrift = 0x2;
+
+    uint8_t startSource(void)
+    {
+        return _startSource;
+    }
+    const char *startSourceName(void);
+
+    // the correction made at startup (secs)
+    double startCorrection(void)
+    {
+        return _startCorrection;
+    }
+
+    //---------------------------------------------------------------------------
+    // Stats
+    float driftPPM(void);
+    // secs asleep since the clock was last set
+    uint32_t secsAsleep(void);
+    double lastStep(void)
+    {
+        return _lastStep;
+    }
+    uint32_t nSteps(void)
+    {
+        return _nSteps;
+    }
+    uint32_t nCorrections(void)
+    {
+        return _nCorrections;
+    }
+
+  private:
+    void checkClock(void);
+    void takeSample(void);
+
+    std::function<void(double)> _onCorrection;
+
+    flxJob _jobCheck;
+
+    // the last check - system time and high resolution timer (us)
+    double _sampleTime;
+    int64_t _sampleTimer;
+
+    uint8_t _startSource;
+    double _startCorrection;
+
+    double _lastStep;
+    uint32_t _nSteps;
+    uint32_t _nCorrections;
+};
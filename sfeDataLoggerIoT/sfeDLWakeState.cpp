@@ -0,0 +1,190 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - warm wake from deep sleep
+ *
+ */
+
+#include "sfeDLWakeState.h"
+#include "sfeDLVersion.h"
+
+#include <Flux/flxCoreLog.h>
+
+#include <esp_rom_crc.h>
+#include <esp_sleep.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#define kWakeStateMagic 0x53574C44 // "DLWS"
+
+// State saved for the next wake - the CRC covers the fields before it
+typedef struct
+{
+    uint32_t magic;
+    uint32_t buildID;
+    uint32_t modeFlags;
+    uint32_t baudRate;
+    uint32_t startupDelay;
+    uint32_t outputMode;
+    uint32_t crc;
+} sfeDLWakeSaved_t;
+
+// Wake cycle timings - kept until a cold boot clears RTC memory
+typedef struct
+{
+    uint32_t magic;
+    uint32_t msLastAwake;
+    sfeDLWakeTimes_t cold;
+    sfeDLWakeTimes_t warm;
+} sfeDLWakeStats_t;
+
+RTC_DATA_ATTR static sfeDLWakeSaved_t _rtcSaved;
+RTC_DATA_ATTR static sfeDLWakeStats_t _rtcStats;
+
+//---------------------------------------------------------------------------
+// The ID of this firmware build - saved state is only used by the build that saved it
+
+static uint32_t wakeBuildID(void)
+{
+    static const char szBuild[] = __DATE__ " " __TIME__;
+
+    uint32_t buildNumber = BUILD_NUMBER;
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&buildNumber, sizeof(buildNumber));
+    return esp_rom_crc32_le(crc, (const uint8_t *)szBuild, sizeof(szBuild));
+}
+
+//---------------------------------------------------------------------------
+static uint32_t wakeSavedCRC(void)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)&_rtcSaved, offsetof(sfeDLWakeSaved_t, crc));
+}
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+sfeDLWakeState::sfeDLWakeState() : _bWarm{false}, _msFirstObs{0}
+{
+}
+
+//---------------------------------------------------------------------------
+// begin()
+//
+// A warm wake is a timer wake from deep sleep, with state saved by this build
+
+bool sfeDLWakeState::begin(void)
+{
+    if (_rtcStats.magic != kWakeStateMagic)
+    {
+        memset(&_rtcStats, 0, sizeof(_rtcStats));
+        _rtcStats.magic = kWakeStateMagic;
+    }
+
+    _bWarm = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && _rtcSaved.magic == kWakeStateMagic &&
+             _rtcSaved.buildID == wakeBuildID() && _rtcSaved.crc == wakeSavedCRC();
+
+#ifdef DATALOGGER_IOT_COLD_WAKE
+    // every wake takes the full startup path - to compare against warm wakes
+    _bWarm = false;
+#endif
+
+    // The saved state is good for one wake - it's saved again before the next sleep
+    _rtcSaved.magic = 0;
+
+    sfeDLWakeTimes_t &theTimes = _bWarm ? _rtcStats.warm : _rtcStats.cold;
+    theTimes.nCycles++;
+
+    return _bWarm;
+}
+
+//---------------------------------------------------------------------------
+// Saved values - the caller checks isWarm() first
+uint32_t sfeDLWakeState::modeFlags(void)
+{
+    return _rtcSaved.modeFlags;
+}
+
+uint32_t sfeDLWakeState::baudRate(void)
+{
+    return _rtcSaved.baudRate;
+}
+
+uint32_t sfeDLWakeState::startupDelay(void)
+{
+    return _rtcSaved.startupDelay;
+}
+
+uint8_t sfeDLWakeState::outputMode(void)
+{
+    return _rtcSaved.outputMode;
+}
+
+//---------------------------------------------------------------------------
+// save()
+//
+// Save state for the next wake, and the awake time of this cycle
+
+void sfeDLWakeState::save(uint32_t modeFlags, uint32_t baudRate, uint32_t startupDelay, uint8_t outputMode)
+{
+    _rtcSaved.buildID = wakeBuildID();
+    _rtcSaved.modeFlags = modeFlags;
+    _rtcSaved.baudRate = baudRate;
+    _rtcSaved.startupDelay = startupDelay;
+    _rtcSaved.outputMode = outputMode;
+    _rtcSaved.magic = kWakeStateMagic;
+    _rtcSaved.crc = wakeSavedCRC();
+
+    uint32_t msAwake = millis();
+    sfeDLWakeTimes_t &theTimes = _bWarm ? _rtcStats.warm : _rtcStats.cold;
+    theTimes.msAwakeTotal += msAwake;
+    theTimes.nAwake++;
+
+    _rtcStats.msLastAwake = msAwake;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLWakeState::write(JsonDocument &jDoc)
+{
+    if (_msFirstObs != 0)
+        return;
+
+    // millis() starts at boot
+    _msFirstObs = millis();
+
+    sfeDLWakeTimes_t &theTimes = _bWarm ? _rtcStats.warm : _rtcStats.cold;
+    theTimes.msFirstObsTotal += _msFirstObs;
+    theTimes.nFirstObs++;
+
+    flxLog_V(F("%s wake - first observation %u ms after boot"), _bWarm ? "Warm" : "Cold", _msFirstObs);
+}
+
+//---------------------------------------------------------------------------
+uint32_t sfeDLWakeState::msLastAwake(void)
+{
+    return _rtcStats.msLastAwake;
+}
+
+const sfeDLWakeTimes_t &sfeDLWakeState::coldTimes(void)
+{
+    return _rtcStats.cold;
+}
+
+const sfeDLWakeTimes_t &sfeDLWakeState::warmTimes(void)
+{
+    return _rtcStats.warm;
+}
+
+//---------------------------------------------------------------------------
+void sfeDLWakeState::resetStats(void)
+{
+    memset(&_rtcStats.cold, 0, sizeof(_rtcStats.cold));
+    memset(&_rtcStats.warm, 0, sizeof(_rtcStats.warm));
+}
@@ -0,0 +1,88 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * SparkFun Data Logger - warm wake from deep sleep
+ *
+ * State kept in RTC memory across deep sleep. Before sleeping, the app saves the values that don't change
+ * from wake to wake. On a timer wake with a good state block - same firmware build, CRC good - startup is
+ * "warm" and skips:
+ *
+ *      - the board check (eFuse read and decrypt) - the board mode flags are restored
+ *      - the startup property read from NVS (baud rate, startup delay, message mode) - restored
+ *      - the wait on the serial port, and the startup command menu
+ *      - the startup radio window in WiFi on demand mode - the system clock runs through deep sleep
+ *
+ * Any other start - power on, reset, crash, new firmware - is "cold" and takes the full startup path.
+ *
+ * Each wake cycle is timed - boot to the first observation, and boot to sleep (awake time). The totals are
+ * kept for cold and warm wakes, so the two can be compared (!wake-stats).
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <Flux/flxCoreInterface.h>
+
+#include <ArduinoJson.h>
+
+// Wake cycle timings - for cold or warm wakes
+typedef struct
+{
+    uint32_t nCycles;
+    uint32_t nFirstObs;
+    uint32_t msFirstObsTotal;
+    uint32_t nAwake; // cycles that ended in sleep
+    uint32_t msAwakeTotal;
+} sfeDLWakeTimes_t;
+
+class sfeDLWakeState : public flxIWriterJSON
+{
+  public:
+    sfeDLWakeState();
+
+    // Check the RTC state block - call first thing at startup. Returns true for a warm wake
+    bool begin(void);
+
+    bool isWarm(void)
+    {
+        return _bWarm;
+    }
+
+    // Saved values - only valid on a warm wake
+    uint32_t modeFlags(void);
+    uint32_t baudRate(void);
+    uint32_t startupDelay(void);
+    uint8_t outputMode(void);
+
+    // Save state for the next wake - call just before deep sleep
+    void save(uint32_t modeFlags, uint32_t baudRate, uint32_t startupDelay, uint8_t outputMode);
+
+    // flxIWriterJSON - times the first observation of the cycle
+    void write(JsonDocument &jDoc);
+
+    // this cycle - ms from boot to the first observation, 0 if there hasn't been one
+    uint32_t msFirstObservation(void)
+    {
+        return _msFirstObs;
+    }
+
+    // the previous cycle - ms from boot to sleep, 0 if it didn't end in sleep
+    uint32_t msLastAwake(void);
+
+    const sfeDLWakeTimes_t &coldTimes(void);
+    const sfeDLWakeTimes_t &warmTimes(void);
+
+    void resetStats(void);
+
+  private:
+    bool _bWarm;
+    uint32_t _msFirstObs;
+};
@@ -132,6 +132,12 @@ class sfeDLWebServer : public flxActionType<sfeDLWebServer>
         return _mdnsRunning;
     }
 
+    // Was the web server used - page, file list or download - in the last msWindow milliseconds?
+    bool activeWithin(uint32_t msWindow)
+    {
+        return _pWebServer != nullptr && _loginTicks > 0 && millis() - _loginTicks < msWindow;
+    }
+
     void setFilePrefix(std::string sPrefix)
     {
         if (sPrefix.length() == 0)
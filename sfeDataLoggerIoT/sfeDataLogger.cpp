@@ -94,14 +94,46 @@ constexpr char *sfeDataLogger::kLogFormatNames[];
 // delay used in loop during startup
 const uint32_t kStartupLoopDelayMS = 70;
 
+// The serial console task - the menu and commands used to run on the Arduino loop task, so same stack size. It
+// runs on the core of the main loop, below its priority - so it only runs while the main loop waits.
+#define kConsoleStackSize 8192
+#define kConsoleTaskPriority tskIDLE_PRIORITY
+
+// The main loop waits up to this long (ms) for the console task to finish an edit
+const uint32_t kConsoleYieldMaxMS = 50;
+
+// How often (ms) the console task checks that the main loop handled an edit session
+const uint32_t kConsoleWaitMS = 10;
+
+//--------------------------------------------------------------------------------
+// console task loop - standard C static method - for FreeRTOS
+
+static void _sfeDataLogger_TaskConsole(void *parameter)
+{
+    sfeDataLogger *pApp = (sfeDataLogger *)parameter;
+
+    if (pApp == nullptr)
+        return;
+
+    while (true)
+    {
+        // wait for the main loop to hand over a key press
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        pApp->processConsole();
+    }
+}
+
 //---------------------------------------------------------------------------
 // Constructor
 //---------------------------------------------------------------------------
 //
 
 sfeDataLogger::sfeDataLogger()
-    : _logTypeSD{kAppLogTypeNone}, _logTypeSer{kAppLogTypeNone}, _timer{kDefaultLogInterval}, _isValidMode{false},
-      _modeFlags{0}, _opFlags{0}, _fuelGauge{nullptr}, _bSleepEnabled{false}, _bLogSysInfo{false}, _pSystemInfo{nullptr}
+    : _logTypeSD{kAppLogTypeNone}, _logTypeSer{kAppLogTypeNone}, _logTypeSDActive{kAppLogTypeNone},
+      _logTypeSerActive{kAppLogTypeNone}, _bHTTPLinesActive{false}, _timer{kDefaultLogInterval}, _isValidMode{false},
+      _modeFlags{0}, _opFlags{0}, _fuelGauge{nullptr}, _bSleepEnabled{false}, _bSleepPending{false},
+      _hTaskConsole{NULL}, _bConsoleBusy{false}, _bCommandPending{false}, _bEditStarted{false}, _bEditEnded{false},
+      _bEditFinished{false}, _bLogSysInfo{false}, _pSystemInfo{nullptr}
 #ifdef ENABLE_OLED_DISPLAY
       ,
       _pDisplay{nullptr}
@@ -111,6 +143,9 @@ sfeDataLogger::sfeDataLogger()
     // Add a title for this section - the application level  - of settings
     setTitle("General");
 
+    // settings saved per key by earlier versions are read from the per key storage
+    _settingsStore.setLegacy(&_sysStorage);
+
     flxRegister(ledEnabled, "LED Enabled", "Enable/Disable the on-board LED activity");
 
     // our the menu timeout property to our props/menu system entries
@@ -123,6 +158,7 @@ sfeDataLogger::sfeDataLogger()
     sdCardLogType.setTitle("Output");
     flxRegister(sdCardLogType, "SD Card Format", "Enable and set the output format");
     flxRegister(serialLogType, "Serial Console Format", "Enable and set the output format");
+    flxRegister(serialFullPolicy, "Serial Buffer Full", "When the serial output buffer is full - wait or drop");
     flxRegister(jsonBufferSize, "JSON Buffer Size", "Output buffer size in bytes");
 
     // Terminal Serial Baud Rate
@@ -132,6 +168,7 @@ sfeDataLogger::sfeDataLogger()
     // Add the format changing props to the logger - makes more sense from a UX standpoint.
     _logger.addProperty(sdCardLogType);
     _logger.addProperty(serialLogType);
+    _logger.addProperty(serialFullPolicy);
 
     _logger.setTitle("Logging");
 
@@ -140,6 +177,7 @@ sfeDataLogger::sfeDataLogger()
     flxRegister(sleepEnabled, "Enable System Sleep", "If enabled, sleep the system ");
     flxRegister(sleepInterval, "Sleep Interval (sec)", "The interval the system will sleep for");
     flxRegister(wakeInterval, "Wake Interval (sec)", "The interval the system will operate between sleep period");
+    flxRegister(sleepBufferWakes, "Buffer Wakes", "Hold observations in memory, writing them every N wakes. 0 is off");
 
     startupOutputMode.setTitle("Advanced");
     flxRegister(startupOutputMode, "Startup Messages", "Level of message output at startup");
@@ -216,16 +254,10 @@ void sfeDataLogger::onSettingsEdit(bool bLoading)
         // no longer editing
         clearOpMode(kDataLoggerOpEditing);
 
-        // did the editing operation set a restart flag? If so see if the user wants to restart
-        // the device.
+        // did the editing operation set a restart flag? Save the settings now, so the changes that need it aren't
+        // lost in the restart - the console task asks the user, see processConsole()
         if (inOpMode(kDataLoggerOpPendingRestart))
-        {
-            flxLog_N("\n\rSome changes required a device restart to take effect...");
-            _sysUpdate.restartDevice();
-
-            // this shouldn't return unless user aborted
-            clearOpMode(kDataLoggerOpPendingRestart);
-        }
+            _settingsSaver.flush();
     }
 }
 
@@ -293,8 +325,10 @@ bool sfeDataLogger::onSetup()
     if (startupOutputMode() == kAppStartupMsgNone)
         flxLog.setLogLevel(flxLogWarning);
 
-    // See if we can ID the board we're running on.
-    _modeFlags |= dlModeCheckSystem();
+    // See if we can ID the board we're running on - on a warm wake, the board was checked before sleeping
+    _bootProfile.start(sfeDLBootProfile::kBootBoardCheck);
+    _modeFlags |= _wakeState.isWarm() ? _wakeState.modeFlags() : dlModeCheckSystem();
+    _bootProfile.end(sfeDLBootProfile::kBootBoardCheck);
 
     // Lets set the application name. If we recognize the board, we use it's name, otherwise
     // we use something generic
@@ -312,17 +346,19 @@ bool sfeDataLogger::onSetup()
     setVersion(kDLVersionNumberMajor, kDLVersionNumberMinor, kDLVersionNumberPoint, kDLVersionDescriptor, BUILD_NUMBER);
 
     // set the settings storage system for the framework
-    flxSettings.setStorage(&_sysStorage);
+    flxSettings.setStorage(&_settingsStore);
     flxSettings.setFallback(&_jsonStorage);
 
     // Have JSON storage write/use the SD card
     _jsonStorage.setFileSystem(&_theSDCard);
     _jsonStorage.setFilename("datalogger.json");
 
-    // Have settings saved when editing via serial console is complete.
-    flxRegisterEventCB(flxEvent::kOnEdit, this, &sfeDataLogger::onSettingsEdit);
-    flxRegisterEventCB(flxEvent::kOnEditFinished, &flxSettings, &flxSettingsSave::saveEvent_CB);
-    flxRegisterEventCB(flxEvent::kOnNewFile, &flxSettings, &flxSettingsSave::saveEvent_CB);
+    // Have settings saved when editing via serial console is complete, and when a new log file is started (the
+    // file number). Saves are made by a job - file rotation doesn't wait on settings storage
+    // Edit sessions run on the console task - their events are handled on the main loop
+    flxRegisterEventCB(flxEvent::kOnEdit, this, &sfeDataLogger::onEditEvent);
+    flxRegisterEventCB(flxEvent::kOnEditFinished, this, &sfeDataLogger::onEditFinishedEvent);
+    flxRegisterEventCB(flxEvent::kOnNewFile, &_settingsSaver, &sfeDLSettingsSaver::onNewFile);
 
     // Add serial settings to flux - the flux loop call will take care
     // of everything else.
@@ -401,6 +437,14 @@ bool sfeDataLogger::onSetup()
     flxRegisterEventCB(flxEvent::kOnSystemActivity, this, &sfeDataLogger::onSystemActivity);
     flxRegisterEventCB(flxEvent::kOnSystemActivityLow, this, &sfeDataLogger::onSystemActivityLow);
 
+    // devices are loaded next - time it
+    _deviceCache.markLoadStart();
+    _bootProfile.start(sfeDLBootProfile::kBootDeviceLoad);
+
+    // Verify-first - if the qwiic bus hasn't changed, the cached devices are built and the auto-load is skipped
+    if (!inOpMode(kDataLoggerOpStartNoAutoload) && _deviceCache.loadCached())
+        flux.setAutoload(false);
+
     return true;
 }
 
@@ -414,6 +458,9 @@ bool sfeDataLogger::onSetup()
 
 void sfeDataLogger::onDeviceLoad()
 {
+    _deviceCache.markLoadEnd();
+    _bootProfile.end(sfeDLBootProfile::kBootDeviceLoad);
+
     // quick check on fuel gauge - which is part of the IOT 9DOF board
     auto fuelGauge = flux.get<flxDevMAX17048>();
     if (fuelGauge->size() > 0)
@@ -496,6 +543,9 @@ void sfeDataLogger::onDeviceLoad()
 
 void sfeDataLogger::onRestore(void)
 {
+    // the restore runs until onStart()
+    _bootProfile.start(sfeDLBootProfile::kBootRestore);
+
     // At this point, we know enough about the device to set details about it.
     char prefix[5] = "0000";
     (void)dlModeCheckPrefix(_modeFlags, prefix);
@@ -506,7 +556,7 @@ void sfeDataLogger::onRestore(void)
 // reset the device - erase settings, reboot
 void sfeDataLogger::resetDevice(void)
 {
-    _sysStorage.resetStorage();
+    _settingsStore.resetStorage();
     _sysUpdate.restartDevice();
 }
 
@@ -615,27 +665,47 @@ void sfeDataLogger::onInitStartupCommands(uint delaySecs)
 
 void sfeDataLogger::onInit(void)
 {
-    // Did the user set a serial value?
+    _bootProfile.start(sfeDLBootProfile::kBootSerial);
+
+    // Did the user set a serial value? On a warm wake from sleep, use the values saved before sleeping
     uint32_t theRate;
     uint32_t theDelay;
-    getStartupProperties(theRate, theDelay);
+    if (_wakeState.begin())
+    {
+        theRate = _wakeState.baudRate();
+        theDelay = _wakeState.startupDelay();
+        startupOutputMode = _wakeState.outputMode();
+    }
+    else
+        getStartupProperties(theRate, theDelay);
 
     // just to be safe...
     theRate = theRate >= 1200 ? theRate : kDefaultTerminalBaudRate;
 
+    // A large driver transmit buffer - the startup output doesn't wait on the baud rate
+    Serial.setTxBufferSize(kAppSerialTxBufferSize);
     Serial.begin(theRate);
 
-    // Wait on serial - not sure if a timeout is needed ... but added for safety
-    for (uint32_t startMS = millis(); !Serial && millis() - startMS <= kSerialStartupDelayMS;)
+    // Wait on serial - not sure if a timeout is needed ... but added for safety. Not on a warm wake - nobody is
+    // waiting on the console of a sleeping logger
+    for (uint32_t startMS = millis(); !_wakeState.isWarm() && !Serial && millis() - startMS <= kSerialStartupDelayMS;)
         delay(250);
 
+    _bootProfile.end(sfeDLBootProfile::kBootSerial);
+
     sfeLED.initialize();
     sfeLED.on(sfeLED.Green);
 
+    // serial log output is buffered and sent by its own task
+    _serialOutput.initialize();
+
     setOpMode(kDataLoggerOpStartup);
 
     startupDelaySecs = theDelay;
+
+    _bootProfile.start(sfeDLBootProfile::kBootStartupMenu);
     onInitStartupCommands(theDelay);
+    _bootProfile.end(sfeDLBootProfile::kBootStartupMenu);
 
     // change the order of the system settings
     flux.insert_after(&flxSettings, &flxClock);
@@ -650,6 +720,7 @@ void sfeDataLogger::onInit(void)
     flux.insert_after(&_analogPinEnable, &_soilMoistureEnable);
 
     flux.insert_after(&_iotEndpoints, &_analogPinEnable);
+    flux.insert_after(&_iotPublishing, &_iotEndpoints);
 }
 //---------------------------------------------------------------------------
 // Check our platform status
@@ -688,6 +759,8 @@ void sfeDataLogger::checkOpMode()
 // Called after the system is loaded, restored and initialized
 bool sfeDataLogger::onStart()
 {
+    _bootProfile.end(sfeDLBootProfile::kBootRestore);
+    _bootProfile.start(sfeDLBootProfile::kBootStart);
 
     // flxLog_I("DEBUG: onStart() - entry -  Free Heap: %d", ESP.getFreeHeap());
 
@@ -725,8 +798,13 @@ bool sfeDataLogger::onStart()
 
     boot_count++;
 
-    // init wifi
-    _wifiConnection.connect();
+    // init wifi - in on demand mode, the radio manager brings it up for each upload window. The startup window
+    // sets the clock - not needed on a warm wake, the clock runs during sleep
+    _radioManager.initialize(!_wakeState.isWarm());
+
+    // deferred settings saves
+    _settingsSaver.initialize();
+
     // Logging is done at an interval - using an interval timer.
     // Connect logger to the timer event
     _logger.listen(_timer.on_interval_with_name);
@@ -735,6 +813,14 @@ bool sfeDataLogger::onStart()
     _logger.add(_fmtJSON);
     _logger.add(_fmtCSV);
 
+    // start the IoT publisher - manages batched output to the IoT endpoints
+    _iotPublisher.initialize();
+    _iotHTTPKeepAlive.initialize();
+    _iotUDP.initialize();
+
+    // the log file is synced - and its position saved for the next wake - while it's written from a saved position
+    _logFileStats.initialize();
+
     // check SD card status
     if (!_theSDCard.enabled())
     {
@@ -743,6 +829,7 @@ bool sfeDataLogger::onStart()
     }
 
     // setup NFC - it provides another means to load WiFi credentials
+    _bootProfile.start(sfeDLBootProfile::kBootDeviceSetup);
     setupNFDevice();
 
     // now lets rock on the external serial device
@@ -780,15 +867,22 @@ bool sfeDataLogger::onStart()
         }
     }
 
+    // any change to the attached hardware is logged
+    _deviceCache.verify(loadedDevices);
+
     // Setup the Bio Hub
     setupBioHub();
 
     // setup the ENS160
     setupENS160();
 
+    _bootProfile.end(sfeDLBootProfile::kBootDeviceSetup);
+
     // Check time devices
+    _bootProfile.start(sfeDLBootProfile::kBootTime);
     if (!setupTime())
         flxLog_W(F("Time reference setup failed."));
+    _bootProfile.end(sfeDLBootProfile::kBootTime);
 
     flxLog_N("");
 
@@ -809,7 +903,11 @@ bool sfeDataLogger::onStart()
     checkOpMode();
 
     if (startupOutputMode() == kAppStartupMsgNormal)
+    {
+        _bootProfile.start(sfeDLBootProfile::kBootStatus);
         displayAppStatus(true);
+        _bootProfile.end(sfeDLBootProfile::kBootStatus);
+    }
 
     if (!_isValidMode)
         outputVMessage();
@@ -817,6 +915,12 @@ bool sfeDataLogger::onStart()
     // for our web server file search
     _iotWebServer.setFilePrefix(_theOutputFile.filePrefix());
 
+    // start the log file sync
+    _syncEngine.initialize();
+
+    // key presses at the serial console are handled on their own task
+    startConsoleTask();
+
     // Register our device management event handlers
     flxRegisterEventCB(flxEvent::kOnFluxAddDevice, this, &sfeDataLogger::onDeviceAdded);
     flxRegisterEventCB(flxEvent::kOnFluxRemoveDevice, this, &sfeDataLogger::onDeviceRemoved);
@@ -836,6 +940,11 @@ bool sfeDataLogger::onStart()
     if (startupOutputMode() != kAppStartupMsgNormal)
         flxLog.setLogLevel(flxLogInfo);
 
+    // observations held in RTC memory during sleep - written out now if it's time
+    _sleepBuffer.initialize();
+
+    _bootProfile.end(sfeDLBootProfile::kBootStart);
+
     // log now!
     _timer.trigger();
     return true;
@@ -848,6 +957,13 @@ void sfeDataLogger::enterSleepMode()
     if (!sleepEnabled())
         return;
 
+    // Don't sleep out from under the console - sleep once it's done
+    if (_bConsoleBusy)
+    {
+        _bSleepPending = true;
+        return;
+    }
+
     time_t t_now;
     time(&t_now);
     struct tm *tmLocal = localtime(&t_now);
@@ -872,6 +988,21 @@ void sfeDataLogger::enterSleepMode()
 
     esp_sleep_enable_timer_wakeup(period);
 
+    // the clock is corrected at wake from the time asleep
+    _timeKeeper.sleep();
+
+    // a pending settings save is lost in sleep
+    _settingsSaver.flush();
+
+    // and so are the log records queued for the serial console
+    _serialOutput.flush();
+
+    // the log file position, so the next wake appends without a seek
+    _logFileStats.flush();
+
+    // for a warm wake
+    _wakeState.save(_modeFlags, serialBaudRate(), startupDelaySecs(), startupOutputMode());
+
     esp_deep_sleep_start(); // see you on the other side
 }
 //---------------------------------------------------------------------------
@@ -946,40 +1077,195 @@ void sfeDataLogger::onDeviceRemoved(uint32_t uiDevice)
     _logger.remove(pDevice);
 }
 //---------------------------------------------------------------------------
-// loop()
-//
-// Called during the operational loop of the system.
+// Console task
+//---------------------------------------------------------------------------
+bool sfeDataLogger::startConsoleTask(void)
+{
+    if (_hTaskConsole != NULL)
+        return true;
+
+    BaseType_t xReturnValue = xTaskCreatePinnedToCore(_sfeDataLogger_TaskConsole, // Console task function
+                                                      "SerialConsole",            // String with name of task.
+                                                      kConsoleStackSize,          // Stack size
+                                                      this,                       // Parameter passed to the task
+                                                      kConsoleTaskPriority,       // Priority of the task.
+                                                      &_hTaskConsole,             // Task handle.
+                                                      xPortGetCoreID());          // The main loop core
+    if (xReturnValue != pdPASS)
+    {
+        // the console runs on the main loop - logging pauses during edits
+        _hTaskConsole = NULL;
+        flxLog_W(F("Unable to start the serial console task"));
+        return false;
+    }
+    return true;
+}
 
-bool sfeDataLogger::loop()
+//---------------------------------------------------------------------------
+// processConsole()
+
+void sfeDataLogger::processConsole(void)
 {
-    // key press at Serial Console? What to do??
-    if (Serial.available())
+    // Bang command?
+    uint8_t chIn = Serial.read();
+    if (chIn == '!')
     {
-        // Bang command?
-        uint8_t chIn = Serial.read();
-        if (chIn == '!')
+        flxSerial.textToWhite();
+        Serial.write('>');
+        flxSerial.textToNormal();
+        Serial.write('!');
+        Serial.flush();
+
+        sfeDLCommands cmdProcessor;
+        if (cmdProcessor.readCommand(_consoleCommand))
         {
-            flxSerial.textToWhite();
-            Serial.write('>');
-            flxSerial.textToNormal();
-            Serial.write('!');
-            Serial.flush();
-            sfeDLCommands cmdProcessor;
-            bool status = cmdProcessor.processCommand(this);
+            // most commands run on the main loop - which hands the console back when it's done. Ones that prompt,
+            // or run for a while, run here so logging continues
+            if (!cmdProcessor.runsOnConsole(_consoleCommand))
+            {
+                _bCommandPending = true;
+                return;
+            }
+            cmdProcessor.runCommand(this, _consoleCommand);
+            _consoleCommand.clear();
         }
-        else // edit settings
+    }
+    else // edit settings
+    {
+        // start an editing session
+        sfeLEDColor_t color;
+        int status = _serialSettings.editSettings();
+        if (status == -1)
+            color = sfeLED.Red;
+        else if (status == 1)
+            color = sfeLED.Green;
+        else
+            color = sfeLED.Yellow;
+        sfeLED.flash(color);
+
+        // the end of the session is handled on the main loop - then ask about a restart, if one is needed
+        if (_hTaskConsole == NULL)
+            processConsoleWork();
+        while (_bEditFinished || _bEditEnded)
+            delay(kConsoleWaitMS);
+
+        if (inOpMode(kDataLoggerOpPendingRestart))
         {
-            // start an editing session
-            sfeLEDColor_t color;
-            int status = _serialSettings.editSettings();
-            if (status == -1)
-                color = sfeLED.Red;
-            else if (status == 1)
-                color = sfeLED.Green;
-            else
-                color = sfeLED.Yellow;
-            sfeLED.flash(color);
+            flxLog_N("\n\rSome changes required a device restart to take effect...");
+            _settingsSaver.flush();
+            _sysUpdate.restartDevice();
+
+            // this shouldn't return unless user aborted
+            clearOpMode(kDataLoggerOpPendingRestart);
         }
     }
+
+    // hand the console back to the main loop
+    _bConsoleBusy = false;
+}
+
+//---------------------------------------------------------------------------
+// yieldToConsole()
+//
+// A console task that's ready to run was cut off by the main loop - let it run until it waits again (for a key
+// press, or on output), so the main loop doesn't start a pass part way through a menu edit
+
+void sfeDataLogger::yieldToConsole(void)
+{
+    if (_hTaskConsole == NULL || !_bConsoleBusy)
+        return;
+
+    uint32_t startTicks = millis();
+    while (eTaskGetState(_hTaskConsole) == eReady && millis() - startTicks < kConsoleYieldMaxMS)
+        delay(1);
+}
+
+//---------------------------------------------------------------------------
+// Console work on the main loop
+//---------------------------------------------------------------------------
+// The edit session events are sent on the console task - note them for the main loop
+
+void sfeDataLogger::onEditEvent(bool bLoading)
+{
+    if (bLoading)
+        _bEditStarted = true;
+    else
+        _bEditEnded = true;
+}
+
+void sfeDataLogger::onEditFinishedEvent(void)
+{
+    _bEditFinished = true;
+}
+
+//---------------------------------------------------------------------------
+// processConsoleWork()
+//
+// Run a command line, and handle the edit session events, from the console task. Commands build observations
+// and the edit handlers change the logger state - so they run here, between observations, not on the console task.
+// Commands that prompt, and !download, stay on the console task - see processConsole().
+
+void sfeDataLogger::processConsoleWork(void)
+{
+    // the flags are cleared once handled - the console task waits on them at the end of a session
+    if (_bEditStarted)
+    {
+        onSettingsEdit(true);
+        _bEditStarted = false;
+    }
+    if (_bEditFinished)
+    {
+        _settingsSaver.onEditFinished();
+        _radioManager.onEditFinished();
+        _bEditFinished = false;
+    }
+    if (_bEditEnded)
+    {
+        onSettingsEdit(false);
+        _bEditEnded = false;
+    }
+    if (_bCommandPending)
+    {
+        sfeDLCommands cmdProcessor;
+        cmdProcessor.runCommand(this, _consoleCommand);
+        _consoleCommand.clear();
+
+        // hand the console back
+        _bCommandPending = false;
+        _bConsoleBusy = false;
+    }
+}
+
+//---------------------------------------------------------------------------
+// loop()
+//
+// Called during the operational loop of the system.
+
+bool sfeDataLogger::loop()
+{
+    // key press at Serial Console? Hand it to the console task - and keep logging
+    if (!_bConsoleBusy && Serial.available())
+    {
+        _bConsoleBusy = true;
+        updateLogWriters(); // pause serial log output
+
+        if (_hTaskConsole != NULL)
+            xTaskNotifyGive(_hTaskConsole);
+        else
+            processConsole();
+    }
+
+    // commands and edit session events from the console
+    processConsoleWork();
+
+    // apply log type changes made at the console, resume serial log output when the console is done
+    updateLogWriters();
+
+    // a sleep deferred while the console was in use?
+    if (_bSleepPending && !_bConsoleBusy)
+    {
+        _bSleepPending = false;
+        enterSleepMode();
+    }
     return false;
 }
@@ -82,7 +82,23 @@
 // OLED
 // #include <Flux/flxDevMicroOLED.h>
 
+#include "sfeDLBootProfile.h"
 #include "sfeDLButton.h"
+#include "sfeDLDeviceCache.h"
+#include "sfeDLFmtBinary.h"
+#include "sfeDLFmtLineProtocol.h"
+#include "sfeDLIoTHTTP.h"
+#include "sfeDLIoTPublisher.h"
+#include "sfeDLIoTUDP.h"
+#include "sfeDLLogFileStats.h"
+#include "sfeDLRadioManager.h"
+#include "sfeDLSerialOutput.h"
+#include "sfeDLSettingsSaver.h"
+#include "sfeDLSettingsSnapshot.h"
+#include "sfeDLSleepBuffer.h"
+#include "sfeDLSyncEngine.h"
+#include "sfeDLTimeKeeper.h"
+#include "sfeDLWakeState.h"
 #include "sfeDLWebServer.h"
 
 // #ifdef ENABLE_OLED_DISPLAY
@@ -111,6 +127,9 @@ const uint16_t kSystemSleepWakeSec = 120;
 // What is the out of the box baud rate ..
 const uint32_t kDefaultTerminalBaudRate = 115200;
 
+// Serial driver transmit buffer - sent from the UART interrupt, so output doesn't wait on the baud rate
+const uint32_t kAppSerialTxBufferSize = 4096;
+
 // General startup delay (secs) for the startup menu
 const uint32_t kStartupMenuDefaultDelaySecs = 2;
 
@@ -154,6 +173,24 @@ class sfeDataLogger : public flxApplication
     // Setup the IOT clients
     bool setupIoTClients(void);
 
+    //---------------------------------------------------------------------
+    // Route an IoT endpoint's output through a publish channel
+    template <typename T> sfeDLIoTChannel *addIoTChannel(T &endpoint, const char *name, bool bFreeForm = true)
+    {
+        sfeDLIoTChannel *pChannel = new sfeDLIoTChannel(name, "Publishing options for this IoT service", bFreeForm);
+        if (!pChannel)
+        {
+            flxLogM_E(kMsgErrAllocError, name);
+            return nullptr;
+        }
+        pChannel->setEndpoint(&endpoint, [&endpoint]() { return endpoint.enabled(); });
+
+        _iotPublisher.add(pChannel);
+        _iotPublishing.push_back(*pChannel);
+
+        return pChannel;
+    }
+
     //---------------------------------------------------------------------
     // Setup time ...
     bool setupTime(void);
@@ -215,8 +252,11 @@ class sfeDataLogger : public flxApplication
     static constexpr uint8_t kAppLogTypeNone = 0x0;
     static constexpr uint8_t kAppLogTypeCSV = 0x1;
     static constexpr uint8_t kAppLogTypeJSON = 0x2;
+    static constexpr uint8_t kAppLogTypeLineProtocol = 0x3;
+    static constexpr uint8_t kAppLogTypeBinary = 0x4; // serial only
 
-    static constexpr char *kLogFormatNames[] = {"Disabled", "CSV Format", "JSON Format"};
+    static constexpr char *kLogFormatNames[] = {"Disabled", "CSV Format", "JSON Format", "Line Protocol",
+                                                "Binary Frames"};
 
     // Startup output modes
     static constexpr uint8_t kAppStartupMsgNormal = 0x0;
@@ -242,6 +282,17 @@ class sfeDataLogger : public flxApplication
     uint8_t _logTypeSD;
     uint8_t _logTypeSer;
 
+    // The log types the SD card and serial writers are attached for. Log type changes are applied on
+    // the main loop, between observations.
+    uint8_t _logTypeSDActive;
+    uint8_t _logTypeSerActive;
+
+    // is the HTTP Keep-Alive service attached to the line protocol formatter
+    bool _bHTTPLinesActive;
+
+    void updateLogWriters(void);
+    void moveLogWriter(flxWriter *pWriter, uint8_t fromType, uint8_t toType);
+
     // For the terminal baud rate setting
 
     uint32_t _terminalBaudRate;
@@ -258,9 +309,15 @@ class sfeDataLogger : public flxApplication
     uint32_t get_sleepWakePeriod(void);
     void set_sleepWakePeriod(uint32_t);
 
+    uint32_t get_sleepBufferWakes(void);
+    void set_sleepBufferWakes(uint32_t);
+
     uint32_t get_jsonBufferSize(void);
     void set_jsonBufferSize(uint32_t);
 
+    uint8_t get_serialFullPolicy(void);
+    void set_serialFullPolicy(uint8_t);
+
     bool get_verbose_dev_name(void);
     void set_verbose_dev_name(bool);
 
@@ -297,19 +354,44 @@ class sfeDataLogger : public flxApplication
 
     bool loop();
 
+    //---------------------------------------------------------------------------
+    // processConsole()
+    //
+    // Handle a key press at the serial console - a bang command or a settings edit session. Runs on the
+    // console task, so logging continues while the user is in the menu. Commands that prompt or run for a while
+    // (!download) run there - other command lines are run, and the edit session events handled, on the main
+    // loop - see processConsoleWork().
+    void processConsole(void);
+
+    // yieldToConsole()
+    //
+    // Called by the main loop between passes. The console task runs below the main loop's priority, on its core,
+    // so menu edits are only made while the main loop waits - this lets an edit that was cut off finish first.
+    void yieldToConsole(void);
+
     // Define our log type properties
 
     flxPropertyRWUInt8<sfeDataLogger, &sfeDataLogger::get_logTypeSD, &sfeDataLogger::set_logTypeSD> sdCardLogType = {
         kAppLogTypeCSV,
         {{kLogFormatNames[kAppLogTypeNone], kAppLogTypeNone},
          {kLogFormatNames[kAppLogTypeCSV], kAppLogTypeCSV},
-         {kLogFormatNames[kAppLogTypeJSON], kAppLogTypeJSON}}};
+         {kLogFormatNames[kAppLogTypeJSON], kAppLogTypeJSON},
+         {kLogFormatNames[kAppLogTypeLineProtocol], kAppLogTypeLineProtocol}}};
 
     flxPropertyRWUInt8<sfeDataLogger, &sfeDataLogger::get_logTypeSer, &sfeDataLogger::set_logTypeSer> serialLogType = {
         kAppLogTypeCSV,
         {{kLogFormatNames[kAppLogTypeNone], kAppLogTypeNone},
          {kLogFormatNames[kAppLogTypeCSV], kAppLogTypeCSV},
-         {kLogFormatNames[kAppLogTypeJSON], kAppLogTypeJSON}}};
+         {kLogFormatNames[kAppLogTypeJSON], kAppLogTypeJSON},
+         {kLogFormatNames[kAppLogTypeLineProtocol], kAppLogTypeLineProtocol},
+         {kLogFormatNames[kAppLogTypeBinary], kAppLogTypeBinary}}};
+
+    // Serial console output - what to do when the output buffer is full
+    flxPropertyRWUInt8<sfeDataLogger, &sfeDataLogger::get_serialFullPolicy, &sfeDataLogger::set_serialFullPolicy>
+        serialFullPolicy = {sfeDLSerialOutput::kPolicyBlock,
+                            {{"Block", sfeDLSerialOutput::kPolicyBlock},
+                             {"Drop Record", sfeDLSerialOutput::kPolicyDropRecord},
+                             {"Drop Oldest", sfeDLSerialOutput::kPolicyDropOldest}}};
 
     // JSON output buffer size
     flxPropertyRWUInt32<sfeDataLogger, &sfeDataLogger::get_jsonBufferSize, &sfeDataLogger::set_jsonBufferSize>
@@ -320,6 +402,8 @@ class sfeDataLogger : public flxApplication
     flxPropertyRWUInt32<sfeDataLogger, &sfeDataLogger::get_sleepWakePeriod, &sfeDataLogger::set_sleepWakePeriod>
         wakeInterval = {60, 86400};
     flxPropertyRWBool<sfeDataLogger, &sfeDataLogger::get_sleepEnabled, &sfeDataLogger::set_sleepEnabled> sleepEnabled;
+    flxPropertyRWUInt32<sfeDataLogger, &sfeDataLogger::get_sleepBufferWakes, &sfeDataLogger::set_sleepBufferWakes>
+        sleepBufferWakes = {0, 100};
 
     // Display LED Enabled?
     flxPropertyRWBool<sfeDataLogger, &sfeDataLogger::get_ledEnabled, &sfeDataLogger::set_ledEnabled> ledEnabled;
@@ -367,12 +451,18 @@ class sfeDataLogger : public flxApplication
     // event things
     void onFirmwareLoad(bool bLoading);
     void onSettingsEdit(bool bLoading);
+    void onEditEvent(bool bLoading);
+    void onEditFinishedEvent(void);
+    void processConsoleWork(void);
 
     void onSystemActivity(void);
     void onSystemActivityLow(void);
 
     void onErrorMessage(uint8_t);
 
+    // serial console task
+    bool startConsoleTask(void);
+
     void getStartupProperties(uint32_t &baudRate, uint32_t &startupDelay);
 
     // Board button callbacks
@@ -398,6 +488,14 @@ class sfeDataLogger : public flxApplication
     // Note: setting internal buffer sizes using template to minimize alloc calls.
     flxFormatJSON<kAppJSONDocSize> _fmtJSON;
     flxFormatCSV _fmtCSV;
+    sfeDLFmtLineProtocol _fmtLineProtocol;
+    sfeDLFmtBinary _fmtBinary;
+
+    // Buffered serial console log output
+    sfeDLSerialOutput _serialOutput;
+
+    // SD card and IoT output - buffered in RTC memory across deep sleep
+    sfeDLSleepBuffer _sleepBuffer;
 
     // Our logger
     flxLogger _logger;
@@ -411,7 +509,12 @@ class sfeDataLogger : public flxApplication
     // A writer interface for the SD Card that also rotates files
     flxFileRotate _theOutputFile;
 
-    // settings things
+    // Times writes to the output file
+    sfeDLLogFileStats _logFileStats;
+
+    // settings things - kept in one NVS blob, with the per setting storage as a fallback
+    sfeDLSettingsSnapshot _settingsStore;
+    sfeDLSettingsSaver _settingsSaver;
     flxPreferences _sysStorage;
     flxSettingsSerial _serialSettings;
     flxStorageJSONPrefFile _jsonStorage;
@@ -448,6 +551,11 @@ class sfeDataLogger : public flxApplication
 
     // Container for IoT endpoint drivers
     flxActionContainer _iotEndpoints;
+
+    // Routes JSON observations to the IoT endpoints, and the container for the per endpoint publish options
+    sfeDLIoTPublisher _iotPublisher;
+    flxActionContainer _iotPublishing;
+
     // IoT endpoints
     // An generic MQTT client
     flxMQTTESP32 _mqttClient;
@@ -467,6 +575,12 @@ class sfeDataLogger : public flxApplication
     // HTTP/URL Post
     flxIoTHTTP _iotHTTP;
 
+    // HTTP/URL Post - persistent connection
+    sfeDLIoTHTTP _iotHTTPKeepAlive;
+
+    // UDP datagrams to a local collector
+    sfeDLIoTUDP _iotUDP;
+
     // machine chat Iot
     flxIoTMachineChat _iotMachineChat;
 
@@ -477,6 +591,24 @@ class sfeDataLogger : public flxApplication
     // Web Server
     sfeDLWebServer _iotWebServer;
 
+    // Upload of closed log files
+    sfeDLSyncEngine _syncEngine;
+
+    // WiFi on demand - for battery deployments
+    sfeDLRadioManager _radioManager;
+
+    // State kept across deep sleep - for a warm wake
+    sfeDLWakeState _wakeState;
+
+    // The devices loaded at startup - kept in NVS to spot hardware changes
+    sfeDLDeviceCache _deviceCache;
+
+    // Startup phase timing
+    sfeDLBootProfile _bootProfile;
+
+    // Wall clock across deep sleep - corrected at wake, without waiting on NTP
+    sfeDLTimeKeeper _timeKeeper;
+
     // Our firmware Update/Reset system
     flxSysFirmware _sysUpdate;
 
@@ -503,6 +635,19 @@ class sfeDataLogger : public flxApplication
     // sleep things - is enabled storage, sleep event
     bool _bSleepEnabled;
     flxJob _sleepJob;
+    bool _bSleepPending;
+
+    // serial console task - and is it handling a menu/command?
+    TaskHandle_t _hTaskConsole;
+    volatile bool _bConsoleBusy;
+
+    // console work handed to the main loop - a command line, and the edit session events. Each is set by the
+    // console task and cleared by the main loop.
+    std::string _consoleCommand;
+    volatile bool _bCommandPending;
+    volatile bool _bEditStarted;
+    volatile bool _bEditEnded;
+    volatile bool _bEditFinished;
 
     // log sys info
 
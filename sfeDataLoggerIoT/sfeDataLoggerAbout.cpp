@@ -172,7 +172,7 @@ void sfeDataLogger::displayAppStatus(bool useInfo)
     // at startup, useInfo == true, the file isn't known, so skip output
     if (!useInfo)
         flxLog_N("%c    Current Filename: \t%s", pre_ch,
-                 _theOutputFile.currentFilename().length() == 0 ? "<none>" : _theOutputFile.currentFilename().c_str());
+                 _logFileStats.currentFilename().length() == 0 ? "<none>" : _logFileStats.currentFilename().c_str());
     flxLog_N("%c    Rotate Period: %d Hours", pre_ch, _theOutputFile.rotatePeriod());
 
     bool bEnabled = _extIntrEvent.isEnabled();
@@ -230,6 +230,8 @@ void sfeDataLogger::displayAppStatus(bool useInfo)
     _displayAboutObjHelper(pre_ch, _mqttClient.name(), _mqttClient.enabled());
     _displayAboutObjHelper(pre_ch, _mqttSecureClient.name(), _mqttSecureClient.enabled());
     _displayAboutObjHelper(pre_ch, _iotHTTP.name(), _iotHTTP.enabled());
+    _displayAboutObjHelper(pre_ch, _iotHTTPKeepAlive.name(), _iotHTTPKeepAlive.enabled());
+    _displayAboutObjHelper(pre_ch, _iotUDP.name(), _iotUDP.enabled());
     _displayAboutObjHelper(pre_ch, _iotAWS.name(), _iotAWS.enabled());
     _displayAboutObjHelper(pre_ch, _iotAzure.name(), _iotAzure.enabled());
     _displayAboutObjHelper(pre_ch, _iotThingSpeak.name(), _iotThingSpeak.enabled());
@@ -249,6 +251,8 @@ void sfeDataLogger::displayAppStatus(bool useInfo)
     snprintf(szBuffer, sizeof(szBuffer), "mDNS: http://%s.local", _iotWebServer.mDNSName().c_str());
     _displayAboutObjHelper(pre_ch, szBuffer, _iotWebServer.mDNSEnabled());
     _displayAboutObjHelper(pre_ch, "Authentication", _iotWebServer.authUsername().length() > 0);
+    _displayAboutObjHelper(pre_ch, _syncEngine.name(), _syncEngine.enabled());
+    _displayAboutObjHelper(pre_ch, _radioManager.name(), _radioManager.onDemand());
 
     flxLog_N("");
 
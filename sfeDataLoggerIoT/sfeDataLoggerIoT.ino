@@ -39,6 +39,8 @@ void setup()
 // Arduino loop -
 void loop()
 {
+    // the settings menu runs on the console task - its edits are made between passes of the loop
+    theDataLogger.yieldToConsole();
 
     ///////////////////////////////////////////////////////////////////
     // Flux
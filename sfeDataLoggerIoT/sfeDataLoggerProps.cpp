@@ -32,17 +32,11 @@ void sfeDataLogger::set_logTypeSD(uint8_t logType)
     if (logType == _logTypeSD)
         return;
 
-    if (_logTypeSD == kAppLogTypeCSV)
-        _fmtCSV.remove(&_theOutputFile);
-    else if (_logTypeSD == kAppLogTypeJSON)
-        _fmtJSON.remove(&_theOutputFile);
-
     _logTypeSD = logType;
 
-    if (_logTypeSD == kAppLogTypeCSV)
-        _fmtCSV.add(&_theOutputFile);
-    else if (_logTypeSD == kAppLogTypeJSON)
-        _fmtJSON.add(&_theOutputFile);
+    // During a console session, the main loop applies the change
+    if (!_bConsoleBusy)
+        updateLogWriters();
 }
 //---------------------------------------------------------------------------
 uint8_t sfeDataLogger::get_logTypeSer(void)
@@ -55,17 +49,66 @@ void sfeDataLogger::set_logTypeSer(uint8_t logType)
     if (logType == _logTypeSer)
         return;
 
-    if (_logTypeSer == kAppLogTypeCSV)
-        _fmtCSV.remove(flxSerial);
-    else if (_logTypeSer == kAppLogTypeJSON)
-        _fmtJSON.remove(flxSerial);
-
     _logTypeSer = logType;
 
-    if (_logTypeSer == kAppLogTypeCSV)
-        _fmtCSV.add(flxSerial);
-    else if (_logTypeSer == kAppLogTypeJSON)
-        _fmtJSON.add(flxSerial);
+    if (!_bConsoleBusy)
+        updateLogWriters();
+}
+
+//---------------------------------------------------------------------------
+// Move a writer from the formatter of one log type to another
+
+void sfeDataLogger::moveLogWriter(flxWriter *pWriter, uint8_t fromType, uint8_t toType)
+{
+    if (fromType == kAppLogTypeCSV)
+        _fmtCSV.remove(pWriter);
+    else if (fromType == kAppLogTypeJSON)
+        _fmtJSON.remove(pWriter);
+    else if (fromType == kAppLogTypeLineProtocol)
+        _fmtLineProtocol.remove(pWriter);
+
+    if (toType == kAppLogTypeCSV)
+        _fmtCSV.add(pWriter);
+    else if (toType == kAppLogTypeJSON)
+        _fmtJSON.add(pWriter);
+    else if (toType == kAppLogTypeLineProtocol)
+        _fmtLineProtocol.add(pWriter);
+}
+
+//---------------------------------------------------------------------------
+// updateLogWriters()
+//
+// Attach the SD card and serial writers to the formatters of the current log types. Serial log output is
+// paused while the console is in use - so it doesn't scroll through the menu. SD card output goes through the
+// sleep buffer. The HTTP Keep-Alive service only gets line protocol output while it's enabled for it.
+
+void sfeDataLogger::updateLogWriters(void)
+{
+    if (_logTypeSDActive != _logTypeSD)
+    {
+        moveLogWriter(&_sleepBuffer, _logTypeSDActive, _logTypeSD);
+        _logTypeSDActive = _logTypeSD;
+    }
+
+    uint8_t logTypeSer = _bConsoleBusy ? kAppLogTypeNone : _logTypeSer;
+    if (_logTypeSerActive != logTypeSer)
+    {
+        moveLogWriter(&_serialOutput, _logTypeSerActive, logTypeSer);
+        _logTypeSerActive = logTypeSer;
+
+        // binary frames are written straight to the serial output
+        _fmtBinary.setOutput(logTypeSer == kAppLogTypeBinary ? &_serialOutput : nullptr);
+    }
+
+    bool bHTTPLines = _iotHTTPKeepAlive.lineProtocolEnabled();
+    if (_bHTTPLinesActive != bHTTPLines)
+    {
+        if (bHTTPLines)
+            _fmtLineProtocol.add(&_iotHTTPKeepAlive);
+        else
+            _fmtLineProtocol.remove(&_iotHTTPKeepAlive);
+        _bHTTPLinesActive = bHTTPLines;
+    }
 }
 
 //---------------------------------------------------------------------------
@@ -81,6 +124,19 @@ void sfeDataLogger::set_jsonBufferSize(uint32_t new_size)
     _fmtJSON.setBufferSize(new_size);
 }
 
+//---------------------------------------------------------------------------
+// Serial output full policy
+
+uint8_t sfeDataLogger::get_serialFullPolicy(void)
+{
+    return _serialOutput.policy();
+}
+
+void sfeDataLogger::set_serialFullPolicy(uint8_t policy)
+{
+    _serialOutput.setPolicy(policy);
+}
+
 //---------------------------------------------------------------------------
 // device names
 //---------------------------------------------------------------------------
@@ -109,6 +165,7 @@ void sfeDataLogger::set_sleepEnabled(bool enabled)
         return;
 
     _bSleepEnabled = enabled;
+    _sleepBuffer.setActive(enabled);
 
     if (_bSleepEnabled)
         flxAddJobToQueue(_sleepJob);
@@ -129,6 +186,18 @@ void sfeDataLogger::set_sleepWakePeriod(uint32_t period)
     _sleepJob.setPeriod(period * 1000);
 }
 
+//---------------------------------------------------------------------------
+// Wakes between writes of the sleep buffer - 0 or 1 is off
+uint32_t sfeDataLogger::get_sleepBufferWakes(void)
+{
+    return _sleepBuffer.flushWakes();
+}
+
+void sfeDataLogger::set_sleepBufferWakes(uint32_t nWakes)
+{
+    _sleepBuffer.setFlushWakes(nWakes);
+}
+
 //---------------------------------------------------------------------------
 // LED
 //---------------------------------------------------------------------------
@@ -170,7 +239,7 @@ void sfeDataLogger::set_termBaudRate(uint32_t newRate)
 void sfeDataLogger::getStartupProperties(uint32_t &baudRate, uint32_t &startupDelay)
 {
     // Do we have this block in storage? And yes, a little hacky with name :)
-    flxStorageBlock *stBlk = _sysStorage.getBlock(((flxObject *)this)->name());
+    flxStorageBlock *stBlk = _settingsStore.getBlock(((flxObject *)this)->name());
 
     if (!stBlk)
     {
@@ -194,7 +263,7 @@ void sfeDataLogger::getStartupProperties(uint32_t &baudRate, uint32_t &startupDe
     status = stBlk->read(startupOutputMode.name(), uTmp);
     startupOutputMode = (status ? uTmp : kAppStartupMsgNormal);
 
-    _sysStorage.endBlock(stBlk);
+    _settingsStore.endBlock(stBlk);
 }
 //---------------------------------------------------------------------------
 // local/board name things
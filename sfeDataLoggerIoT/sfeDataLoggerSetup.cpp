@@ -14,6 +14,7 @@
  *
  */
 #include "sfeDLBoard.h"
+#include "sfeDLEvents.h"
 #include "sfeDataLogger.h"
 
 #include <Flux/flxDevBME280.h>
@@ -27,6 +28,13 @@
 static const uint8_t kAppBioHubReset = 17; // Use the TXD pin as the bio hub reset pin
 static const uint8_t kAppBioHubMFIO = 16;  // Use the RXD pin as the bio hub mfio pin
 
+// Log file sync is paused while the web server is in use, and right after an observation is logged
+static const uint32_t kAppSyncWebBusyMS = 30000;
+static const uint32_t kAppSyncLogBusyMS = 500;
+
+// WiFi on demand - time (secs) an upload window stays connected after the NTP client starts, to update the clock
+static const uint32_t kAppRadioNTPWaitSecs = 5;
+
 //---------------------------------------------------------------------------
 // setupSDCard()
 //
@@ -64,6 +72,7 @@ bool sfeDataLogger::setupSDCard(void)
 // Setup the IOT clients
 bool sfeDataLogger::setupIoTClients()
 {
+    sfeDLIoTChannel *pChannel;
 
     _iotEndpoints.setTitle("Services");
     _iotEndpoints.setName("IoT Services", "IoT Service Connection Drivers");
@@ -71,14 +80,14 @@ bool sfeDataLogger::setupIoTClients()
     _mqttClient.setTitle("IoT Services");
     // setup the network connection for the mqtt
     _mqttClient.setNetwork(&_wifiConnection);
-    // add mqtt to JSON
-    _fmtJSON.add(_mqttClient);
+    // add mqtt to the IoT publisher
+    addIoTChannel(_mqttClient, "MQTT Publishing");
     _iotEndpoints.push_back(_mqttClient);
 
     // setup the network connection for the mqtt
     _mqttSecureClient.setNetwork(&_wifiConnection);
-    // add mqtt to JSON
-    _fmtJSON.add(_mqttSecureClient);
+    // add mqtt to the IoT publisher
+    addIoTChannel(_mqttSecureClient, "MQTT Secure Publishing");
 
     _iotEndpoints.push_back(_mqttSecureClient);
 
@@ -88,7 +97,7 @@ bool sfeDataLogger::setupIoTClients()
 
     // Add the filesystem to load certs/keys from the SD card
     _iotAWS.setFileSystem(&_theSDCard);
-    _fmtJSON.add(_iotAWS);
+    addIoTChannel(_iotAWS, "AWS IoT Publishing");
 
     _iotEndpoints.push_back(_iotAWS);
 
@@ -97,7 +106,15 @@ bool sfeDataLogger::setupIoTClients()
 
     // Add the filesystem to load certs/keys from the SD card
     _iotThingSpeak.setFileSystem(&_theSDCard);
-    _fmtJSON.add(_iotThingSpeak);
+    // ThingSpeak is HTTP based - deliver from the background task by default
+    pChannel = addIoTChannel(_iotThingSpeak, "ThingSpeak Publishing", false);
+    if (pChannel)
+    {
+        pChannel->background = true;
+
+        // ThingSpeak rejects updates less than 15 seconds apart
+        pChannel->publishInterval = 15;
+    }
 
     // Add the ThingSpeak driver to the flux system
     _iotEndpoints.push_back(_iotThingSpeak);
@@ -107,7 +124,7 @@ bool sfeDataLogger::setupIoTClients()
 
     // Add the filesystem to load certs/keys from the SD card
     _iotAzure.setFileSystem(&_theSDCard);
-    _fmtJSON.add(_iotAzure);
+    addIoTChannel(_iotAzure, "Azure IoT Publishing");
 
     // Add the Azure IoT driver to the flux system
     _iotEndpoints.push_back(_iotAzure);
@@ -115,29 +132,105 @@ bool sfeDataLogger::setupIoTClients()
     // general HTTP / URL logger
     _iotHTTP.setNetwork(&_wifiConnection);
     _iotHTTP.setFileSystem(&_theSDCard);
-    _fmtJSON.add(_iotHTTP);
+    // HTTP services connect on each publish - deliver from the background task by default
+    pChannel = addIoTChannel(_iotHTTP, "HTTP Publishing");
+    if (pChannel)
+        pChannel->background = true;
 
     // Add the HTTP driver to the flux system
     _iotEndpoints.push_back(_iotHTTP);
+
+    // HTTP with a persistent connection
+    _iotHTTPKeepAlive.setNetwork(&_wifiConnection);
+    _iotHTTPKeepAlive.setFileSystem(&_theSDCard);
+    pChannel = addIoTChannel(_iotHTTPKeepAlive, "HTTP Keep-Alive Publishing");
+    if (pChannel)
+        pChannel->background = true;
+
+    // line protocol batches are posted from the IoT delivery task
+    _iotHTTPKeepAlive.setDeliveryNotify([this]() { return _iotPublisher.notifyDelivery(); });
+    _iotPublisher.addDeliveryService([this]() { return _iotHTTPKeepAlive.serviceLines(); });
+
+    _iotEndpoints.push_back(_iotHTTPKeepAlive);
+
+    // UDP telemetry - a send doesn't wait on the network, so it's left inline for the lowest latency
+    _iotUDP.setNetwork(&_wifiConnection);
+    addIoTChannel(_iotUDP, "UDP Telemetry Publishing");
+
+    _iotEndpoints.push_back(_iotUDP);
     // Machine Chat
     _iotMachineChat.setNetwork(&_wifiConnection);
     _iotMachineChat.setFileSystem(&_theSDCard);
-    _fmtJSON.add(_iotMachineChat);
+    pChannel = addIoTChannel(_iotMachineChat, "MachineChat Publishing", false);
+    if (pChannel)
+        pChannel->background = true;
 
     // Add the Machine Chat driver to the flux system
     _iotEndpoints.push_back(_iotMachineChat);
 
     // Arduino IoT
     _iotArduinoIoT.setNetwork(&_wifiConnection);
-    _fmtJSON.add(_iotArduinoIoT);
+    addIoTChannel(_iotArduinoIoT, "Arduino IoT Publishing", false);
 
     // Add the Arduino IoT driver to the flux system
     _iotEndpoints.push_back(_iotArduinoIoT);
+    // The publisher delivers JSON output to each endpoint via the endpoint's publish channel
+    _iotPublishing.setTitle("Publishing");
+    _iotPublishing.setName("IoT Publishing", "Per IoT Service publishing options");
+    _iotPublisher.setNetwork(&_wifiConnection);
+    _iotPublisher.setFileSystem(&_theSDCard);
+
+    // SD card and IoT output go through the sleep buffer - it holds observations in RTC memory across deep sleep
+    _logFileStats.setOutput(&_theOutputFile, &_theSDCard);
+    _sleepBuffer.setOutputs(&_logFileStats, &_iotPublisher);
+    _sleepBuffer.setIoTState([this]() { return _iotPublisher.enabled(); }, [this]() { return _iotPublisher.online(); });
+    _fmtJSON.add(_sleepBuffer);
+
+    // Line protocol output is made from the JSON observations - to the serial console, SD card and HTTP. The
+    // HTTP Keep-Alive service is attached by updateLogWriters() while it's enabled for line protocol.
+    _fmtJSON.add(_fmtLineProtocol);
+
+    // Binary frames, for PC capture, are also made from the JSON observations - serial console only
+    _fmtJSON.add(_fmtBinary);
+
+    // WiFi on demand - the publisher holds observations while the radio is off, and delivers them in each window
+    _radioManager.setWiFi(&_wifiConnection);
+    _radioManager.setMinConnected((kAppNTPStartupDelaySecs + kAppRadioNTPWaitSecs) * 1000);
+    _radioManager.setWindowStart([this]() { _iotPublisher.flushAll(); });
+    _radioManager.setDrainedCheck([this]() { return _iotPublisher.undelivered() == 0; });
+    _radioManager.setConnectCallback([this](bool bDone) {
+        if (bDone)
+            _bootProfile.end(sfeDLBootProfile::kBootWiFi);
+        else
+            _bootProfile.start(sfeDLBootProfile::kBootWiFi);
+    });
+    _fmtJSON.add(_radioManager);
+
+    // Times the first observation of each wake cycle
+    _fmtJSON.add(_wakeState);
+
+    // A large clock step means earlier observations have timestamps off by it - log it, so they can be fixed
+    _timeKeeper.setCorrectionCallback([this](double step) {
+        char szBuffer[64];
+        snprintf(szBuffer, sizeof(szBuffer), "Clock stepped by %.3f secs", step);
+        _logger.logMessage("Time Correction", szBuffer);
+    });
+
     // Web server
     // _iotWebServer.setTitle("Preview");
     _iotWebServer.setNetwork(&_wifiConnection);
     _iotWebServer.setFileSystem(&_theSDCard);
 
+    // Log file sync - uploads closed log files
+    _syncEngine.setNetwork(&_wifiConnection);
+    _syncEngine.setFileSystem(&_theSDCard);
+    _syncEngine.setFileRotate(&_theOutputFile);
+    _syncEngine.setOpenFilename([this]() { return _logFileStats.currentFilename(); });
+    _syncEngine.setBusyCheck([this]() {
+        return _iotWebServer.activeWithin(kAppSyncWebBusyMS) ||
+               _iotPublisher.msSinceObservation() < kAppSyncLogBusyMS;
+    });
+
     return true;
 }
 
@@ -173,6 +266,9 @@ bool sfeDataLogger::setupTime()
     // update the system clock to the reference clock
     flxClock.updateClock();
 
+    // Correct the clock after sleep - from the RTC if there's one, so the first observations don't wait on NTP
+    _timeKeeper.initialize(allRTC8803->size() > 0 ? allRTC8803->at(0) : nullptr);
+
     return true;
 }
 //---------------------------------------------------------------------
@@ -268,7 +364,7 @@ void sfeDataLogger::setupGNSS(void)
     pGNSS->setAvailablePPSPins(kDLBoardGNSSPPSPins, sizeof(kDLBoardGNSSPPSPins) / sizeof(kDLBoardGNSSPPSPins[0]));
 
     // map the GNSS PPS event to the log observation event
-    flxAddEventAliasWithValue(flxEvent::kOnGNSSPPSEvent, flxEvent::kOnLogObservationWithSource, "PPS");
+    flxAddEventAliasWithValue(flxEvent::kOnGNSSPPSEvent, flxEvent::kOnLogObservationWithSource, kDLEventSourcePPS);
 }
 
 //---------------------------------------------------------------------------
@@ -279,7 +375,8 @@ void sfeDataLogger::setupExtSerial(void)
     _extSerial.txPin(kDLBoardExtSerialTXPin);
 
     // map the data available event to the log observation event
-    flxAddEventAliasWithValue(flxEvent::kOnSerialDataAvailable, flxEvent::kOnLogObservationWithSource, "SERIAL");
+    flxAddEventAliasWithValue(flxEvent::kOnSerialDataAvailable, flxEvent::kOnLogObservationWithSource,
+                              kDLEventSourceSerial);
 }
 //---------------------------------------------------------------------------
 void sfeDataLogger::setInterruptEvent(void)
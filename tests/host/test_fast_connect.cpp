@@ -0,0 +1,261 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * Host test - sfeDLFastConnect, against a fake radio driver
+ *
+ */
+
+#include "sfeDLFastConnect.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <type_traits>
+#include <utility>
+
+static int _nFailed = 0;
+
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                            \
+            _nFailed++;                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+// The cached link is kept in RTC memory - it must not hold the WiFi password
+template <typename T, typename = void> struct hasPassword : std::false_type
+{
+};
+template <typename T> struct hasPassword<T, decltype((void)std::declval<T>().password, void())> : std::true_type
+{
+};
+static_assert(!hasPassword<sfeDLWiFiLink_t>::value, "the cached link holds no credentials");
+
+const uint32_t kTestIP = 0x0A01A8C0;    // 192.168.1.10
+const uint32_t kTestNewIP = 0x0B01A8C0; // 192.168.1.11
+const uint32_t kTestClock = 1700000000;
+
+//---------------------------------------------------------------------------
+// A radio that connects after a delay - or not at all. Each call is logged, in order.
+
+class testDriver : public sfeDLWiFiDriver
+{
+  public:
+    testDriver()
+        : ssid{"home"}, bFastWorks{true}, bJoinWorks{true}, msConnect{200}, ip{kTestIP}, clock{kTestClock},
+          _ticks{1000}, _connectAt{0}
+    {
+    }
+
+    bool begin(const sfeDLWiFiLink_t &theLink, bool bStaticIP)
+    {
+        calls += bStaticIP ? "begin-static " : "begin-dhcp ";
+        if (ssid != theLink.ssid)
+            return false;
+
+        _connectAt = bFastWorks ? _ticks + msConnect : 0;
+        return true;
+    }
+
+    void join(void)
+    {
+        calls += "join ";
+        _connectAt = bJoinWorks ? _ticks + msConnect * 10 : 0;
+    }
+
+    bool isConnected(void)
+    {
+        return _connectAt != 0 && _ticks >= _connectAt;
+    }
+
+    bool getLink(sfeDLWiFiLink_t &theLink)
+    {
+        if (!isConnected())
+            return false;
+
+        strncpy(theLink.ssid, ssid.c_str(), sizeof(theLink.ssid) - 1);
+        memset(theLink.bssid, 0x42, sizeof(theLink.bssid));
+        theLink.channel = 6;
+        theLink.ip = ip;
+        theLink.gateway = 0x0101A8C0;
+        theLink.subnet = 0x00FFFFFF;
+        theLink.dns = 0x0101A8C0;
+        return true;
+    }
+
+    void reset(void)
+    {
+        calls += "reset ";
+        _connectAt = 0;
+    }
+
+    uint32_t ticks(void)
+    {
+        return _ticks;
+    }
+
+    uint32_t now(void)
+    {
+        return clock > 0 ? clock + (_ticks - 1000) / 1000 : 0;
+    }
+
+    void wait(uint32_t ms)
+    {
+        _ticks += ms;
+    }
+
+    // the station drops the connection - before the next connect
+    void drop(void)
+    {
+        _connectAt = 0;
+        calls.clear();
+    }
+
+    std::string ssid;
+    bool bFastWorks;
+    bool bJoinWorks;
+    uint32_t msConnect;
+    uint32_t ip;
+    uint32_t clock;
+
+    std::string calls;
+
+  private:
+    uint32_t _ticks;
+    uint32_t _connectAt;
+};
+
+//---------------------------------------------------------------------------
+// No cached link - a full connection, from a reset station, and the link is cached
+static void testFirstConnect(testDriver &theDriver, sfeDLFastConnect &theConnect, sfeDLWiFiLink_t &theLink)
+{
+    CHECK(!theConnect.cached());
+    CHECK(theConnect.connect());
+    CHECK(theDriver.calls == "reset join ");
+    CHECK(theConnect.lastConnect() == sfeDLFastConnect::kConnectFull);
+    CHECK(theConnect.cached());
+    CHECK(strcmp(theLink.ssid, "home") == 0 && theLink.channel == 6 && theLink.ip == kTestIP);
+    CHECK(theLink.leaseStart == theDriver.now());
+}
+
+//---------------------------------------------------------------------------
+// The lease is in time - the cached address is used, no DHCP. The lease start is kept
+static void testFastStatic(testDriver &theDriver, sfeDLFastConnect &theConnect, sfeDLWiFiLink_t &theLink)
+{
+    uint32_t leaseStart = theLink.leaseStart;
+
+    theDriver.drop();
+    theDriver.wait(60000);
+    CHECK(theConnect.connect());
+    CHECK(theDriver.calls == "begin-static ");
+    CHECK(theConnect.lastConnect() == sfeDLFastConnect::kConnectFast);
+    CHECK(theConnect.nFast() == 1 && theConnect.nFastDHCP() == 0);
+    CHECK(theLink.leaseStart == leaseStart);
+}
+
+//---------------------------------------------------------------------------
+// The lease is out of time, or there's no clock to check it - the fast connection uses DHCP, and a new lease
+// starts
+static void testFastDHCP(testDriver &theDriver, sfeDLFastConnect &theConnect, sfeDLWiFiLink_t &theLink)
+{
+    theDriver.drop();
+    theDriver.wait((kFastConnectLeaseSecs + 1) * 1000);
+    CHECK(theConnect.connect());
+    CHECK(theDriver.calls == "begin-dhcp ");
+    CHECK(theConnect.lastConnect() == sfeDLFastConnect::kConnectFastDHCP);
+    CHECK(theLink.leaseStart == theDriver.now());
+
+    uint32_t clock = theDriver.clock;
+    theDriver.clock = 0;
+    theDriver.drop();
+    CHECK(theConnect.connect());
+    CHECK(theDriver.calls == "begin-dhcp ");
+    theDriver.clock = clock;
+
+    // a lease time of 0 always uses DHCP
+    theConnect.setLeaseSecs(0);
+    theDriver.drop();
+    CHECK(theConnect.connect());
+    CHECK(theDriver.calls == "begin-dhcp ");
+    theConnect.setLeaseSecs(kFastConnectLeaseSecs);
+
+    // DHCP gave a new address - it's cached, with a new lease
+    theDriver.drop();
+    theDriver.ip = kTestNewIP;
+    theDriver.wait(2000);
+    theConnect.setLeaseSecs(1);
+    CHECK(theConnect.connect());
+    theConnect.setLeaseSecs(kFastConnectLeaseSecs);
+    CHECK(theLink.ip == kTestNewIP && theLink.leaseStart == theDriver.now());
+
+    CHECK(theConnect.nFastDHCP() == 4);
+}
+
+//---------------------------------------------------------------------------
+// The access point is gone - the cached link is dropped, the station reset, then a full connection
+static void testFastFails(testDriver &theDriver, sfeDLFastConnect &theConnect, sfeDLWiFiLink_t &theLink)
+{
+    uint32_t nFull = theConnect.nFull();
+
+    theDriver.drop();
+    theDriver.bFastWorks = false;
+    CHECK(theConnect.connect());
+    CHECK(theDriver.calls == "begin-static reset join ");
+    CHECK(theConnect.lastConnect() == sfeDLFastConnect::kConnectFull);
+    CHECK(theConnect.nFastFailed() == 1 && theConnect.nFull() == nFull + 1);
+    CHECK(theConnect.cached());
+    theDriver.bFastWorks = true;
+
+    // the network of the settings changed - the link isn't tried
+    theDriver.drop();
+    theDriver.ssid = "work";
+    CHECK(theConnect.connect());
+    CHECK(theDriver.calls == "begin-static reset join ");
+    CHECK(strcmp(theLink.ssid, "work") == 0);
+
+    // nothing works
+    theDriver.drop();
+    theDriver.bFastWorks = false;
+    theDriver.bJoinWorks = false;
+    CHECK(!theConnect.connect());
+    CHECK(theConnect.lastConnect() == sfeDLFastConnect::kConnectFailed);
+    CHECK(!theConnect.cached());
+    CHECK(theConnect.nFailed() == 1);
+}
+
+//---------------------------------------------------------------------------
+int main(void)
+{
+    testDriver theDriver;
+    sfeDLWiFiLink_t theLink;
+    memset(&theLink, 0xA5, sizeof(theLink));
+
+    sfeDLFastConnect theConnect;
+    theConnect.setDriver(&theDriver);
+    theConnect.attach(&theLink);
+
+    testFirstConnect(theDriver, theConnect, theLink);
+    testFastStatic(theDriver, theConnect, theLink);
+    testFastDHCP(theDriver, theConnect, theLink);
+    testFastFails(theDriver, theConnect, theLink);
+
+    if (_nFailed > 0)
+    {
+        printf("%d checks failed\n", _nFailed);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ *---------------------------------------------------------------------------------
+ *
+ * Copyright (c) 2022-2024, SparkFun Electronics Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ *---------------------------------------------------------------------------------
+ */
+
+/*
+ * Host test - sfeDLRTCBuffer
+ *
+ */
+
+#include "sfeDLRTCBuffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int _nFailed = 0;
+
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                            \
+            _nFailed++;                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+// The buffer header, as laid out in the memory block - two slots at the start
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t capacity;
+    uint32_t used;
+    uint16_t count;
+    uint16_t wakes;
+    uint32_t crc;
+} testHeader_t;
+
+const size_t kTestHeadersSize = 2 * sizeof(testHeader_t);
+
+static uint32_t _memory[1024];
+
+//---------------------------------------------------------------------------
+static testHeader_t *header(int slot)
+{
+    return (testHeader_t *)_memory + slot;
+}
+
+// the slot with the higher sequence - the current header
+static int currentSlot(void)
+{
+    return (int32_t)(header(1)->sequence - header(0)->sequence) > 0 ? 1 : 0;
+}
+
+static void sealHeader(testHeader_t *pHeader)
+{
+    pHeader->crc = sfeDLRTCBuffer::crc32((const uint8_t *)pHeader, offsetof(testHeader_t, crc));
+}
+
+static bool appendString(sfeDLRTCBuffer &theBuffer, const char *szText)
+{
+    return theBuffer.append('T', (const uint8_t *)szText, strlen(szText) + 1);
+}
+
+//---------------------------------------------------------------------------
+// The CRC matches zlib crc32()
+static void testCRC(void)
+{
+    CHECK(sfeDLRTCBuffer::crc32((const uint8_t *)"123456789", 9) == 0xCBF43926);
+    CHECK(sfeDLRTCBuffer::crc32((const uint8_t *)"", 0) == 0);
+}
+
+//---------------------------------------------------------------------------
+// Fill the buffer - append fails when full, and the records read back, in order, after a new attach
+static void testFull(void)
+{
+    memset(_memory, 0xA5, sizeof(_memory));
+
+    sfeDLRTCBuffer theBuffer;
+    CHECK(!theBuffer.attach(_memory, sizeof(_memory)));
+    CHECK(theBuffer.capacity() == sizeof(_memory) - kTestHeadersSize);
+    CHECK(theBuffer.count() == 0 && theBuffer.used() == 0);
+
+    char szText[32];
+    int nRecords = 0;
+    for (;;)
+    {
+        snprintf(szText, sizeof(szText), "record %d", nRecords);
+        if (!appendString(theBuffer, szText))
+            break;
+        nRecords++;
+    }
+    CHECK(nRecords > 0);
+    CHECK(theBuffer.count() == nRecords);
+    CHECK(theBuffer.capacity() - theBuffer.used() < sfeDLRTCBuffer::recordSize(strlen(szText) + 1));
+
+    // a record that fits the space left still goes in
+    size_t left = theBuffer.capacity() - theBuffer.used();
+    if (left >= sfeDLRTCBuffer::recordSize(0))
+    {
+        CHECK(theBuffer.append('E', nullptr, 0));
+        nRecords++;
+    }
+    CHECK(!theBuffer.append('E', nullptr, 0));
+
+    theBuffer.countWake();
+    theBuffer.countWake();
+
+    // after a sleep
+    sfeDLRTCBuffer theRestored;
+    CHECK(theRestored.attach(_memory, sizeof(_memory)));
+    CHECK(theRestored.count() == nRecords);
+    CHECK(theRestored.wakes() == 2);
+
+    size_t offset = 0;
+    uint8_t type;
+    const uint8_t *pData;
+    uint16_t length;
+    int nRead = 0;
+    while (theRestored.read(offset, type, pData, length))
+    {
+        if (type == 'T')
+        {
+            snprintf(szText, sizeof(szText), "record %d", nRead);
+            CHECK(length == strlen(szText) + 1 && strcmp((const char *)pData, szText) == 0);
+        }
+        nRead++;
+    }
+    CHECK(nRead == nRecords);
+    CHECK(offset == theRestored.used());
+
+    // clear empties the buffer and the wake count - and it's usable again
+    theRestored.clear();
+    CHECK(theRestored.count() == 0 && theRestored.used() == 0 && theRestored.wakes() == 0);
+    CHECK(appendString(theRestored, "after clear"));
+}
+
+//---------------------------------------------------------------------------
+// The header sequence wraps around - the header after 0xFFFFFFFF is still the current one
+static void testSequenceWrap(void)
+{
+    sfeDLRTCBuffer theBuffer;
+    theBuffer.attach(_memory, sizeof(_memory));
+    theBuffer.clear();
+    CHECK(appendString(theBuffer, "one"));
+
+    int current = currentSlot();
+    header(current ^ 1)->sequence = 0xFFFFFFFE;
+    sealHeader(header(current ^ 1));
+    header(current)->sequence = 0xFFFFFFFF;
+    sealHeader(header(current));
+
+    sfeDLRTCBuffer theWrapped;
+    CHECK(theWrapped.attach(_memory, sizeof(_memory)));
+    CHECK(theWrapped.count() == 1);
+
+    CHECK(appendString(theWrapped, "two"));
+    CHECK(header(0)->sequence == 0 || header(1)->sequence == 0);
+
+    sfeDLRTCBuffer theRestored;
+    CHECK(theRestored.attach(_memory, sizeof(_memory)));
+    CHECK(theRestored.count() == 2);
+}
+
+//---------------------------------------------------------------------------
+// A damaged record - reading stops there, with offset short of the used area
+static void testCorruptRecord(void)
+{
+    sfeDLRTCBuffer theBuffer;
+    theBuffer.attach(_memory, sizeof(_memory));
+    theBuffer.clear();
+
+    CHECK(appendString(theBuffer, "good"));
+    CHECK(appendString(theBuffer, "damaged"));
+    CHECK(appendString(theBuffer, "lost"));
+
+    // a byte in the data of the second record
+    uint8_t *pData = (uint8_t *)_memory + kTestHeadersSize + sfeDLRTCBuffer::recordSize(5);
+    pData[4] ^= 0xFF;
+
+    size_t offset = 0;
+    uint8_t type;
+    const uint8_t *pRecord;
+    uint16_t length;
+
+    CHECK(theBuffer.read(offset, type, pRecord, length));
+    CHECK(strcmp((const char *)pRecord, "good") == 0);
+
+    size_t damagedOffset = offset;
+    CHECK(!theBuffer.read(offset, type, pRecord, length));
+    CHECK(offset == damagedOffset);
+    CHECK(offset < theBuffer.used());
+}
+
+//---------------------------------------------------------------------------
+// A damaged current header (a brown out during the write) falls back to the previous one - losing the last
+// record only. With both headers damaged, the buffer starts over.
+static void testHeaderFallback(void)
+{
+    sfeDLRTCBuffer theBuffer;
+    theBuffer.attach(_memory, sizeof(_memory));
+    theBuffer.clear();
+
+    CHECK(appendString(theBuffer, "first"));
+    CHECK(appendString(theBuffer, "second"));
+
+    header(currentSlot())->used ^= 1;
+
+    sfeDLRTCBuffer theFallback;
+    CHECK(theFallback.attach(_memory, sizeof(_memory)));
+    CHECK(theFallback.count() == 1);
+
+    size_t offset = 0;
+    uint8_t type;
+    const uint8_t *pData;
+    uint16_t length;
+    CHECK(theFallback.read(offset, type, pData, length) && strcmp((const char *)pData, "first") == 0);
+    CHECK(!theFallback.read(offset, type, pData, length));
+    CHECK(offset == theFallback.used());
+
+    // the next update writes over the damaged slot
+    CHECK(appendString(theFallback, "third"));
+    sfeDLRTCBuffer theRestored;
+    CHECK(theRestored.attach(_memory, sizeof(_memory)));
+    CHECK(theRestored.count() == 2);
+
+    // both slots damaged
+    header(0)->magic = 0;
+    header(1)->crc ^= 1;
+
+    sfeDLRTCBuffer theCleared;
+    CHECK(!theCleared.attach(_memory, sizeof(_memory)));
+    CHECK(theCleared.count() == 0 && theCleared.used() == 0);
+    CHECK(appendString(theCleared, "new"));
+}
+
+//---------------------------------------------------------------------------
+int main(void)
+{
+    testCRC();
+    testFull();
+    testSequenceWrap();
+    testCorruptRecord();
+    testHeaderFallback();
+
+    if (_nFailed > 0)
+    {
+        printf("%d checks failed\n", _nFailed);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
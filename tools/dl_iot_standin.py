@@ -0,0 +1,334 @@
+#!/usr/bin/env python
+
+#--------------------------------------------------------------------------------
+#
+#
+# Copyright (c) 2022-2024, SparkFun Electronics Inc.
+#
+# SPDX-License-Identifier: MIT
+#
+#--------------------------------------------------------------------------------
+
+#
+# Local stand-in IoT servers for load testing the DataLogger IoT publish path - no cloud account needed.
+#
+#	dl_iot_standin.py http --port 8080 --latency 200 --loss 5
+#	dl_iot_standin.py mqtt --port 1883 --latency 300 --jitter 100 --disconnect-every 50
+#	dl_iot_standin.py sync --port 8080 --output synced --fail-after 10
+#
+# Point the DataLogger HTTP (or HTTP Keep-Alive) service at http://<host>:<port>/, or the MQTT service
+# at <host>:<port>. The sync server receives log file uploads from the Log File Sync - point its URL at
+# http://<host>:<port>/ - and writes each file to <output>/<device id>/<file name>. Add --certfile/--keyfile
+# to serve HTTPS/MQTTS (the DataLogger must then either have the matching CA certificate, or no CA
+# certificate set).
+#
+# Faults injected:
+#	--latency/--jitter	 delay (ms) before each response (HTTP response, MQTT CONNACK/PUBACK)
+#	--loss				 percent of messages that get no response - the connection is dropped
+#	--disconnect-every	 close the connection after every N messages
+#	--fail-after		 (sync) drop the connection, mid-file, after every N chunks
+#
+# A report is output every --report seconds - messages, throughput and injected faults. Run the
+# !iot-stats command on the DataLogger for the device side view - publish time percentiles, drops
+# and the heap high water mark.
+
+import argparse
+import asyncio
+import os
+import random
+import ssl
+import sys
+import time
+import zlib
+
+#----------------------------------------------------------------------------------------
+class dlStandinStats:
+
+	def __init__(self):
+		self.reset()
+		self.start = time.time()
+		self.total_messages = 0
+		self.total_bytes = 0
+
+	def reset(self):
+		self.interval_start = time.time()
+		self.messages = 0
+		self.bytes = 0
+		self.connections = 0
+		self.lost = 0
+		self.disconnects = 0
+
+	def report(self, name):
+		elapsed = max(time.time() - self.interval_start, 0.001)
+		self.total_messages += self.messages
+		self.total_bytes += self.bytes
+
+		print('{}: {:5d} msgs  {:7.2f} msgs/sec  {:9.1f} bytes/sec  connections: {:3d}  '
+			  'lost: {:3d}  disconnects: {:3d}  (total: {} msgs, {} bytes)'.format(
+			  name, self.messages, self.messages / elapsed, self.bytes / elapsed, self.connections,
+			  self.lost, self.disconnects, self.total_messages, self.total_bytes), flush=True)
+		self.reset()
+
+#----------------------------------------------------------------------------------------
+class dlStandin:
+
+	def __init__(self, args):
+		self.args = args
+		self.stats = dlStandinStats()
+
+	async def delay(self):
+		ms = self.args.latency + random.uniform(-self.args.jitter, self.args.jitter)
+		if ms > 0:
+			await asyncio.sleep(ms / 1000.)
+
+	def lose(self):
+		if random.uniform(0, 100) < self.args.loss:
+			self.stats.lost += 1
+			return True
+		return False
+
+	def disconnect(self, count):
+		if self.args.disconnect_every > 0 and count % self.args.disconnect_every == 0:
+			self.stats.disconnects += 1
+			return True
+		return False
+
+	def received(self, payload):
+		self.stats.messages += 1
+		self.stats.bytes += len(payload)
+		if self.args.echo:
+			print(payload.decode('utf-8', errors='replace'), flush=True)
+
+	async def handle(self, reader, writer):
+		self.stats.connections += 1
+		try:
+			await self.session(reader, writer)
+		except (asyncio.IncompleteReadError, ConnectionError, ValueError):
+			pass
+		finally:
+			writer.close()
+
+	async def reporter(self, name):
+		while True:
+			await asyncio.sleep(self.args.report)
+			self.stats.report(name)
+
+#----------------------------------------------------------------------------------------
+# HTTP stand-in - accepts POSTs, supports keep-alive
+
+class dlStandinHTTP(dlStandin):
+
+	async def session(self, reader, writer):
+		count = 0
+		while True:
+			request = await reader.readuntil(b'\r\n\r\n')
+			lines = request.decode('latin-1').split('\r\n')
+
+			# header names are lower cased
+			headers = {}
+			for line in lines[1:]:
+				name, _, value = line.partition(':')
+				if name:
+					headers[name.strip().lower()] = value.strip()
+
+			keep_alive = headers.get('connection', 'keep-alive' if lines[0].endswith('HTTP/1.1') else 'close')
+			keep_alive = keep_alive.lower() == 'keep-alive'
+
+			payload = await reader.readexactly(int(headers.get('content-length', 0)))
+			self.received(payload)
+			count += 1
+
+			if self.lose():
+				return
+
+			status, extra = self.respond(headers, payload, count)
+			if status is None:
+				return
+
+			await self.delay()
+
+			close = not keep_alive or self.disconnect(count)
+			writer.write('HTTP/1.1 {}\r\nContent-Length: 0\r\n{}Connection: {}\r\n\r\n'.format(status,
+						 ''.join('{}: {}\r\n'.format(k, v) for k, v in extra.items()),
+						 'close' if close else 'keep-alive').encode('latin-1'))
+			await writer.drain()
+			if close:
+				return
+
+	# returns the response status and extra headers - a status of None drops the connection
+	def respond(self, headers, payload, count):
+		return '200 OK', {}
+
+#----------------------------------------------------------------------------------------
+# Log file sync server - appends each chunk to its file, checking the offset and CRC32
+
+class dlStandinSync(dlStandinHTTP):
+
+	def __init__(self, args):
+		super().__init__(args)
+		self.chunks = 0
+		self.resumes = 0
+		self.crc_errors = 0
+		self.files = 0
+
+	def respond(self, headers, payload, count):
+		try:
+			device = os.path.basename(headers['x-dl-device'])
+			filename = os.path.basename(headers['x-dl-file'])
+			file_size = int(headers['x-dl-file-size'])
+			offset = int(headers['x-dl-offset'])
+			crc = int(headers['x-dl-crc32'], 16)
+		except (KeyError, ValueError):
+			return '400 Bad Request', {}
+
+		self.chunks += 1
+		if self.args.fail_after > 0 and self.chunks % self.args.fail_after == 0:
+			self.stats.disconnects += 1
+			return None, {}
+
+		path = os.path.join(self.args.output, device or 'unknown', filename)
+		os.makedirs(os.path.dirname(path), exist_ok=True)
+		current = os.path.getsize(path) if os.path.exists(path) else 0
+
+		if offset != current:
+			self.resumes += 1
+			print('SYNC: {} - offset {}, expected {}'.format(filename, offset, current), flush=True)
+			return '409 Conflict', {'X-DL-Offset': current}
+
+		if zlib.crc32(payload) != crc:
+			self.crc_errors += 1
+			print('SYNC: {} - CRC mismatch at offset {}'.format(filename, offset), flush=True)
+			return '422 Unprocessable Entity', {}
+
+		with open(path, 'ab') as f:
+			f.write(payload)
+
+		if current + len(payload) >= file_size:
+			self.files += 1
+			print('SYNC: {} - complete, {} bytes'.format(filename, file_size), flush=True)
+
+		return '200 OK', {}
+
+	async def reporter(self, name):
+		while True:
+			await asyncio.sleep(self.args.report)
+			print('{}: files: {}  chunks: {}  resumes: {}  CRC errors: {}'.format(name, self.files, self.chunks,
+				  self.resumes, self.crc_errors), flush=True)
+			self.stats.report(name)
+
+#----------------------------------------------------------------------------------------
+# MQTT stand-in - minimal MQTT 3.1.1 broker. Acknowledges, but doesn't forward, publishes.
+
+class dlStandinMQTT(dlStandin):
+
+	async def read_packet(self, reader):
+		header = (await reader.readexactly(1))[0]
+
+		length = 0
+		for shift in range(0, 28, 7):
+			byte = (await reader.readexactly(1))[0]
+			length |= (byte & 0x7f) << shift
+			if byte & 0x80 == 0:
+				break
+
+		return header, await reader.readexactly(length)
+
+	async def session(self, reader, writer):
+		count = 0
+		while True:
+			header, body = await self.read_packet(reader)
+			packet_type = header >> 4
+
+			if packet_type == 1:	# CONNECT
+				await self.delay()
+				writer.write(bytes([0x20, 0x02, 0x00, 0x00]))
+
+			elif packet_type == 3:	# PUBLISH
+				qos = (header >> 1) & 0x03
+				topic_length = int.from_bytes(body[0:2], 'big')
+				pos = 2 + topic_length
+				packet_id = body[pos:pos+2]
+				if qos > 0:
+					pos += 2
+
+				self.received(body[pos:])
+				count += 1
+
+				if self.lose():
+					return
+				if qos > 0:
+					await self.delay()
+					writer.write(bytes([0x40 if qos == 1 else 0x50, 0x02]) + packet_id)
+				if self.disconnect(count):
+					await writer.drain()
+					return
+
+			elif packet_type == 6:	# PUBREL
+				writer.write(bytes([0x70, 0x02]) + body[0:2])
+
+			elif packet_type == 8:	# SUBSCRIBE - grant QoS 0 to each topic
+				n_topics = 0
+				pos = 2
+				while pos < len(body):
+					pos += 2 + int.from_bytes(body[pos:pos+2], 'big') + 1
+					n_topics += 1
+				writer.write(bytes([0x90, 2 + n_topics]) + body[0:2] + bytes(n_topics))
+
+			elif packet_type == 12:	# PINGREQ
+				writer.write(bytes([0xd0, 0x00]))
+
+			elif packet_type == 14:	# DISCONNECT
+				return
+
+			await writer.drain()
+
+#----------------------------------------------------------------------------------------
+async def _dl_iot_standin_run(args):
+
+	standins = {'http': dlStandinHTTP, 'mqtt': dlStandinMQTT, 'sync': dlStandinSync}
+	standin = standins[args.protocol](args)
+
+	context = None
+	if args.certfile:
+		context = ssl.create_default_context(ssl.Purpose.CLIENT_AUTH)
+		context.load_cert_chain(args.certfile, args.keyfile)
+
+	server = await asyncio.start_server(standin.handle, args.host, args.port, ssl=context)
+
+	print('{} stand-in listening on {}:{}{}'.format(args.protocol.upper(), args.host, args.port,
+		  ' (TLS)' if context else ''), flush=True)
+
+	asyncio.ensure_future(standin.reporter(args.protocol.upper()))
+
+	async with server:
+		await server.serve_forever()
+
+#----------------------------------------------------------------------------------------
+def dl_iot_standin():
+
+	parser = argparse.ArgumentParser(description='Local HTTP/MQTT/sync stand-in servers for DataLogger IoT testing')
+	parser.add_argument('protocol', choices=['http', 'mqtt', 'sync'], help='server type')
+	parser.add_argument('--host', default='0.0.0.0', help='address to listen on')
+	parser.add_argument('--port', type=int, help='port to listen on (default: 8080 for http and sync, 1883 for mqtt)')
+	parser.add_argument('--certfile', help='TLS certificate - enables HTTPS/MQTTS')
+	parser.add_argument('--keyfile', help='TLS private key')
+	parser.add_argument('--latency', type=float, default=0, help='response delay (ms)')
+	parser.add_argument('--jitter', type=float, default=0, help='random +/- variation of the delay (ms)')
+	parser.add_argument('--loss', type=float, default=0, help='percent of messages not responded to')
+	parser.add_argument('--disconnect-every', type=int, default=0, help='close the connection every N messages')
+	parser.add_argument('--fail-after', type=int, default=0, help='(sync) drop the connection every N chunks')
+	parser.add_argument('--output', default='synced', help='(sync) directory synced files are written to')
+	parser.add_argument('--report', type=float, default=10, help='report interval (secs)')
+	parser.add_argument('--echo', action='store_true', help='output received payloads')
+	args = parser.parse_args()
+
+	if args.port is None:
+		args.port = 1883 if args.protocol == 'mqtt' else 8080
+
+	try:
+		asyncio.run(_dl_iot_standin_run(args))
+	except KeyboardInterrupt:
+		pass
+
+if __name__ == '__main__':
+	dl_iot_standin()
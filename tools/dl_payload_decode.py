@@ -0,0 +1,182 @@
+#!/usr/bin/env python
+
+#--------------------------------------------------------------------------------
+#
+#
+# Copyright (c) 2022-2024, SparkFun Electronics Inc.
+#
+# SPDX-License-Identifier: MIT
+#
+#--------------------------------------------------------------------------------
+
+#
+# Decode compact (key dictionary) DataLogger IoT payloads back to the full JSON observation form.
+#
+# Input is read from stdin (or a file), one payload per line - for example the output of
+#
+#	mosquitto_sub -t <topic>
+#
+# Dictionary payloads are learned as they arrive. Full JSON payloads pass through unchanged. Lines
+# prefixed with "msgpack:" are taken as hex encoded MessagePack.
+#
+# Output is one full JSON observation per line.
+
+import argparse
+import json
+import struct
+import sys
+
+#----------------------------------------------------------------------------------------
+# Minimal MessagePack decoder - covers the types ArduinoJson outputs
+
+def _mp_decode(data, pos):
+
+	b = data[pos]
+	pos += 1
+
+	if b <= 0x7f:
+		return b, pos
+	if b >= 0xe0:
+		return b - 0x100, pos
+	if 0x80 <= b <= 0x8f:
+		return _mp_map(data, pos, b & 0x0f)
+	if 0x90 <= b <= 0x9f:
+		return _mp_array(data, pos, b & 0x0f)
+	if 0xa0 <= b <= 0xbf:
+		n = b & 0x1f
+		return data[pos:pos+n].decode('utf-8'), pos + n
+
+	if b == 0xc0:
+		return None, pos
+	if b == 0xc2:
+		return False, pos
+	if b == 0xc3:
+		return True, pos
+
+	sizes = {0xca: ('>f', 4), 0xcb: ('>d', 8),
+			 0xcc: ('>B', 1), 0xcd: ('>H', 2), 0xce: ('>I', 4), 0xcf: ('>Q', 8),
+			 0xd0: ('>b', 1), 0xd1: ('>h', 2), 0xd2: ('>i', 4), 0xd3: ('>q', 8)}
+	if b in sizes:
+		fmt, n = sizes[b]
+		return struct.unpack(fmt, data[pos:pos+n])[0], pos + n
+
+	lengths = {0xd9: 1, 0xda: 2, 0xdb: 4, 0xdc: 2, 0xdd: 4, 0xde: 2, 0xdf: 4}
+	if b in lengths:
+		n = lengths[b]
+		count = int.from_bytes(data[pos:pos+n], 'big')
+		pos += n
+		if b in (0xd9, 0xda, 0xdb):
+			return data[pos:pos+count].decode('utf-8'), pos + count
+		if b in (0xdc, 0xdd):
+			return _mp_array(data, pos, count)
+		return _mp_map(data, pos, count)
+
+	raise ValueError('Unsupported MessagePack type: 0x{:02x}'.format(b))
+
+def _mp_array(data, pos, count):
+	result = []
+	for i in range(count):
+		value, pos = _mp_decode(data, pos)
+		result.append(value)
+	return result, pos
+
+def _mp_map(data, pos, count):
+	result = {}
+	for i in range(count):
+		key, pos = _mp_decode(data, pos)
+		value, pos = _mp_decode(data, pos)
+		result[key] = value
+	return result, pos
+
+def msgpack_decode(data):
+	value, pos = _mp_decode(data, 0)
+	return value
+
+#----------------------------------------------------------------------------------------
+# Payload decoder
+
+class dlPayloadDecoder:
+
+	def __init__(self):
+		self._dictionaries = {}
+
+	#------------------------------------------------------------------------------------
+	# learn a dictionary payload
+	def add_dictionary(self, payload):
+		self._dictionaries[payload['dictionary']] = payload['sections']
+
+	#------------------------------------------------------------------------------------
+	# decode a single compact observation
+	def _decode_observation(self, sections, observation):
+
+		result = {}
+		for entry in observation:
+			section = sections[entry[0]]
+			if len(section['params']) == 0:
+				result[section['name']] = entry[1] if len(entry) > 1 else None
+				continue
+
+			values = {}
+			for name, value in zip(section['params'], entry[1:]):
+				if value is not None:
+					values[name] = value
+			result[section['name']] = values
+		return result
+
+	#------------------------------------------------------------------------------------
+	# decode a payload - returns a list of full observations. Dictionaries return an empty list.
+	def decode(self, payload):
+
+		if 'dictionary' in payload:
+			self.add_dictionary(payload)
+			return []
+
+		# batch?
+		if 'observations' in payload:
+			results = []
+			for obs in payload['observations']:
+				results += self.decode(obs)
+			return results
+
+		if 'dv' not in payload:
+			return [payload]
+
+		sections = self._dictionaries.get(payload['dv'])
+		if sections is None:
+			raise KeyError('No dictionary received for version {}'.format(payload['dv']))
+
+		return [self._decode_observation(sections, payload['o'])]
+
+#----------------------------------------------------------------------------------------
+def dl_payload_decode():
+
+	parser = argparse.ArgumentParser(description='Decode compact DataLogger IoT payloads to JSON')
+	parser.add_argument('file', nargs='?', type=argparse.FileType('r'), default=sys.stdin,
+						help='file of payloads, one per line (default: stdin)')
+	parser.add_argument('-d', '--dictionary', type=argparse.FileType('r'),
+						help='file holding a previously captured dictionary payload')
+	args = parser.parse_args()
+
+	decoder = dlPayloadDecoder()
+
+	if args.dictionary:
+		decoder.add_dictionary(json.load(args.dictionary))
+
+	for line in args.file:
+		line = line.strip()
+		if len(line) == 0:
+			continue
+		try:
+			if line.startswith('msgpack:'):
+				payload = msgpack_decode(bytes.fromhex(line[8:]))
+			else:
+				payload = json.loads(line)
+
+			for obs in decoder.decode(payload):
+				print(json.dumps(obs))
+
+		except (ValueError, KeyError, IndexError) as err:
+			print('Unable to decode payload: {}'.format(err), file=sys.stderr)
+
+if __name__ == '__main__':
+	dl_payload_decode()
@@ -0,0 +1,167 @@
+#!/usr/bin/env python
+
+#--------------------------------------------------------------------------------
+#
+#
+# Copyright (c) 2022-2024, SparkFun Electronics Inc.
+#
+# SPDX-License-Identifier: MIT
+#
+#--------------------------------------------------------------------------------
+
+#
+# Host simulation of the DataLogger "WiFi On Demand" radio state machine (sfeDLRadioManager). Reports the
+# radio on time per hour and the energy per observation, for WiFi always on and on demand, so the settings
+# can be tuned before a battery deployment.
+#
+#	dl_radio_sim.py --log-interval 60 --batch 30 --upload-interval 1800
+#	dl_radio_sim.py --log-interval 15 --alarms-per-hour 2 --hours 72
+#
+# The state machine is stepped once a second, as on the device:
+#
+#	Off -> Connecting		batch size, upload interval or an alarm
+#	Connecting -> Draining	connected (after --connect-time)
+#	Draining -> Off			held payloads sent and the min connected time passed, or the window timed out
+#
+# The current figures are estimates - set them for the board and network at hand. On hardware, compare the
+# battery change rate reported by !radio-stats.
+
+import argparse
+import random
+
+# Radio states - match sfeDLRadioManager
+kRadioOn = 0
+kRadioOff = 1
+kRadioConnecting = 2
+kRadioDraining = 3
+
+#----------------------------------------------------------------------------------------
+class dlRadioSim:
+
+	def __init__(self, args, on_demand):
+		self.args = args
+		self.on_demand = on_demand
+		self.random = random.Random(args.seed)
+
+		self.state = kRadioOff if on_demand else kRadioOn
+		self.window_start = 0
+		self.connected_at = 0
+		self.last_window = 0
+		self.window_requested = on_demand	# the first window sets the clock
+		self.queued = 0
+		self.held = 0
+
+		self.observations = 0
+		self.windows = 0
+		self.timeouts = 0
+		self.radio_on = 0.
+		self.radio_active = 0.
+
+	# seconds of radio activity to send n payloads
+	def send(self, n):
+		secs = n * self.args.publish_time / 1000.
+		self.radio_active += secs
+		return secs
+
+	def step(self, t):
+		args = self.args
+
+		# log an observation - one payload per service
+		if t % args.log_interval == 0:
+			self.observations += 1
+			if self.state == kRadioOn:
+				self.send(args.services)
+			else:
+				self.queued += 1
+				self.held += args.services
+
+		if args.alarms_per_hour > 0 and self.random.random() < args.alarms_per_hour / 3600.:
+			self.window_requested = True
+
+		if self.state == kRadioOn:
+			self.radio_on += 1
+			return
+
+		if self.state != kRadioOff:
+			self.radio_on += 1
+
+		timeout = t - self.window_start >= args.window_timeout
+
+		if self.state == kRadioOff:
+			if self.window_requested or self.queued >= args.batch or t - self.last_window >= args.upload_interval:
+				self.windows += 1
+				self.window_start = t
+				self.window_requested = False
+				self.state = kRadioConnecting
+				self.radio_active += args.connect_time
+
+		elif self.state == kRadioConnecting:
+			if t - self.window_start >= args.connect_time:
+				self.connected_at = t
+				self.state = kRadioDraining
+			elif timeout:
+				self.radio_down(t, True)
+
+		elif self.state == kRadioDraining:
+			# the delivery task sends as many held payloads as fit in a second
+			n = min(self.held, int(1000 / args.publish_time) if args.publish_time > 0 else self.held)
+			self.send(n)
+			self.held -= n
+
+			if timeout:
+				self.radio_down(t, True)
+			elif t - self.connected_at >= args.min_connected and self.held == 0:
+				self.radio_down(t, False)
+
+	def radio_down(self, t, timed_out):
+		if timed_out:
+			self.timeouts += 1
+		self.last_window = t
+		self.queued = 0
+		self.state = kRadioOff
+
+	def run(self):
+		for t in range(int(self.args.hours * 3600)):
+			self.step(t)
+		return self
+
+	def report(self, name):
+		args = self.args
+		hours = args.hours
+
+		# charge (mAh): base system, radio connected idle, and radio transmitting
+		idle = max(self.radio_on - self.radio_active, 0.)
+		mah = (args.i_base * hours * 3600. + args.i_radio_idle * idle + args.i_radio_active * self.radio_active) / 3600.
+		mwh = mah * args.voltage
+
+		print('{:10s} radio on: {:7.1f} secs/hour  windows: {:5d}  timeouts: {:3d}  observations: {:6d}  '
+			  'energy: {:7.1f} mWh  per observation: {:6.3f} mWh  avg current: {:5.1f} mA'.format(
+			  name, self.radio_on / hours, self.windows, self.timeouts, self.observations, mwh,
+			  mwh / max(self.observations, 1), mah / hours))
+
+#----------------------------------------------------------------------------------------
+def dl_radio_sim():
+
+	parser = argparse.ArgumentParser(description='Simulate the DataLogger WiFi on demand radio state machine')
+	parser.add_argument('--hours', type=float, default=24, help='time simulated (hours)')
+	parser.add_argument('--log-interval', type=int, default=60, help='secs between observations')
+	parser.add_argument('--services', type=int, default=1, help='IoT services enabled - payloads per observation')
+	parser.add_argument('--batch', type=int, default=30, help='Batch Size - observations that open a window')
+	parser.add_argument('--upload-interval', type=int, default=900, help='Upload Interval (secs)')
+	parser.add_argument('--window-timeout', type=int, default=90, help='Window Timeout (secs)')
+	parser.add_argument('--min-connected', type=int, default=10, help='min secs connected - for NTP')
+	parser.add_argument('--alarms-per-hour', type=float, default=0, help='event triggered windows per hour')
+	parser.add_argument('--connect-time', type=float, default=3, help='secs to associate and get an address')
+	parser.add_argument('--publish-time', type=float, default=250, help='ms to publish one payload')
+	parser.add_argument('--i-base', type=float, default=35, help='system current, radio off (mA)')
+	parser.add_argument('--i-radio-idle', type=float, default=45, help='added current, radio connected (mA)')
+	parser.add_argument('--i-radio-active', type=float, default=110, help='added current, radio sending (mA)')
+	parser.add_argument('--voltage', type=float, default=3.7, help='battery voltage')
+	parser.add_argument('--seed', type=int, default=1, help='random seed for the alarms')
+	args = parser.parse_args()
+
+	dlRadioSim(args, False).run().report('Always On')
+	dlRadioSim(args, True).run().report('On Demand')
+
+if __name__ == '__main__':
+	dl_radio_sim()
@@ -0,0 +1,230 @@
+#!/usr/bin/env python
+
+#--------------------------------------------------------------------------------
+#
+#
+# Copyright (c) 2022-2024, SparkFun Electronics Inc.
+#
+# SPDX-License-Identifier: MIT
+#
+#--------------------------------------------------------------------------------
+
+#
+# Capture the DataLogger "Binary Frames" serial output to CSV (or JSON lines).
+#
+#	dl_serial_capture.py --port /dev/ttyUSB0 --baud 500000 --output capture.csv
+#	dl_serial_capture.py --input capture.bin --output capture.jsonl --format jsonl
+#
+# --port needs pyserial. --input reads a raw stream saved earlier (--save writes one).
+#
+# Frames are COBS encoded between 0x00 delimiters, with a CRC32. Each data frame carries the ID of the
+# schema frame that names and types its values - the device repeats the schema, so a capture can start
+# mid-stream. Console text between frames is skipped (--text echoes it to stderr). The frame sequence
+# numbers show frames lost - to a full device buffer, or on the wire.
+#
+# CSV output starts a new header row when the schema changes.
+
+import argparse
+import csv
+import json
+import struct
+import sys
+import time
+import zlib
+
+# value types - struct format of each
+kValueTypes = {'b': '<B', 'i': '<i', 'f': '<f', 'd': '<d'}
+
+#----------------------------------------------------------------------------------------
+def cobs_decode(data):
+
+	out = bytearray()
+	pos = 0
+	while pos < len(data):
+		code = data[pos]
+		if code == 0 or pos + code > len(data):
+			raise ValueError('bad COBS block')
+		out += data[pos+1:pos+code]
+		pos += code
+		if code < 0xff and pos < len(data):
+			out.append(0)
+	return bytes(out)
+
+#----------------------------------------------------------------------------------------
+class dlFrameDecoder:
+
+	def __init__(self):
+		self.schemas = {}
+		self.next_seq = None
+		self.frames = 0
+		self.schema_frames = 0
+		self.samples = 0
+		self.lost = 0
+		self.restarts = 0
+		self.crc_errors = 0
+		self.unsynced = 0
+		self.text = 0
+
+	# track the sequence number of each frame
+	def sequence(self, seq):
+		if self.next_seq is not None and seq != self.next_seq:
+			gap = (seq - self.next_seq) & 0xffff
+			if gap < 0x8000:
+				self.lost += gap
+			else:
+				self.restarts += 1		# went backwards - the device restarted
+		self.next_seq = (seq + 1) & 0xffff
+
+	# decode a segment of the stream - returns ('data', (schema id, millis, fields, values)), ('text', text) or None
+	def decode(self, segment):
+
+		try:
+			frame = cobs_decode(segment)
+		except ValueError:
+			frame = b''
+
+		if len(frame) < 7 or zlib.crc32(frame[:-4]) != struct.unpack('<I', frame[-4:])[0]:
+			# console output between frames - or a damaged frame
+			if all(0x20 <= b < 0x7f or b in b'\r\n\t' for b in segment):
+				self.text += 1
+				return 'text', segment.decode('ascii')
+			self.crc_errors += 1
+			return None
+
+		frame_type = chr(frame[0])
+		seq, schema_id = struct.unpack('<HH', frame[1:5])
+		self.frames += 1
+		self.sequence(seq)
+
+		if frame_type == 'S':
+			self.schema_frames += 1
+			version, n_fields = struct.unpack('<BH', frame[5:8])
+			pos = 8
+			fields = []
+			for i in range(n_fields):
+				ftype = chr(frame[pos])
+				n = frame[pos+1]
+				fields.append((ftype, frame[pos+2:pos+2+n].decode('utf-8')))
+				pos += 2 + n
+			self.schemas[schema_id] = fields
+			return None
+
+		if frame_type != 'D':
+			return None
+
+		fields = self.schemas.get(schema_id)
+		if fields is None:
+			self.unsynced += 1		# waiting for the schema
+			return None
+
+		millis = struct.unpack('<I', frame[5:9])[0]
+		pos = 9
+		values = []
+		for ftype, name in fields:
+			if ftype == 's':
+				n = frame[pos]
+				values.append(frame[pos+1:pos+1+n].decode('utf-8', 'replace'))
+				pos += 1 + n
+			else:
+				fmt = kValueTypes[ftype]
+				values.append(struct.unpack(fmt, frame[pos:pos+struct.calcsize(fmt)])[0])
+				pos += struct.calcsize(fmt)
+
+		self.samples += 1
+		return 'data', (schema_id, millis, fields, values)
+
+	def report(self, n_bytes, secs):
+		return ('frames: {}  schema frames: {}  samples: {} ({:.1f}/sec)  lost: {}  crc errors: {}  unsynced: {}  '
+				'restarts: {}  text: {}  bytes: {} ({:.0f}/sec)').format(self.frames, self.schema_frames,
+				self.samples, self.samples / secs, self.lost, self.crc_errors, self.unsynced, self.restarts,
+				self.text, n_bytes, n_bytes / secs)
+
+#----------------------------------------------------------------------------------------
+def _dl_open_input(args):
+
+	if args.input:
+		return open(args.input, 'rb')
+
+	import serial
+	return serial.Serial(args.port, args.baud, timeout=0.5)
+
+#----------------------------------------------------------------------------------------
+def dl_serial_capture():
+
+	parser = argparse.ArgumentParser(description='Capture DataLogger binary serial frames')
+	source = parser.add_mutually_exclusive_group(required=True)
+	source.add_argument('--port', help='serial port of the DataLogger')
+	source.add_argument('--input', help='raw stream file to decode')
+	parser.add_argument('--baud', type=int, default=115200, help='serial baud rate')
+	parser.add_argument('--output', help='output file (default stdout)')
+	parser.add_argument('--format', choices=['csv', 'jsonl'], default='csv', help='output format')
+	parser.add_argument('--save', help='also save the raw stream to this file')
+	parser.add_argument('--text', action='store_true', help='echo console text to stderr')
+	parser.add_argument('--report', type=float, default=10, help='report interval (secs)')
+	args = parser.parse_args()
+
+	source = _dl_open_input(args)
+	output = open(args.output, 'w') if args.output else sys.stdout
+	raw = open(args.save, 'wb') if args.save else None
+
+	decoder = dlFrameDecoder()
+	writer = csv.writer(output, lineterminator='\n')
+	current_schema = None
+	pending = bytearray()
+	n_bytes = 0
+	start = time.time()
+	next_report = start + args.report
+
+	try:
+		while True:
+			data = source.read(4096)
+			if not data:
+				if args.input:
+					break
+				continue
+
+			n_bytes += len(data)
+			if raw:
+				raw.write(data)
+
+			pending += data
+			segments = pending.split(b'\x00')
+			pending = segments.pop()		# incomplete - wait for its delimiter
+
+			for segment in segments:
+				if not segment:
+					continue
+				result = decoder.decode(bytes(segment))
+				if not result:
+					continue
+
+				kind, value = result
+				if kind == 'text':
+					if args.text:
+						print(value, end='', file=sys.stderr)
+					continue
+
+				schema_id, millis, fields, values = value
+				if args.format == 'jsonl':
+					obs = {'millis': millis}
+					obs.update({name: v for (ftype, name), v in zip(fields, values)})
+					print(json.dumps(obs), file=output)
+					continue
+
+				if schema_id != current_schema:
+					current_schema = schema_id
+					writer.writerow(['millis'] + [name for ftype, name in fields])
+				writer.writerow([millis] + values)
+
+			if time.time() >= next_report:
+				next_report = time.time() + args.report
+				print(decoder.report(n_bytes, time.time() - start), file=sys.stderr, flush=True)
+
+	except KeyboardInterrupt:
+		pass
+
+	output.flush()
+	print(decoder.report(n_bytes, max(time.time() - start, 0.001)), file=sys.stderr)
+
+if __name__ == '__main__':
+	dl_serial_capture()
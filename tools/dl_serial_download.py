@@ -0,0 +1,188 @@
+#!/usr/bin/env python
+
+#--------------------------------------------------------------------------------
+#
+#
+# Copyright (c) 2022-2024, SparkFun Electronics Inc.
+#
+# SPDX-License-Identifier: MIT
+#
+#--------------------------------------------------------------------------------
+
+#
+# Download a file from the DataLogger SD card over the serial console - needs pyserial.
+#
+#	dl_serial_download.py --port /dev/ttyUSB0 --baud 115200 sfe0004.txt
+#	dl_serial_download.py --port /dev/ttyUSB0 sfe0004.txt --output logs/sfe0004.txt
+#
+# Sends the !download command, then requests the file a window of blocks at a time. Each block is CRC
+# checked - lost or damaged blocks are requested again. If the output file exists, it's checked against
+# the start of the device file, and the download resumes from its end (--restart to start over).
+#
+# Logging on the device continues during the download.
+
+import argparse
+import os
+import struct
+import sys
+import time
+import zlib
+
+from dl_serial_capture import cobs_decode
+
+#----------------------------------------------------------------------------------------
+class dlFrameReader:
+
+	def __init__(self, port):
+		self.port = port
+		self.pending = bytearray()
+		self.frames = []
+		self.crc_errors = 0
+
+	# next valid frame - None on timeout. Console text and damaged frames are skipped
+	def read(self, timeout):
+
+		deadline = time.time() + timeout
+		while not self.frames:
+			if time.time() >= deadline:
+				return None
+
+			data = self.port.read(4096)
+			if not data:
+				continue
+
+			self.pending += data
+			segments = self.pending.split(b'\x00')
+			self.pending = segments.pop()
+
+			for segment in segments:
+				try:
+					frame = cobs_decode(bytes(segment))
+				except ValueError:
+					continue
+				if len(frame) < 5:
+					continue
+				if zlib.crc32(frame[:-4]) != struct.unpack('<I', frame[-4:])[0]:
+					self.crc_errors += 1
+					continue
+				self.frames.append(frame[:-4])
+
+		return self.frames.pop(0)
+
+	def command(self, text):
+		self.port.write((text + '\n').encode('ascii'))
+
+#----------------------------------------------------------------------------------------
+# check a partial download against the device file - returns the offset to resume from
+
+def _dl_resume_offset(reader, output, size):
+
+	if not os.path.exists(output):
+		return 0
+
+	length = os.path.getsize(output)
+	if length == 0 or length > size:
+		return 0
+
+	reader.command('V {}'.format(length))
+	while True:
+		frame = reader.read(30)		# the device reads the file to check it
+		if frame is None:
+			return 0
+		if frame[:1] == b'V':
+			break
+
+	v_length, v_crc = struct.unpack('<II', frame[1:9])
+	with open(output, 'rb') as f:
+		local_crc = zlib.crc32(f.read(length))
+
+	if v_length != length or v_crc != local_crc:
+		print('{} does not match the device file - starting over'.format(output), file=sys.stderr)
+		return 0
+
+	print('Resuming at {} bytes'.format(length), file=sys.stderr)
+	return length
+
+#----------------------------------------------------------------------------------------
+def dl_serial_download():
+
+	parser = argparse.ArgumentParser(description='Download a file from the DataLogger over the serial console')
+	parser.add_argument('file', help='file on the DataLogger SD card')
+	parser.add_argument('--port', required=True, help='serial port of the DataLogger')
+	parser.add_argument('--baud', type=int, default=115200, help='serial baud rate')
+	parser.add_argument('--output', help='output file (default - the file name)')
+	parser.add_argument('--restart', action='store_true', help='start over - don\'t resume a partial download')
+	parser.add_argument('--timeout', type=float, default=2, help='time to wait for a block (secs)')
+	args = parser.parse_args()
+
+	import serial
+	port = serial.Serial(args.port, args.baud, timeout=0.05)
+	port.reset_input_buffer()
+
+	reader = dlFrameReader(port)
+	port.write('!download {}\r'.format(args.file).encode('ascii'))
+
+	while True:
+		frame = reader.read(10)
+		if frame is None:
+			sys.exit('No response from the DataLogger - is the console in use, or the file name wrong?')
+		if frame[:1] == b'H':
+			break
+
+	version, size, block_size, window = struct.unpack('<BIHB', frame[1:9])
+	name = frame[9:].decode('utf-8')
+	output = args.output or os.path.basename(name)
+
+	offset = 0 if args.restart else _dl_resume_offset(reader, output, size)
+	resume_at = offset
+
+	out = open(output, 'r+b' if offset > 0 else 'wb')
+	out.seek(offset)
+	out.truncate()
+
+	start = time.time()
+	n_windows = 0
+	n_timeouts = 0
+	n_out_of_order = 0
+
+	while offset < size:
+		reader.command('G {}'.format(offset))
+		n_windows += 1
+
+		window_end = min(size, offset + window * block_size)
+		while True:
+			frame = reader.read(args.timeout)
+			if frame is None:
+				n_timeouts += 1
+				break
+			if frame[:1] == b'E':
+				break
+			if frame[:1] != b'B':
+				continue
+
+			block_offset = struct.unpack('<I', frame[1:5])[0]
+			data = frame[5:]
+			if block_offset == offset:
+				out.write(data)
+				offset += len(data)
+			elif block_offset > offset:
+				n_out_of_order += 1		# a block was lost before this one - it's requested again
+
+			# the last block of the window?
+			if block_offset + len(data) >= window_end:
+				break
+
+		print('\r{}: {} / {} bytes'.format(name, offset, size), end='', file=sys.stderr, flush=True)
+
+	reader.command('Q')
+	out.close()
+
+	secs = max(time.time() - start, 0.001)
+	rate = (offset - resume_at) / secs
+	print('\n{} bytes in {:.1f} secs - {:.0f} bytes/sec, {:.0f}% of the {} baud limit'.format(offset - resume_at,
+		  secs, rate, rate / (args.baud / 10) * 100, args.baud), file=sys.stderr)
+	print('windows: {}  timeouts: {}  out of order blocks: {}  crc errors: {}'.format(n_windows, n_timeouts,
+		  n_out_of_order, reader.crc_errors), file=sys.stderr)
+
+if __name__ == '__main__':
+	dl_serial_download()
@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+
+#--------------------------------------------------------------------------------
+#
+#
+# Copyright (c) 2022-2024, SparkFun Electronics Inc.
+#
+# SPDX-License-Identifier: MIT
+#
+#--------------------------------------------------------------------------------
+
+#
+# Listener for the DataLogger "UDP Telemetry" IoT service - a minimal local collector.
+#
+#	dl_udp_listen.py --port 5005
+#	dl_udp_listen.py --port 5005 --echo
+#
+# Datagrams are JSON or MessagePack (detected per datagram):
+#
+#	{"seq":<sequence number>,"dev":"<device id>","p":[<payload>, ...]}
+#
+# The sequence number of each device is tracked to count lost, duplicate and out of order datagrams. With
+# --echo, each payload is output as full JSON observations, one per line - compact payloads are decoded
+# with the key dictionary, as dl_payload_decode.py does.
+
+import argparse
+import json
+import socket
+import sys
+import time
+
+from dl_payload_decode import dlPayloadDecoder, msgpack_decode
+
+#----------------------------------------------------------------------------------------
+class dlUDPDevice:
+
+	def __init__(self):
+		self.decoder = dlPayloadDecoder()
+		self.next_seq = None
+		self.datagrams = 0
+		self.payloads = 0
+		self.lost = 0
+		self.duplicates = 0
+		self.out_of_order = 0
+		self.restarts = 0
+
+	# track the sequence number - returns False for a duplicate datagram
+	def sequence(self, seq):
+		if self.next_seq is None or seq == self.next_seq:
+			pass
+		elif seq == 0:
+			self.restarts += 1		# the device restarted
+		elif seq > self.next_seq:
+			self.lost += seq - self.next_seq
+		elif seq == self.next_seq - 1:
+			self.duplicates += 1
+			return False
+		else:
+			# a late datagram - it was counted as lost
+			self.out_of_order += 1
+			self.lost = max(self.lost - 1, 0)
+			return True
+		self.next_seq = seq + 1
+		return True
+
+#----------------------------------------------------------------------------------------
+def _dl_udp_decode(data):
+
+	if data[:1] == b'{':
+		return json.loads(data.decode('utf-8'))
+	return msgpack_decode(data)
+
+#----------------------------------------------------------------------------------------
+def dl_udp_listen():
+
+	parser = argparse.ArgumentParser(description='Listen for DataLogger UDP telemetry datagrams')
+	parser.add_argument('--host', default='0.0.0.0', help='address to listen on')
+	parser.add_argument('--port', type=int, default=5005, help='UDP port to listen on')
+	parser.add_argument('--report', type=float, default=10, help='report interval (secs)')
+	parser.add_argument('--echo', action='store_true', help='output received observations')
+	args = parser.parse_args()
+
+	sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	sock.bind((args.host, args.port))
+	sock.settimeout(1)
+
+	print('UDP listener on {}:{}'.format(args.host, args.port), file=sys.stderr, flush=True)
+
+	devices = {}
+	next_report = time.time() + args.report
+	n_bytes = 0
+	n_errors = 0
+
+	try:
+		while True:
+			try:
+				data, addr = sock.recvfrom(65535)
+
+				datagram = _dl_udp_decode(data)
+				device = devices.setdefault(datagram.get('dev', addr[0]), dlUDPDevice())
+				device.datagrams += 1
+				n_bytes += len(data)
+				if not device.sequence(int(datagram['seq'])):
+					continue
+				device.payloads += len(datagram['p'])
+
+				for payload in datagram['p']:
+					for obs in device.decoder.decode(payload):
+						if args.echo:
+							print(json.dumps(obs), flush=True)
+
+			except socket.timeout:
+				pass
+			except (ValueError, KeyError, IndexError, TypeError) as err:
+				n_errors += 1
+				print('Unable to decode datagram: {}'.format(err), file=sys.stderr)
+
+			if time.time() >= next_report:
+				next_report = time.time() + args.report
+				for name, device in devices.items():
+					print('{}: datagrams: {}  payloads: {}  lost: {}  duplicates: {}  out of order: {}  '
+						  'restarts: {}  bytes: {}  decode errors: {}'.format(name, device.datagrams, device.payloads,
+						  device.lost, device.duplicates, device.out_of_order, device.restarts, n_bytes,
+						  n_errors), file=sys.stderr, flush=True)
+
+	except KeyboardInterrupt:
+		pass
+
+if __name__ == '__main__':
+	dl_udp_listen()